@@ -0,0 +1,147 @@
+#include "BufferPool.h"
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <vector>
+
+using pgp::utils::BufferPool;
+
+namespace
+{
+    /* bytes worth of blocks a single thread keeps per size class */
+    constexpr size_t local_cache_bytes{ 32 * 1024 * 1024 };
+    /* the shared depot keeps this many times the local limit */
+    constexpr size_t depot_factor{ 4 };
+    /* bytes the shared depot keeps over all size classes, so it can't pin memory after a burst of large blocks */
+    constexpr size_t depot_max_bytes{ 64 * 1024 * 1024 };
+
+    using FreeList = std::vector<BufferPool::Block>;
+    using FreeLists = std::array<FreeList, BufferPool::class_count>;
+
+    size_t class_bits(size_t size)
+    {
+        size_t bits = BufferPool::min_class_bits;
+        while (bits <= BufferPool::max_class_bits && (size_t{ 1 } << bits) < size) bits++;
+        return bits;
+    }
+
+    /* amount of blocks of a class a thread caches, at most eight, classes larger than the per thread budget are not cached */
+    size_t local_limit(size_t bits)
+    {
+        return std::min<size_t>(local_cache_bytes >> bits, 8);
+    }
+
+    /* blocks overflowing the thread caches, shared between all threads */
+    struct Depot
+    {
+        std::mutex mutex;
+        FreeLists lists;
+        size_t bytes{ 0 };
+
+        /* @brief Keep a block if the class and the depot still have room, the mutex has to be held */
+        void offer(BufferPool::Block block, size_t index)
+        {
+            const auto bits = index + BufferPool::min_class_bits;
+            const auto capacity = size_t{ 1 } << bits;
+
+            if (lists[index].size() >= local_limit(bits) * depot_factor || bytes + capacity > depot_max_bytes) return;
+
+            lists[index].push_back(std::move(block));
+            bytes += capacity;
+        }
+
+        /* @brief Take a block of a class, the mutex has to be held
+        @return empty block if there is none */
+        BufferPool::Block take(size_t index)
+        {
+            auto& list = lists[index];
+            if (list.empty()) return {};
+
+            auto block = std::move(list.back());
+            list.pop_back();
+            bytes -= size_t{ 1 } << (index + BufferPool::min_class_bits);
+            return block;
+        }
+    };
+
+    Depot& depot()
+    {
+        static Depot instance;
+        return instance;
+    }
+
+    /* per thread cache, handed to the depot when the thread exits */
+    struct LocalCache
+    {
+        FreeLists lists;
+
+        ~LocalCache()
+        {
+            auto& shared = depot();
+            std::lock_guard lock(shared.mutex);
+
+            for (size_t i = 0; i < lists.size(); i++)
+                for (auto& block : lists[i])
+                    shared.offer(std::move(block), i);
+        }
+    };
+
+    thread_local LocalCache local_cache;
+}
+
+size_t BufferPool::class_capacity(size_t size)
+{
+    const auto bits = class_bits(size);
+    return bits > max_class_bits ? size : size_t{ 1 } << bits;
+}
+
+BufferPool::Block BufferPool::acquire(size_t min_capacity, size_t& capacity)
+{
+    const auto bits = class_bits(min_capacity);
+
+    if (bits > max_class_bits)
+    { /* too large to be worth caching */
+        capacity = min_capacity;
+        return Block(new uint8_t[capacity]);
+    }
+
+    capacity = size_t{ 1 } << bits;
+    const auto index = bits - min_class_bits;
+
+    if (auto& list = local_cache.lists[index]; !list.empty())
+    {
+        auto block = std::move(list.back());
+        list.pop_back();
+        return block;
+    }
+
+    {
+        auto& shared = depot();
+        std::lock_guard lock(shared.mutex);
+
+        if (auto block = shared.take(index)) return block;
+    }
+
+    return Block(new uint8_t[capacity]);
+}
+
+void BufferPool::release(Block block, size_t capacity)
+{
+    const auto bits = class_bits(capacity);
+
+    /* only blocks with an exact class size came from a size class */
+    if (!block || bits > max_class_bits || (size_t{ 1 } << bits) != capacity) return;
+
+    const auto index = bits - min_class_bits;
+
+    if (auto& list = local_cache.lists[index]; list.size() < local_limit(bits))
+    {
+        list.push_back(std::move(block));
+        return;
+    }
+
+    auto& shared = depot();
+    std::lock_guard lock(shared.mutex);
+    shared.offer(std::move(block), index);
+}
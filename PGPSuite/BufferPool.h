@@ -0,0 +1,147 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "Tracing.h"
+
+namespace pgp::utils
+{
+    /* Pool of reusable byte blocks so repeated operations reuse warm memory instead of allocating and growing every time
+    * Blocks are grouped in power of two size classes, every thread keeps a small cache of its own
+    * and overflows into a shared depot, so blocks released by one thread (e.g. a writer) can be picked up by another (e.g. a worker) */
+    class BufferPool
+    {
+    public:
+        using Block = std::unique_ptr<uint8_t[]>;
+
+        /* smallest size class, 4 KiB */
+        static constexpr size_t min_class_bits{ 12 };
+        /* largest size class, 64 MiB, larger blocks are allocated exactly and never cached
+        * classes over the 32 MiB a thread caches are handed out but freed on release, the shared depot is capped at 64 MiB in total */
+        static constexpr size_t max_class_bits{ 26 };
+        static constexpr size_t class_count{ max_class_bits - min_class_bits + 1 };
+
+        /* @brief Get a block of at least min_capacity bytes, the contents are undefined
+        @param capacity: receives the real size of the block */
+        static Block acquire(size_t min_capacity, size_t& capacity);
+
+        /* @brief Return a block to the pool, capacity has to be the one given by acquire */
+        static void release(Block block, size_t capacity);
+
+        /* @brief Rounds a size up to the capacity of its size class */
+        static size_t class_capacity(size_t size);
+    };
+
+    /* Growable byte buffer which takes its storage from the BufferPool and returns it on destruction
+    * Unlike std::vector growing or resizing never zero fills the memory */
+    class PooledBuffer
+    {
+    protected:
+        BufferPool::Block _storage;
+        size_t _capacity{ 0 };
+        size_t _size{ 0 };
+    public:
+        PooledBuffer() = default;
+        /* @param capacity: bytes to reserve up front */
+        explicit PooledBuffer(size_t capacity) { reserve(capacity); }
+        PooledBuffer(const PooledBuffer&) = delete;
+        PooledBuffer(PooledBuffer&& other) noexcept { *this = std::move(other); }
+        ~PooledBuffer() { reset(); }
+
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+        PooledBuffer& operator=(PooledBuffer&& other) noexcept
+        {
+            if (this == &other) return *this;
+
+            reset();
+            _storage = std::move(other._storage);
+            _capacity = std::exchange(other._capacity, 0);
+            _size = std::exchange(other._size, 0);
+
+            return *this;
+        }
+
+        uint8_t* data() { return _storage.get(); }
+        const uint8_t* data() const { return _storage.get(); }
+        size_t size() const { return _size; }
+        size_t capacity() const { return _capacity; }
+        bool empty() const { return _size == 0; }
+
+        /* @brief Make sure at least capacity bytes fit without reallocating, existing data is kept */
+        void reserve(size_t capacity)
+        {
+            if (capacity <= _capacity) return;
+
+            size_t new_capacity{ 0 };
+            auto block = BufferPool::acquire(capacity, new_capacity);
+
+            if (_size > 0) std::memcpy(block.get(), _storage.get(), _size);
+            if (_storage) BufferPool::release(std::move(_storage), _capacity);
+
+            _storage = std::move(block);
+            _capacity = new_capacity;
+        }
+
+        /* @brief Change the size, new bytes are left uninitialized */
+        void resize(size_t size)
+        {
+            reserve(size);
+            _size = size;
+        }
+
+        void append(const void* bytes, size_t len)
+        {
+            /* grow geometrically so many small writes don't reallocate every time */
+            if (_size + len > _capacity) reserve(std::max<size_t>(_size + len, _capacity * 2));
+
+            std::memcpy(_storage.get() + _size, bytes, len);
+            _size += len;
+        }
+
+        /* @brief Forget the contents but keep the memory for reuse */
+        void clear() { _size = 0; }
+
+        /* @brief Hand the memory back to the pool */
+        void reset()
+        {
+            if (_storage) BufferPool::release(std::move(_storage), _capacity);
+            _capacity = 0;
+            _size = 0;
+        }
+
+        /* rnp_output_writer_t compatible callback, app_ctx has to be a PooledBuffer */
+        static bool writer_callback(void* app_ctx, const void* buf, size_t len)
+        {
+            trace::Span span("buffer write");
+            static_cast<PooledBuffer*>(app_ctx)->append(buf, len);
+            return true;
+        }
+    };
+}
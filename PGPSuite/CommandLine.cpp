@@ -0,0 +1,818 @@
+#include "CommandLine.h"
+#include "PGPBatch.h"
+#include "PGPDecrypt.h"
+#include "PGPAutoTune.h"
+#include "PGPKeyProfiles.h"
+#include "PGPKeyImport.h"
+#include "PGPWatchFolder.h"
+#include "PGPDaemon.h"
+#include "PGPManifest.h"
+#include "PGPJournal.h"
+#include "KeyIndex.h"
+#include "PGPSegmented.h"
+#include "PersistentData.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <Windows.h>
+
+using namespace suite;
+
+namespace
+{
+    /* @brief Prints the outcome of every job as it finishes and counts the failures */
+    struct BatchReporter
+    {
+        size_t failed{ 0 };
+        /* print the measurements of every file */
+        bool show_metrics{ false };
+
+        void operator()(const pgp::batch::JobResult& result)
+        {
+            if (result.result)
+                std::cout << "ok     " << result.source << " -> " << result.destination << '\n';
+            else
+            {
+                failed++;
+                std::cout << "FAILED " << result.source << ": " << result.result.what() << '\n';
+            }
+
+            if (show_metrics && result.result.metrics())
+                std::cout << "       " << result.result.metrics()->summary() << '\n';
+        }
+    };
+
+    /* @return Usage error for an option whose value is not a whole number */
+    std::string invalid_number(const cli::Arguments& args, const std::string& name)
+    {
+        return "Invalid --" + name + '=' + args.get(name) + ", expected a whole number.\n";
+    }
+
+    /* @brief Read the options every batch command shares
+    @return A usage error if a value makes no sense */
+    pgp::OpRes batch_options(const cli::Arguments& args, pgp::batch::Options& options)
+    {
+        auto write_block_kb = options.write_block_size / 1024;
+
+        for (const auto& [name, value] : { std::pair{ "workers", &options.workers }, std::pair{ "queue", &options.queue_depth },
+            std::pair{ "max-buffered", &options.max_buffered_size }, std::pair{ "write-block-kb", &write_block_kb }, std::pair{ "io-depth", &options.io_depth } })
+            if (!args.get_number(name, *value)) return invalid_number(args, name);
+
+        options.write_block_size = write_block_kb * 1024;
+        options.unbuffered_writes = args.has("unbuffered");
+
+        const auto io = args.get("io", "blocking");
+        if (io != "blocking" && io != "overlapped") return "Unknown --io=" + io + ", use blocking or overlapped.\n";
+        options.io_backend = io == "overlapped" ? pgp::utils::IOBackend::Overlapped : pgp::utils::IOBackend::Blocking;
+
+        if (options.io_depth == 0) return "--io-depth has to be at least 1.\n";
+
+        return true;
+    }
+
+    /* @brief Run the jobs and report on them, with --journal every finished job is recorded and --resume skips what an earlier run finished
+    @param done: what happened to the files, for the summary */
+    int run_batch(const cli::Arguments& args, std::vector<pgp::batch::Job> jobs, pgp::batch::WorkerFactory factory, const char* done)
+    {
+        pgp::batch::Options options;
+        if (auto res = batch_options(args, options); !res)
+        {
+            std::cerr << res.what();
+            return 2;
+        }
+
+        BatchReporter reporter;
+        reporter.show_metrics = args.has("metrics");
+
+        pgp::journal::Journal journal;
+        const auto journaled = args.has("journal");
+        size_t skipped{ 0 };
+
+        if (journaled)
+        {
+            if (auto res = journal.open(args.get("journal"), args.has("resume")); !res)
+            {
+                std::cerr << res.what() << '\n';
+                return 1;
+            }
+
+            jobs = journal.remaining(jobs, skipped);
+        }
+        else if (args.has("resume"))
+        {
+            std::cerr << "--resume needs the --journal of the run to resume.\n";
+            return 2;
+        }
+
+        pgp::batch::run(jobs, std::move(factory), options, [&](const pgp::batch::JobResult& result)
+            {
+                reporter(result);
+
+                if (!journaled) return;
+                if (auto res = journal.record(result); !res) std::cerr << res.what() << '\n';
+            });
+
+        std::cout << jobs.size() - reporter.failed << " of " << jobs.size() << " files " << done;
+        if (skipped > 0) std::cout << ", " << skipped << " finished earlier";
+        std::cout << ".\n";
+
+        return reporter.failed == 0 ? 0 : 1;
+    }
+
+    /* @brief Encrypt only what changed since the last run, according to the manifest in the output directory */
+    int encrypt_incremental(const cli::Arguments& args, std::vector<pgp::batch::Job> jobs, bool auto_tune)
+    {
+        const auto pubkey = args.get("pubkey");
+        const auto userid = args.get("userid");
+        const auto password = args.get("password");
+        auto manifest_file = args.get("incremental");
+
+        pgp::batch::Options options;
+        if (auto res = batch_options(args, options); !res)
+        {
+            std::cerr << res.what();
+            return 2;
+        }
+
+        if (manifest_file.empty())
+        {
+            if (args.get("out").empty())
+            {
+                std::cerr << "Provide --out or --incremental=manifest, the manifest is kept next to the output.\n";
+                return 2;
+            }
+
+            manifest_file = pgp::utils::from_path(pgp::utils::to_path(args.get("out")) / pgp::manifest::default_name);
+        }
+
+        /* the recipient is exported once, it both identifies the recipients and feeds the workers */
+        auto recipient = std::make_shared<std::vector<uint8_t>>();
+        if (!pubkey.empty())
+        {
+            if (auto res = pgp::export_recipient(pubkey, userid, *recipient); !res)
+            {
+                std::cerr << res.what() << '\n';
+                return 1;
+            }
+        }
+
+        pgp::manifest::Manifest manifest;
+        if (auto res = manifest.load(manifest_file); !res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        const auto plan = pgp::manifest::plan(jobs, manifest, pgp::manifest::describe_recipients(*recipient, !password.empty()));
+
+        BatchReporter reporter;
+        reporter.show_metrics = args.has("metrics");
+        const auto results = pgp::batch::run(plan.jobs, pgp::batch::encrypt_worker(recipient, userid, password, auto_tune), options, std::ref(reporter));
+
+        /* saved even after failures, so what did succeed is not done again */
+        pgp::manifest::record(manifest, plan, results);
+        if (auto res = manifest.save(manifest_file); !res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        std::cout << plan.jobs.size() - reporter.failed << " of " << plan.jobs.size() << " files encrypted, " << plan.skipped << " unchanged.\n";
+        return reporter.failed == 0 ? 0 : 1;
+    }
+
+    int encrypt_batch(const cli::Arguments& args)
+    {
+        const auto pubkey = args.get("pubkey");
+        const auto userid = args.get("userid");
+        const auto password = args.get("password");
+
+        if ((pubkey.empty() || userid.empty()) && password.empty())
+        {
+            std::cerr << "Provide either --pubkey and --userid, --password or both.\n";
+            return 2;
+        }
+
+        auto jobs = pgp::batch::collect_jobs(args.positional, args.get("out"), [](const std::string& name) { return name + ".asc"; });
+        const auto auto_tune = args.has("auto-tune") || pgp::tune::enabled();
+
+        if (args.has("incremental"))
+        {
+            /* the manifest already records what was done, a journal would only compete with it */
+            if (args.has("journal") || args.has("resume"))
+            {
+                std::cerr << "--incremental can not be combined with --journal or --resume.\n";
+                return 2;
+            }
+
+            return encrypt_incremental(args, std::move(jobs), auto_tune);
+        }
+
+        return run_batch(args, std::move(jobs), pgp::batch::encrypt_worker(pubkey, userid, password, auto_tune), "encrypted");
+    }
+
+    int decrypt_batch(const cli::Arguments& args)
+    {
+        auto jobs = pgp::batch::collect_jobs(args.positional, args.get("out"), pgp::utils::remove_extension);
+
+        return run_batch(args, std::move(jobs), pgp::batch::decrypt_worker(args.get("secring"), args.get("password")), "decrypted");
+    }
+
+    int encrypt_segmented(const cli::Arguments& args)
+    {
+        if (args.positional.size() != 1)
+        {
+            std::cerr << "Provide exactly one file to encrypt.\n";
+            return 2;
+        }
+
+        const auto file = args.positional.front();
+        auto sign_password = args.get("sign-password");
+
+        pgp::segmented::EncryptSettings settings;
+        settings.pubkey_file = args.get("pubkey");
+        settings.userid = args.get("userid");
+        settings.password = args.get("password");
+        settings.signer_secring = args.get("sign-key");
+        settings.signer_userid = args.get("signer");
+        settings.passprovider = pgp::context_pass_provider;
+        settings.pass_context = &sign_password;
+
+        size_t segment_mb = settings.segment_size / (1024 * 1024);
+        for (const auto& [name, value] : { std::pair{ "segment-mb", &segment_mb }, std::pair{ "workers", &settings.workers } })
+            if (!args.get_number(name, *value))
+            {
+                std::cerr << invalid_number(args, name);
+                return 2;
+            }
+        settings.segment_size = uint64_t{ segment_mb } * 1024 * 1024;
+
+        if (args.has("auto-tune") || pgp::tune::enabled()) settings.options = pgp::tune::choose_for_file(file);
+
+        const auto res = pgp::segmented::encrypt_file(file, args.get("out", file + ".pgpseg"), settings);
+
+        if (!res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        if (args.has("metrics") && res.metrics()) std::cout << res.metrics()->summary() << '\n';
+        return 0;
+    }
+
+    int decrypt_segmented(const cli::Arguments& args)
+    {
+        if (args.positional.size() != 1)
+        {
+            std::cerr << "Provide exactly one segmented directory to decrypt.\n";
+            return 2;
+        }
+
+        const auto directory = args.positional.front();
+
+        pgp::segmented::DecryptSettings settings;
+        settings.secring_file = args.get("secring");
+        settings.password = args.get("password");
+        settings.signer_pubkey = args.get("signer-key");
+        if (!args.get_number("workers", settings.workers))
+        {
+            std::cerr << invalid_number(args, "workers");
+            return 2;
+        }
+
+        auto output = args.get("out");
+        if (output.empty())
+        {
+            /* only the name is taken from the index, never a path */
+            pgp::segmented::Index index;
+            if (auto res = pgp::segmented::read_index(directory, settings.signer_pubkey, index); !res)
+            {
+                std::cerr << res.what() << '\n';
+                return 1;
+            }
+
+            const auto parent = pgp::utils::to_path(directory).lexically_normal().parent_path();
+            output = pgp::utils::from_path(parent / pgp::utils::to_path(index.name).filename());
+        }
+
+        const auto res = pgp::segmented::decrypt_file(directory, output, settings);
+
+        if (!res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        if (args.has("metrics") && res.metrics()) std::cout << res.metrics()->summary() << '\n';
+        return 0;
+    }
+
+    /* @brief Check every message can still be decrypted intact, nothing is written but the report */
+    int verify_dir(const cli::Arguments& args)
+    {
+        if (args.positional.empty())
+        {
+            std::cerr << "Provide the files or directories to check.\n";
+            return 2;
+        }
+
+        pgp::batch::Options options;
+        if (auto res = batch_options(args, options); !res)
+        {
+            std::cerr << res.what();
+            return 2;
+        }
+
+        auto jobs = pgp::batch::collect_jobs(args.positional, {}, [](const std::string&) { return std::string{}; });
+
+        /* directories hold more than messages, only what starts like one is checked */
+        const auto collected = jobs.size();
+        std::erase_if(jobs, [](const pgp::batch::Job& job) { return !pgp::looks_like_message(job.source); });
+        const auto skipped = collected - jobs.size();
+
+        std::ofstream report;
+        if (args.has("report"))
+        {
+            report.open(pgp::utils::to_path(args.get("report")), std::ios::binary | std::ios::trunc);
+            if (!report)
+            {
+                std::cerr << "Could not create: " << args.get("report") << '\n';
+                return 1;
+            }
+        }
+
+        size_t failed{ 0 };
+        pgp::batch::run(jobs, pgp::batch::verify_worker(args.get("secring"), args.get("password")), options, [&](const pgp::batch::JobResult& result)
+            {
+                /* messages end with a line break, the report has one line per file */
+                auto reason = result.result.what();
+                while (!reason.empty() && reason.back() == '\n') reason.pop_back();
+                std::replace(reason.begin(), reason.end(), '\n', ' ');
+
+                if (!result.result) failed++;
+
+                std::cout << (result.result ? "PASS   " : "FAIL   ") << result.source << "  " << (result.result ? result.note : reason) << '\n';
+
+                if (report.is_open())
+                    report << (result.result ? "PASS" : "FAIL") << '\t' << result.source << '\t' << result.note << '\t' << reason << '\n';
+            });
+
+        std::cout << jobs.size() - failed << " of " << jobs.size() << " files passed";
+        if (skipped > 0) std::cout << ", " << skipped << " skipped as not encrypted messages";
+        std::cout << ".\n";
+
+        return failed == 0 ? 0 : 1;
+    }
+
+    /* @brief Build the key index of a directory of keyrings up front, decrypting with the directory as keyring uses it */
+    int index_keyrings(const cli::Arguments& args)
+    {
+        if (args.positional.size() != 1)
+        {
+            std::cerr << "Provide the directory of keyrings to index.\n";
+            return 2;
+        }
+
+        pgp::keyring::KeyIndex index;
+        bool rebuilt{ false };
+
+        if (auto res = index.open(args.positional.front(), rebuilt); !res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        std::cout << (rebuilt ? "Indexed " : "Index up to date, ") << index.keys() << " key ids in " << index.keyrings() << " files.\n";
+        return 0;
+    }
+
+    int import_keys(const cli::Arguments& args)
+    {
+        const auto keyring = args.get("keyring");
+
+        if (keyring.empty() || args.positional.empty())
+        {
+            std::cerr << "Provide --keyring and the key files or directories to import.\n";
+            return 2;
+        }
+
+        std::vector<std::string> files;
+        for (const auto& job : pgp::batch::collect_jobs(args.positional, {}, [](const std::string& name) { return name; }))
+            files.push_back(job.source);
+
+        size_t workers{ 0 };
+        if (!args.get_number("workers", workers))
+        {
+            std::cerr << invalid_number(args, "workers");
+            return 2;
+        }
+
+        pgp::ImportSummary summary;
+        const auto res = pgp::import_keys(files, keyring, summary, workers, [](const pgp::ImportResult& result)
+            {
+                if (!result.result) std::cout << "FAILED " << result.path << ": " << result.result.what() << '\n';
+            });
+
+        if (!res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        std::cout << summary.files - summary.failed << " of " << summary.files << " files imported, "
+            << summary.keys_after << " keys in " << keyring << " (" << summary.keys_after - summary.keys_before << " new).\n";
+        return summary.failed == 0 ? 0 : 1;
+    }
+
+    /* the watcher ctrl+c should stop */
+    std::atomic<pgp::watch::Watcher*> active_watcher{ nullptr };
+
+    BOOL WINAPI stop_watching(DWORD)
+    {
+        if (auto* watcher = active_watcher.load()) watcher->stop();
+        return TRUE;
+    }
+
+    int watch_folder(const cli::Arguments& args)
+    {
+        if (args.positional.size() != 1 || !args.has("outbox"))
+        {
+            std::cerr << "Provide --outbox and the folder to watch.\n";
+            return 2;
+        }
+
+        pgp::watch::Options options;
+        options.inbox = args.positional.front();
+        options.outbox = args.get("outbox");
+        options.pubkey_file = args.get("pubkey");
+        options.userid = args.get("userid");
+        options.password = args.get("password");
+        options.originals = args.has("delete-originals") ? pgp::watch::Originals::Delete : pgp::watch::Originals::Move;
+        options.sent_dir = args.get("sent");
+
+        auto settle_ms = static_cast<size_t>(options.settle.count()), poll_ms = static_cast<size_t>(options.poll_interval.count());
+        for (const auto& [name, value] : { std::pair{ "settle-ms", &settle_ms }, std::pair{ "poll-ms", &poll_ms } })
+            if (!args.get_number(name, *value))
+            {
+                std::cerr << invalid_number(args, name);
+                return 2;
+            }
+        options.settle = std::chrono::milliseconds(settle_ms);
+        options.poll_interval = std::chrono::milliseconds(poll_ms);
+        options.auto_tune = args.has("auto-tune") || pgp::tune::enabled();
+        if (auto res = batch_options(args, options.batch); !res)
+        {
+            std::cerr << res.what();
+            return 2;
+        }
+
+        BatchReporter reporter;
+        reporter.show_metrics = args.has("metrics");
+
+        pgp::watch::Watcher watcher(options, std::ref(reporter));
+
+        active_watcher = &watcher;
+        SetConsoleCtrlHandler(stop_watching, TRUE);
+
+        std::cout << "Watching " << options.inbox << ", press ctrl+c to stop.\n";
+        const auto res = watcher.run();
+
+        SetConsoleCtrlHandler(stop_watching, FALSE);
+        active_watcher = nullptr;
+
+        if (!res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        return reporter.failed == 0 ? 0 : 1;
+    }
+
+    int run_daemon(const cli::Arguments& args)
+    {
+        pgp::daemon::Options options;
+        options.socket_path = args.get("socket", options.socket_path);
+        options.pubkey_file = args.get("pubkey");
+        options.secring_file = args.get("secring");
+        options.unlock_password = args.get("unlock");
+        if (!args.get_number("workers", options.workers))
+        {
+            std::cerr << invalid_number(args, "workers");
+            return 2;
+        }
+
+        pgp::daemon::Server server(options);
+
+        std::cout << "Serving on " << options.socket_path << ", stop with --client --op=stop\n";
+
+        if (auto res = server.run(); !res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        return 0;
+    }
+
+    /* @brief Send a single request to the daemon, encrypted and decrypted data is written next to the input unless --out is given */
+    int run_client(const cli::Arguments& args)
+    {
+        using pgp::daemon::Operation;
+
+        static const std::map<std::string, Operation> operations
+        {
+            { "ping", Operation::Ping }, { "encrypt", Operation::Encrypt }, { "decrypt", Operation::Decrypt }, { "verify", Operation::Verify }, { "stop", Operation::Shutdown },
+        };
+
+        const auto operation = operations.find(args.get("op"));
+        if (operation == operations.end())
+        {
+            std::cerr << "Provide --op=ping|encrypt|decrypt|verify|stop.\n";
+            return 2;
+        }
+
+        pgp::daemon::Message request, response;
+        request.code = static_cast<uint8_t>(operation->second);
+
+        const bool has_data = operation->second == Operation::Encrypt || operation->second == Operation::Decrypt || operation->second == Operation::Verify;
+        const auto input = args.positional.empty() ? std::string() : args.positional.front();
+
+        if (has_data)
+        {
+            std::ifstream file(pgp::utils::to_path(input), std::ios::binary);
+            if (input.empty() || !file)
+            {
+                std::cerr << "Could not open: " << input << '\n';
+                return 2;
+            }
+
+            request.add(std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+        }
+
+        if (operation->second == Operation::Encrypt)
+        {
+            request.add(args.get("userid"));
+            request.add(args.get("password"));
+            request.add(args.get("armor") == "no" ? "0" : "1");
+        }
+        else if (operation->second == Operation::Decrypt)
+            request.add(args.get("password"));
+
+        pgp::daemon::Client client;
+        auto res = client.connect(args.get("socket", pgp::daemon::default_socket_path()));
+        if (res) res = client.request(request, response);
+
+        if (!res)
+        {
+            std::cerr << res.what() << '\n';
+            return 1;
+        }
+
+        if (operation->second == Operation::Verify)
+            std::cout << response.text(0);
+        else if (operation->second == Operation::Encrypt || operation->second == Operation::Decrypt)
+        {
+            const auto out = args.get("out", operation->second == Operation::Encrypt ? input + ".asc" : pgp::utils::remove_extension(input));
+            std::ofstream file(pgp::utils::to_path(out), std::ios::binary | std::ios::trunc);
+
+            if (response.fields.empty() || !file.write(reinterpret_cast<const char*>(response.fields[0].data()), response.fields[0].size()))
+            {
+                std::cerr << "Failed writing: " << out << '\n';
+                return 1;
+            }
+
+            std::cout << input << " -> " << out << '\n';
+        }
+        else
+            std::cout << "ok\n";
+
+        return 0;
+    }
+
+    int benchmark_keys(const cli::Arguments& args)
+    {
+        size_t rounds{ 5 };
+        if (!args.get_number("rounds", rounds))
+        {
+            std::cerr << invalid_number(args, "rounds");
+            return 2;
+        }
+
+        int failed = 0;
+
+        for (const auto& profile : pgp::key_profiles())
+        {
+            pgp::ProfileCost cost;
+            const auto res = pgp::benchmark_profile(profile, cost, rounds);
+
+            if (res)
+                std::cout << profile.id << "\t" << profile.label << ": " << cost.describe() << '\n';
+            else
+            {
+                failed = 1;
+                std::cout << profile.id << "\t" << profile.label << ": FAILED " << res.what() << '\n';
+            }
+        }
+
+        return failed;
+    }
+
+    int calibrate(const cli::Arguments&)
+    {
+        pgp::tune::Calibration calibration;
+
+        if (auto res = pgp::tune::calibrate(calibration); !res)
+        {
+            std::cerr << res.what();
+            return 1;
+        }
+
+        auto& settings = suite::persistent::settings();
+        pgp::tune::store(settings, calibration);
+        suite::persistent::save_settings();
+
+        std::cout << "AES instructions: " << (calibration.aes_ni ? "yes" : "no") << '\n';
+        for (const auto& sample : calibration.ciphers)
+            std::cout << sample.cipher << "\t" << sample.throughput << " MiB/s\n";
+        for (const auto& sample : calibration.compression)
+            std::cout << sample.algorithm << " " << sample.level << "\t" << sample.throughput << " MiB/s, " << sample.ratio * 100 << "% of input\n";
+
+        const auto chosen = pgp::tune::choose(calibration, pgp::tune::load_policy(settings), nullptr, 0);
+        std::cout << "Chosen for text: " << chosen.cipher << ", " << chosen.compression << " " << chosen.compression_level << '\n';
+        return 0;
+    }
+
+    int print_help(const cli::Arguments&);
+
+    /* ordered so --help lists them alphabetically */
+    const std::map<std::string, cli::Command> commands
+    {
+        { "--benchmark-keys", { "[--rounds=n]", benchmark_keys } },
+        { "--calibrate", { "", calibrate } },
+        { "--client", { "--op=ping|encrypt|decrypt|verify|stop [--socket=path] [--userid=id] [--password | --password-file=file] [--armor=no] [--out=file] [file]", run_client } },
+        { "--daemon", { "[--socket=path] [--pubkey=file|gnupg home] [--secring=file|gnupg home|keyring dir] [--unlock | --unlock-file=file] [--workers=n]", run_daemon } },
+        { "--decrypt-batch", { "[--secring=file|gnupg home|keyring dir] [--password | --password-file=file] [--out=dir] [--workers=n] [--queue=n] [--write-block-kb=n] [--unbuffered] [--io=blocking|overlapped [--io-depth=n]] [--journal=file [--resume]] [--metrics] files/dirs...", decrypt_batch } },
+        { "--decrypt-segmented", { "--signer-key=file|gnupg home [--secring=file|gnupg home|keyring dir] [--password | --password-file=file] [--out=file] [--workers=n] [--metrics] directory", decrypt_segmented } },
+        { "--encrypt-batch", { "[--pubkey=file|gnupg home --userid=id] [--password | --password-file=file] [--out=dir] [--workers=n] [--queue=n] [--write-block-kb=n] [--unbuffered] [--io=blocking|overlapped [--io-depth=n]] [--auto-tune] [--incremental[=manifest] | --journal=file [--resume]] [--metrics] files/dirs...", encrypt_batch } },
+        { "--encrypt-segmented", { "--sign-key=file|gnupg home --signer=id [--sign-password | --sign-password-file=file] [--pubkey=file|gnupg home --userid=id] [--password | --password-file=file] [--segment-mb=n] [--out=dir] [--workers=n] [--auto-tune] [--metrics] file", encrypt_segmented } },
+        { "--help", { "", print_help } },
+        { "--index-keyrings", { "directory", index_keyrings } },
+        { "--import-keys", { "--keyring=file [--workers=n] files/dirs...", import_keys } },
+        { "--verify-dir", { "[--secring=file|gnupg home|keyring dir] [--password | --password-file=file] [--report=file] [--workers=n] [--queue=n] [--io=blocking|overlapped [--io-depth=n]] files/dirs...", verify_dir } },
+        { "--watch", { "--outbox=dir [--pubkey=file|gnupg home --userid=id] [--password | --password-file=file] [--delete-originals | --sent=dir] [--settle-ms=n] [--poll-ms=n] [--workers=n] [--auto-tune] [--metrics] folder", watch_folder } },
+    };
+
+    int print_help(const cli::Arguments&)
+    {
+        std::cout << "Usage: PGPSuite.exe <command> [--option=value]... [--trace=file.json] [file]...\n\nCommands:\n";
+        for (const auto& [name, command] : commands)
+            std::cout << "  " << name << ' ' << command.usage << '\n';
+
+        std::cout << "\nSecrets (--password, --unlock, --sign-password):\n"
+            "  --<name>-file=file reads the first line of file, --<name>=- reads a line from stdin, a bare --<name> asks for it.\n"
+            "  --<name>=value works as well, but every user of the machine can read it from the process list.\n";
+        return 0;
+    }
+
+    /* options holding a secret, a value given on the command line can be read by every user from the process list */
+    constexpr std::array<const char*, 3> secret_options{ "password", "unlock", "sign-password" };
+
+    /* @brief Read a line from the console without echoing it, a redirected stdin is read as is */
+    std::string prompt_hidden(const std::string& prompt)
+    {
+        const auto input = GetStdHandle(STD_INPUT_HANDLE);
+        DWORD mode{ 0 };
+        const bool console = GetConsoleMode(input, &mode);
+
+        std::cerr << prompt;
+        if (console) SetConsoleMode(input, mode & ~ENABLE_ECHO_INPUT);
+
+        std::string line;
+        std::getline(std::cin, line);
+
+        if (console)
+        {
+            SetConsoleMode(input, mode);
+            std::cerr << '\n';
+        }
+
+        return line;
+    }
+
+    /* @brief Fill in the secret options from where other users can not see them
+    * --name-file=file reads the first line of a file, --name=- reads a line from stdin and a bare --name prompts for it.
+    * --name=value still works for scripts that accept the risk
+    @return A usage error if a secret file can not be read */
+    pgp::OpRes resolve_secrets(cli::Arguments& args)
+    {
+        for (const std::string name : secret_options)
+        {
+            std::string value;
+
+            if (args.has(name + "-file"))
+            {
+                if (args.has(name)) return "Give either --" + name + " or --" + name + "-file, not both.\n";
+
+                const auto path = args.get(name + "-file");
+                std::ifstream file(pgp::utils::to_path(path), std::ios::binary);
+                if (!file || !std::getline(file, value)) return "Could not read --" + name + "-file: " + path + '\n';
+            }
+            else if (args.get(name) == "-")
+                std::getline(std::cin, value);
+            else if (args.has(name) && args.get(name).empty())
+                value = prompt_hidden(name + ": ");
+            else
+                continue;
+
+            if (!value.empty() && value.back() == '\r') value.pop_back();
+            args.options[name] = std::move(value);
+        }
+
+        return true;
+    }
+
+    /* the application is a windows subsystem program, so it has to borrow the console of whoever started it */
+    void attach_console()
+    {
+        if (!AttachConsole(ATTACH_PARENT_PROCESS)) return;
+
+        FILE* stream{ nullptr };
+        freopen_s(&stream, "CONOUT$", "w", stdout);
+        freopen_s(&stream, "CONOUT$", "w", stderr);
+        freopen_s(&stream, "CONIN$", "r", stdin);
+    }
+}
+
+cli::Arguments cli::parse(const std::vector<std::string>& args)
+{
+    Arguments parsed;
+
+    if (args.size() > 1) parsed.command = args[1];
+
+    for (size_t i = 2; i < args.size(); i++)
+    {
+        const auto& arg = args[i];
+
+        if (arg.rfind("--", 0) != 0)
+        {
+            parsed.positional.push_back(arg);
+            continue;
+        }
+
+        const auto equals = arg.find('=');
+        if (equals == arg.npos)
+            parsed.options[arg.substr(2)] = "";
+        else
+            parsed.options[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+    }
+
+    return parsed;
+}
+
+bool cli::is_cli_invocation(const std::vector<std::string>& args)
+{
+    return args.size() > 1 && commands.find(args[1]) != commands.end();
+}
+
+int cli::run(const std::vector<std::string>& args)
+{
+    attach_console();
+
+    auto parsed = parse(args);
+    const auto command = commands.find(parsed.command);
+
+    if (command == commands.end())
+    {
+        std::cerr << "Unknown command: " << parsed.command << '\n';
+        return print_help(parsed) + 2;
+    }
+
+    if (auto res = resolve_secrets(parsed); !res)
+    {
+        std::cerr << res.what();
+        return 2;
+    }
+
+    /* --trace works with every command */
+    const auto trace_file = parsed.get("trace");
+    if (!trace_file.empty()) pgp::trace::start();
+
+    const auto exit_code = command->second.handler(parsed);
+
+    if (!trace_file.empty())
+    {
+        if (auto res = pgp::trace::stop(trace_file); !res) std::cerr << res.what() << '\n';
+        else std::cout << "Trace written to " << trace_file << '\n';
+    }
+
+    return exit_code;
+}
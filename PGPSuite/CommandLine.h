@@ -0,0 +1,86 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <charconv>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Headless command line operations, for scripted and bulk use where a window is not wanted
+* Usage: PGPSuite.exe --<command> [--option=value]... [--flag]... [file]...
+* The first argument selects the command, see --help for a list */
+namespace suite::cli
+{
+    /* Parsed arguments of a command */
+    struct Arguments
+    {
+        std::string command;
+        std::unordered_map<std::string, std::string> options; /* --name=value, flags have an empty value */
+        std::vector<std::string> positional;
+
+        bool has(const std::string& name) const { return options.find(name) != options.end(); }
+
+        /* @return value of option name, or fallback if not given */
+        std::string get(const std::string& name, std::string fallback = {}) const
+        {
+            const auto it = options.find(name);
+            return it == options.end() ? fallback : it->second;
+        }
+
+        /* @brief Read the numeric value of option name, value is left as is if the option is not given
+        @return false if the option is given but its value is not a whole number */
+        bool get_number(const std::string& name, size_t& value) const
+        {
+            const auto it = options.find(name);
+            if (it == options.end()) return true;
+
+            const auto& text = it->second;
+            size_t number{ 0 };
+            const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+            if (error != std::errc{} || end != text.data() + text.size()) return false;
+
+            value = number;
+            return true;
+        }
+    };
+
+    /* A command that can be run from the command line */
+    struct Command
+    {
+        const char* usage;
+        std::function<int(const Arguments&)> handler;
+    };
+
+    /* @brief Parse the raw arguments, args[0] being the executable */
+    Arguments parse(const std::vector<std::string>& args);
+
+    /* @brief Check if the arguments ask for a command line operation instead of a window */
+    bool is_cli_invocation(const std::vector<std::string>& args);
+
+    /* @brief Run the command the arguments ask for, output goes to the console that started us
+    @return exit code for the process */
+    int run(const std::vector<std::string>& args);
+}
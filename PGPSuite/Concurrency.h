@@ -0,0 +1,111 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace pgp::utils
+{
+    /* Thread safe FIFO queue with a maximum size, used to connect the stages of a pipeline
+    * push blocks while the queue is full so a fast stage cannot run away from a slow one 
+    * @param _Type type of the items passed through the queue */
+    template<typename _Type>
+    class BoundedQueue
+    {
+    protected:
+        std::deque<_Type> _items;
+        std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+        size_t _capacity;
+        bool _closed{ false };
+    public:
+        /* @param capacity: maximum amount of items waiting in the queue, at least 1 */
+        explicit BoundedQueue(size_t capacity) : _capacity(capacity > 0 ? capacity : 1) {}
+        BoundedQueue(const BoundedQueue&) = delete;
+
+        /* @brief Add an item, blocks while the queue is full
+        @return False if the queue was closed and the item was not added */
+        bool push(_Type item)
+        {
+            std::unique_lock lock(_mutex);
+            _not_full.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+
+            if (_closed) return false;
+
+            _items.push_back(std::move(item));
+            lock.unlock();
+            _not_empty.notify_one();
+
+            return true;
+        }
+
+        /* @brief Add an item only if there is room right away, never blocks
+        @param item: moved from only if it was added
+        @return False if the queue is full or closed */
+        bool try_push(_Type& item)
+        {
+            std::unique_lock lock(_mutex);
+
+            if (_closed || _items.size() >= _capacity) return false;
+
+            _items.push_back(std::move(item));
+            lock.unlock();
+            _not_empty.notify_one();
+
+            return true;
+        }
+
+        /* @brief Take the oldest item, blocks while the queue is empty
+        @return Empty optional once the queue is closed and drained */
+        std::optional<_Type> pop()
+        {
+            std::unique_lock lock(_mutex);
+            _not_empty.wait(lock, [this] { return _closed || !_items.empty(); });
+
+            if (_items.empty()) return {};
+
+            auto item = std::move(_items.front());
+            _items.pop_front();
+            lock.unlock();
+            _not_full.notify_one();
+
+            return item;
+        }
+
+        /* @brief No more items will be pushed, wakes up everyone waiting on the queue */
+        void close()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _closed = true;
+            }
+            _not_empty.notify_all();
+            _not_full.notify_all();
+        }
+    };
+}
@@ -0,0 +1,246 @@
+#include "FileSink.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <Windows.h>
+
+namespace
+{
+    /* unbuffered writes have to be whole sectors, a page covers every sector size in use */
+    constexpr size_t page_size{ 4096 };
+
+    constexpr size_t round_up(size_t size, size_t multiple)
+    {
+        return (size + multiple - 1) / multiple * multiple;
+    }
+}
+
+/* A block of the output with the write that is storing it */
+struct pgp::utils::FileSink::Slot
+{
+    uint8_t* data{ nullptr };
+    OVERLAPPED overlapped{};
+    size_t size{ 0 };
+    bool pending{ false };
+};
+
+pgp::utils::FileSink::FileSink()
+    : _file(INVALID_HANDLE_VALUE)
+{
+}
+
+pgp::utils::FileSink::~FileSink()
+{
+    discard();
+}
+
+bool pgp::utils::FileSink::is_open() const
+{
+    return _file != INVALID_HANDLE_VALUE;
+}
+
+pgp::OpRes pgp::utils::FileSink::open(const std::string& path, const std::string& partial, const FileSinkOptions& options)
+{
+    discard();
+
+    _path = path;
+    _partial = partial;
+    _options = options;
+    _options.block_size = round_up(std::max<size_t>(options.block_size, page_size), page_size);
+    _options.depth = options.backend == IOBackend::Overlapped ? std::max<size_t>(options.depth, 1) : 1;
+    _current = 0;
+    _filled = 0;
+    _written = 0;
+    _failed = false;
+
+    _memory = static_cast<uint8_t*>(VirtualAlloc(nullptr, _options.block_size * _options.depth, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (_memory == nullptr) return "Out of memory for the write buffer of: " + path;
+
+    _slots.resize(_options.depth);
+    for (size_t i = 0; i < _slots.size(); i++) _slots[i].data = _memory + i * _options.block_size;
+
+    const DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | (_options.unbuffered ? FILE_FLAG_NO_BUFFERING : 0);
+    const auto wide = to_path(partial).wstring();
+
+    if (_options.backend == IOBackend::Overlapped)
+        _file = CreateFileW(wide.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags | FILE_FLAG_OVERLAPPED, nullptr);
+
+    _overlapped = is_open();
+
+    if (!_overlapped)
+        _file = CreateFileW(wide.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
+
+    if (!is_open()) return "Could not create: " + partial;
+
+    /* every slot gets an event of its own, so waiting for one write does not return on the completion of another */
+    for (auto& slot : _slots)
+    {
+        if (!_overlapped) break;
+
+        slot.overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (slot.overlapped.hEvent == nullptr) return "Failed to create an event for: " + partial;
+    }
+
+    /* only a hint, a volume that can not reserve the space still gets the file */
+    if (_options.expected_size > 0)
+    {
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(_options.expected_size);
+        SetFileInformationByHandle(_file, FileAllocationInfo, &allocation, sizeof(allocation));
+    }
+
+    return true;
+}
+
+bool pgp::utils::FileSink::write_block(size_t size)
+{
+    auto& slot = _slots[_current];
+
+    /* every write says where it goes, so they can complete in any order */
+    slot.overlapped.Offset = static_cast<DWORD>(_written & 0xFFFFFFFF);
+    slot.overlapped.OffsetHigh = static_cast<DWORD>(_written >> 32);
+    slot.size = size;
+
+    if (!_overlapped)
+    {
+        DWORD written{ 0 };
+
+        if (!WriteFile(_file, slot.data, static_cast<DWORD>(size), &written, &slot.overlapped) || written != size)
+        {
+            _failed = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    ResetEvent(slot.overlapped.hEvent);
+
+    if (!WriteFile(_file, slot.data, static_cast<DWORD>(size), nullptr, &slot.overlapped) && GetLastError() != ERROR_IO_PENDING)
+    {
+        _failed = true;
+        return false;
+    }
+
+    slot.pending = true;
+
+    /* the next block to fill may still be on its way to the disk */
+    _current = (_current + 1) % _slots.size();
+    return wait(_slots[_current]);
+}
+
+bool pgp::utils::FileSink::wait(Slot& slot)
+{
+    if (!slot.pending) return !_failed;
+
+    DWORD written{ 0 };
+    const bool done = GetOverlappedResult(_file, &slot.overlapped, &written, TRUE);
+    slot.pending = false;
+
+    if (!done || written != slot.size) _failed = true;
+
+    return !_failed;
+}
+
+bool pgp::utils::FileSink::write(const void* data, size_t size)
+{
+    if (_failed || !is_open()) return false;
+
+    const auto* bytes = static_cast<const uint8_t*>(data);
+
+    while (size > 0)
+    {
+        const auto part = std::min<size_t>(size, _options.block_size - _filled);
+        std::memcpy(_slots[_current].data + _filled, bytes, part);
+
+        _filled += part;
+        bytes += part;
+        size -= part;
+
+        if (_filled < _options.block_size) break;
+
+        if (!write_block(_filled)) return false;
+        _written += _filled;
+        _filled = 0;
+    }
+
+    return true;
+}
+
+pgp::OpRes pgp::utils::FileSink::commit()
+{
+    trace::Span span("commit", _path);
+
+    if (!is_open()) return "Nothing to commit: " + _path;
+    if (_failed) return "Failed writing: " + _path;
+
+    const auto size = _written + _filled;
+
+    if (_filled > 0)
+    {
+        /* an unbuffered tail is padded to a whole page, the padding is cut off below */
+        const auto tail = _options.unbuffered ? round_up(_filled, page_size) : _filled;
+        std::memset(_slots[_current].data + _filled, 0, tail - _filled);
+
+        if (!write_block(tail)) return "Failed writing: " + _path;
+    }
+
+    for (auto& slot : _slots)
+        if (!wait(slot)) return "Failed writing: " + _path;
+
+    /* the preallocation and the padding both leave the file too long */
+    FILE_END_OF_FILE_INFO end{};
+    end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+
+    if (!SetFileInformationByHandle(_file, FileEndOfFileInfo, &end, sizeof(end)) || !FlushFileBuffers(_file))
+    {
+        _failed = true;
+        return "Failed writing: " + _path;
+    }
+
+    close();
+
+    if (!MoveFileExW(to_path(_partial).wstring().c_str(), to_path(_path).wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFileW(to_path(_partial).wstring().c_str());
+        return "Failed to replace: " + _path;
+    }
+
+    _partial.clear();
+    return true;
+}
+
+void pgp::utils::FileSink::close()
+{
+    /* the blocks can only be freed once the disk is done with them */
+    for (auto& slot : _slots)
+    {
+        if (slot.pending)
+        {
+            DWORD written{ 0 };
+            CancelIoEx(_file, &slot.overlapped);
+            GetOverlappedResult(_file, &slot.overlapped, &written, TRUE);
+        }
+
+        if (slot.overlapped.hEvent != nullptr) CloseHandle(slot.overlapped.hEvent);
+    }
+    _slots.clear();
+
+    if (is_open()) CloseHandle(_file);
+    _file = INVALID_HANDLE_VALUE;
+
+    if (_memory != nullptr) VirtualFree(_memory, 0, MEM_RELEASE);
+    _memory = nullptr;
+}
+
+void pgp::utils::FileSink::discard()
+{
+    const bool created = is_open();
+    close();
+
+    if (created && !_partial.empty()) DeleteFileW(to_path(_partial).wstring().c_str());
+    _partial.clear();
+}
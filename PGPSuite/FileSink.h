@@ -0,0 +1,123 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+
+namespace pgp::utils
+{
+    /* outputs carry this suffix until they are complete */
+    constexpr const char* partial_suffix{ ".partial" };
+
+    /* How files are read and written */
+    enum class IOBackend
+    {
+        /* one request at a time at an explicit offset, the thread waits for every one of them */
+        Blocking,
+        /* several requests in flight at once so the disk is never idle while data is produced or consumed,
+        * falls back to Blocking for files that can not be opened for overlapped I/O */
+        Overlapped
+    };
+
+    /* How a FileSink writes */
+    struct FileSinkOptions
+    {
+        /* bytes collected before a write is issued, rounded up to whole pages */
+        size_t block_size{ 4 * 1024 * 1024 };
+        /* reserved on disk up front so a large file is not grown piece by piece, 0 if unknown */
+        uint64_t expected_size{ 0 };
+        /* bypass the file cache, worth it for outputs much larger than memory that are not read back soon */
+        bool unbuffered{ false };
+        IOBackend backend{ IOBackend::Blocking };
+        /* blocks in flight with the overlapped backend, each takes block_size of memory */
+        size_t depth{ 4 };
+    };
+
+    /* Output file written in large blocks under a temporary name
+    * Space is reserved for the expected size, so multi gigabyte outputs stay in one piece on disk.
+    * With the overlapped backend the next block is filled while the previous ones are still being written.
+    * Nothing appears under the real name until commit flushed the data to disk, a crash or a failure
+    * leaves at most the temporary file, which is removed when the sink is destroyed without a commit */
+    class FileSink
+    {
+    protected:
+        void* _file; /* HANDLE, kept opaque so windows.h stays out of this header */
+        std::string _path;
+        std::string _partial;
+        FileSinkOptions _options;
+
+        /* A block of the output with the write that is storing it */
+        struct Slot;
+
+        /* page aligned, unbuffered writes require that */
+        uint8_t* _memory{ nullptr };
+        std::vector<Slot> _slots;
+        size_t _current{ 0 }; /* slot being filled */
+        size_t _filled{ 0 };
+        uint64_t _written{ 0 };
+        bool _overlapped{ false };
+        bool _failed{ false };
+
+        bool write_block(size_t size);
+        /* @brief Wait until the write of the slot is done, does nothing if none is pending */
+        bool wait(Slot& slot);
+        void close();
+    public:
+        FileSink();
+        FileSink(const FileSink&) = delete;
+        FileSink& operator=(const FileSink&) = delete;
+        ~FileSink();
+
+        /* @brief Create the temporary file
+        @param path: name the file gets on commit
+        @param partial: name while it is being written */
+        OpRes open(const std::string& path, const std::string& partial, const FileSinkOptions& options = {});
+
+        /* @brief Create the temporary file under path with partial_suffix appended */
+        OpRes open(const std::string& path, const FileSinkOptions& options = {}) { return open(path, path + partial_suffix, options); }
+
+        /* @return False once anything failed, the rest of the data is then dropped */
+        bool write(const void* data, size_t size);
+
+        /* @brief Write what is left, cut the file to its real size, flush it to disk and give it its real name */
+        OpRes commit();
+
+        /* @brief Close and remove the temporary file, does nothing after a commit */
+        void discard();
+
+        bool is_open() const;
+        /* @return Bytes written so far */
+        uint64_t size() const { return _written + _filled; }
+
+        /* rnp_output_writer_t compatible callback, app_ctx has to be a FileSink */
+        static bool writer_callback(void* app_ctx, const void* buf, size_t len)
+        {
+            return static_cast<FileSink*>(app_ctx)->write(buf, len);
+        }
+    };
+}
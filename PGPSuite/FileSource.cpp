@@ -0,0 +1,230 @@
+#include "FileSource.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <Windows.h>
+
+namespace
+{
+    constexpr size_t page_size{ 4096 };
+
+    constexpr size_t round_up(size_t size, size_t multiple)
+    {
+        return (size + multiple - 1) / multiple * multiple;
+    }
+}
+
+/* A block of the input with the read that is loading it */
+struct pgp::utils::FileSource::Slot
+{
+    uint8_t* data{ nullptr };
+    OVERLAPPED overlapped{};
+    size_t size{ 0 };
+    bool pending{ false };
+    bool loaded{ false }; /* holds data that was not consumed yet */
+};
+
+pgp::utils::FileSource::FileSource()
+    : _file(INVALID_HANDLE_VALUE)
+{
+}
+
+pgp::utils::FileSource::~FileSource()
+{
+    close();
+}
+
+bool pgp::utils::FileSource::is_open() const
+{
+    return _file != INVALID_HANDLE_VALUE;
+}
+
+pgp::OpRes pgp::utils::FileSource::open(const std::string& path, const FileSourceOptions& options)
+{
+    close();
+
+    _path = path;
+    _options = options;
+    _options.block_size = round_up(std::max<size_t>(options.block_size, page_size), page_size);
+    _options.depth = options.backend == IOBackend::Overlapped ? std::max<size_t>(options.depth, 1) : 1;
+    _current = 0;
+    _consumed = 0;
+    _requested = 0;
+    _failed = false;
+
+    const DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+    const auto wide = to_path(path).wstring();
+
+    if (_options.backend == IOBackend::Overlapped)
+        _file = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags | FILE_FLAG_OVERLAPPED, nullptr);
+
+    _overlapped = is_open();
+
+    if (!_overlapped)
+        _file = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+
+    if (!is_open()) return "Could not open: " + path;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(_file, &size)) return "Could not open: " + path;
+    _size = static_cast<uint64_t>(size.QuadPart);
+
+    _slots.resize(_options.depth);
+
+    /* every slot gets an event of its own, so waiting for one read does not return on the completion of another */
+    for (auto& slot : _slots)
+    {
+        if (!_overlapped) break;
+
+        slot.overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (slot.overlapped.hEvent == nullptr) return "Failed to create an event for: " + path;
+    }
+
+    return true;
+}
+
+bool pgp::utils::FileSource::request(Slot& slot, uint8_t* target)
+{
+    slot.loaded = false;
+    if (_requested >= _size) return true;
+
+    slot.size = static_cast<size_t>(std::min<uint64_t>(_options.block_size, _size - _requested));
+    slot.overlapped.Offset = static_cast<DWORD>(_requested & 0xFFFFFFFF);
+    slot.overlapped.OffsetHigh = static_cast<DWORD>(_requested >> 32);
+    _requested += slot.size;
+
+    if (!_overlapped)
+    {
+        DWORD read{ 0 };
+
+        if (!ReadFile(_file, target, static_cast<DWORD>(slot.size), &read, &slot.overlapped) || read != slot.size)
+        {
+            _failed = true;
+            return false;
+        }
+
+        slot.loaded = true;
+        return true;
+    }
+
+    ResetEvent(slot.overlapped.hEvent);
+
+    if (!ReadFile(_file, target, static_cast<DWORD>(slot.size), nullptr, &slot.overlapped) && GetLastError() != ERROR_IO_PENDING)
+    {
+        _failed = true;
+        return false;
+    }
+
+    slot.pending = true;
+    slot.loaded = true;
+    return true;
+}
+
+bool pgp::utils::FileSource::wait(Slot& slot)
+{
+    if (!slot.pending) return !_failed;
+
+    DWORD read{ 0 };
+    const bool done = GetOverlappedResult(_file, &slot.overlapped, &read, TRUE);
+    slot.pending = false;
+
+    /* a file that shrunk since it was opened counts as a failure too */
+    if (!done || read != slot.size) _failed = true;
+
+    return !_failed;
+}
+
+bool pgp::utils::FileSource::read(void* data, size_t size, size_t& read)
+{
+    read = 0;
+    if (_failed || !is_open()) return false;
+
+    /* the blocks are only set up on the first read, read_all does not need them */
+    if (_memory == nullptr)
+    {
+        _memory = static_cast<uint8_t*>(VirtualAlloc(nullptr, _options.block_size * _slots.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+        if (_memory == nullptr) return false;
+
+        for (size_t i = 0; i < _slots.size(); i++)
+        {
+            _slots[i].data = _memory + i * _options.block_size;
+            if (!request(_slots[i], _slots[i].data)) return false;
+        }
+    }
+
+    auto* bytes = static_cast<uint8_t*>(data);
+
+    while (size > 0)
+    {
+        auto& slot = _slots[_current];
+
+        if (!wait(slot)) return false;
+        if (!slot.loaded) break; /* end of the file */
+
+        const auto part = std::min<size_t>(size, slot.size - _consumed);
+        std::memcpy(bytes, slot.data + _consumed, part);
+
+        _consumed += part;
+        bytes += part;
+        size -= part;
+        read += part;
+
+        if (_consumed < slot.size) break;
+
+        /* the slot is free again, it gets the block after the ones already requested */
+        _consumed = 0;
+        if (!request(slot, slot.data)) return false;
+        _current = (_current + 1) % _slots.size();
+    }
+
+    return true;
+}
+
+pgp::OpRes pgp::utils::FileSource::read_all(void* data)
+{
+    trace::Span span("read all", _path);
+
+    if (!is_open()) return "Could not open: " + _path;
+    if (_requested > 0) return "Already being read: " + _path;
+
+    auto* bytes = static_cast<uint8_t*>(data);
+
+    /* the blocks are read straight into the destination, the slots only track the requests */
+    for (size_t i = 0; _requested < _size; i++)
+    {
+        auto& slot = _slots[i % _slots.size()];
+
+        if (!wait(slot) || !request(slot, bytes + _requested)) return "Failed reading: " + _path;
+    }
+
+    for (auto& slot : _slots)
+        if (!wait(slot)) return "Failed reading: " + _path;
+
+    return true;
+}
+
+void pgp::utils::FileSource::close()
+{
+    /* the blocks can only be freed once the disk is done with them */
+    for (auto& slot : _slots)
+    {
+        if (slot.pending)
+        {
+            DWORD read{ 0 };
+            CancelIoEx(_file, &slot.overlapped);
+            GetOverlappedResult(_file, &slot.overlapped, &read, TRUE);
+        }
+
+        if (slot.overlapped.hEvent != nullptr) CloseHandle(slot.overlapped.hEvent);
+    }
+    _slots.clear();
+
+    if (is_open()) CloseHandle(_file);
+    _file = INVALID_HANDLE_VALUE;
+
+    if (_memory != nullptr) VirtualFree(_memory, 0, MEM_RELEASE);
+    _memory = nullptr;
+}
@@ -0,0 +1,102 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "FileSink.h"
+
+namespace pgp::utils
+{
+    /* How a FileSource reads */
+    struct FileSourceOptions
+    {
+        /* bytes asked for in a single read, rounded up to whole pages */
+        size_t block_size{ 1024 * 1024 };
+        IOBackend backend{ IOBackend::Blocking };
+        /* reads in flight with the overlapped backend, each takes block_size of memory */
+        size_t depth{ 4 };
+    };
+
+    /* Input file read front to back in large blocks
+    * With the overlapped backend the blocks after the one being consumed are already requested,
+    * so the disk works ahead while the data is being decrypted or encrypted */
+    class FileSource
+    {
+    protected:
+        void* _file; /* HANDLE, kept opaque so windows.h stays out of this header */
+        std::string _path;
+        FileSourceOptions _options;
+        uint64_t _size{ 0 };
+
+        /* A block of the input with the read that is loading it */
+        struct Slot;
+
+        uint8_t* _memory{ nullptr };
+        std::vector<Slot> _slots;
+        size_t _current{ 0 }; /* slot being consumed */
+        size_t _consumed{ 0 }; /* bytes of the current slot that were handed out */
+        uint64_t _requested{ 0 }; /* offset of the next block to request */
+        bool _overlapped{ false };
+        bool _failed{ false };
+
+        /* @brief Request the next block of the file, does nothing at the end of the file
+        @param target: where the block goes, the slot's own memory or the destination of read_all */
+        bool request(Slot& slot, uint8_t* target);
+        /* @brief Wait until the read of the slot is done, does nothing if none is pending */
+        bool wait(Slot& slot);
+    public:
+        FileSource();
+        FileSource(const FileSource&) = delete;
+        FileSource& operator=(const FileSource&) = delete;
+        ~FileSource();
+
+        /* @brief Open the file, nothing is read until read or read_all is called */
+        OpRes open(const std::string& path, const FileSourceOptions& options = {});
+
+        /* @brief Copy the next bytes of the file
+        @param read: receives the amount copied, less than size only at the end of the file
+        @return False if reading failed */
+        bool read(void* data, size_t size, size_t& read);
+
+        /* @brief Read the whole file into data, which has to hold size() bytes */
+        OpRes read_all(void* data);
+
+        /* @brief Cancel what is in flight and close the file */
+        void close();
+
+        bool is_open() const;
+        /* @return Size of the file when it was opened */
+        uint64_t size() const { return _size; }
+
+        /* rnp_input_reader_t compatible callback, app_ctx has to be a FileSource */
+        static bool reader_callback(void* app_ctx, void* buf, size_t len, size_t* read)
+        {
+            return static_cast<FileSource*>(app_ctx)->read(buf, len, *read);
+        }
+    };
+}
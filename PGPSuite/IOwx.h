@@ -24,6 +24,10 @@
 #pragma once
 
 #include <wx/wxprec.h>
+#include <wx/weakref.h>
+
+#include <memory>
+#include <thread>
 
 namespace io
 {
@@ -41,6 +45,29 @@ namespace io
         return dialog.GetValue();
     }
 
+    /* @brief Run work on a detached thread and hand its result to done on the ui thread
+    * done is skipped if the window was destroyed in the meantime, so closing a window never waits for the work
+    @param window: window the result is meant for
+    @param work: runs on the background thread and returns the result, must not touch the window
+    @param done: called with the result on the ui thread */
+    template<typename _Window, typename _Work, typename _Done>
+    void run_in_background(_Window* window, _Work work, _Done done)
+    {
+        /* the weak reference is only created and used on the ui thread, the background thread just carries it */
+        auto target = std::make_shared<wxWeakRef<_Window>>(window);
+
+        std::thread([target = std::move(target), work = std::move(work), done = std::move(done)]() mutable
+            {
+                auto result = std::make_shared<decltype(work())>(work());
+
+                if (auto* app = wxTheApp)
+                    app->CallAfter([target = std::move(target), done = std::move(done), result = std::move(result)]()
+                        {
+                            if (*target) done(std::move(*result));
+                        });
+            }).detach();
+    }
+
     /* Spawn file selection window */
     inline wxString file_select_prompt(wxWindow* parent, const char* wildcard = "All files|*", long style = wxFD_OPEN | wxFD_FILE_MUST_EXIST)
     {
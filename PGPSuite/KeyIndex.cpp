@@ -0,0 +1,280 @@
+#include "KeyIndex.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <sstream>
+
+#include <Windows.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr const char* index_header{ "# pgpsuite key index 1" };
+
+    std::string to_upper(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        return text;
+    }
+
+    /* indexes already opened by this process, by directory */
+    struct SharedIndexes
+    {
+        std::mutex mutex;
+        std::map<std::string, std::shared_ptr<const pgp::keyring::KeyIndex>> indexes;
+    };
+
+    SharedIndexes& shared_indexes()
+    {
+        static SharedIndexes instance;
+        return instance;
+    }
+}
+
+std::map<std::string, pgp::keyring::KeyIndex::Stamp> pgp::keyring::KeyIndex::list_files() const
+{
+    std::map<std::string, Stamp> files;
+    std::error_code ec;
+
+    for (auto it = fs::directory_iterator(utils::to_path(_directory), ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+    {
+        if (!it->is_regular_file(ec)) continue;
+
+        auto name = utils::from_path(it->path().filename());
+        if (name == index_name || name.rfind(index_name, 0) == 0) continue;
+
+        Stamp stamp;
+        stamp.size = it->file_size(ec);
+        if (ec) continue;
+        const auto modified = it->last_write_time(ec);
+        if (ec) continue;
+        stamp.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+
+        files[std::move(name)] = stamp;
+    }
+
+    return files;
+}
+
+pgp::OpRes pgp::keyring::KeyIndex::read(const std::string& path)
+{
+    std::ifstream file(utils::to_path(path), std::ios::binary);
+    std::string line;
+
+    _files.clear();
+    _keys.clear();
+
+    if (!std::getline(file, line) || line != index_header) return "Not a key index: " + path;
+
+    /* F lines name a keyring, the K lines after it are the keys in that keyring */
+    std::string current;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string kind;
+
+        if (!std::getline(fields, kind, '\t')) continue;
+
+        if (kind == "F")
+        {
+            Stamp stamp;
+            if (!(fields >> stamp.size >> stamp.modified)) return "Corrupt key index: " + path;
+            fields.ignore(1);
+            if (!std::getline(fields, current) || current.empty()) return "Corrupt key index: " + path;
+            _files[current] = stamp;
+        }
+        else if (kind == "K")
+        {
+            std::string identifier;
+            Location location{ current };
+            if (current.empty() || !(fields >> identifier >> location.offset >> location.length)) return "Corrupt key index: " + path;
+            _keys.emplace(std::move(identifier), std::move(location));
+        }
+    }
+
+    return true;
+}
+
+pgp::OpRes pgp::keyring::KeyIndex::write(const std::string& path) const
+{
+    std::error_code ec;
+    /* other processes may be saving the same index, each writes a file of its own and the last rename wins */
+    const auto temp = utils::to_path(path + "." + std::to_string(GetCurrentProcessId()) + ".tmp");
+
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file << index_header << '\n';
+
+        for (const auto& [name, stamp] : _files)
+        {
+            file << "F\t" << stamp.size << '\t' << stamp.modified << '\t' << name << '\n';
+
+            for (const auto& [identifier, location] : _keys)
+            {
+                if (location.file == name) file << "K\t" << identifier << '\t' << location.offset << '\t' << location.length << '\n';
+            }
+        }
+
+        if (!file.flush())
+        {
+            file.close();
+            fs::remove(temp, ec);
+            return "Failed writing: " + path;
+        }
+    }
+
+    fs::rename(temp, utils::to_path(path), ec);
+    if (ec)
+    {
+        fs::remove(temp, ec);
+        return "Failed to replace: " + path;
+    }
+
+    return true;
+}
+
+void pgp::keyring::KeyIndex::scan(const std::map<std::string, Stamp>& files)
+{
+    metrics::Scope scope("index keyrings");
+    trace::Span span("index keyrings", _directory);
+
+    _files = files;
+    _keys.clear();
+
+    for (const auto& [name, stamp] : files)
+    {
+        Scanner scanner(utils::from_path(utils::to_path(_directory) / utils::to_path(name)));
+        KeyBlock block;
+
+        /* armored keyrings and other files are remembered so they do not trigger a rebuild, but hold no keys */
+        while (scanner.valid() && scanner.next(block))
+        {
+            const Location location{ name, block.offset, block.length };
+
+            if (!block.identified) _keys.emplace("*", location);
+
+            for (const auto& keyid : block.keyids) _keys.emplace(keyid, location);
+            for (const auto& fingerprint : block.fingerprints) _keys.emplace(fingerprint, location);
+        }
+    }
+}
+
+pgp::OpRes pgp::keyring::KeyIndex::open(const std::string& directory, bool& rebuilt)
+{
+    std::error_code ec;
+    _directory = directory;
+    rebuilt = false;
+
+    if (!fs::is_directory(utils::to_path(directory), ec)) return "Not a directory: " + directory;
+
+    const auto path = utils::from_path(utils::to_path(directory) / index_name);
+    const auto files = list_files();
+
+    if (fs::exists(utils::to_path(path), ec) && read(path) && _files == files) return true;
+
+    scan(files);
+    rebuilt = true;
+
+    /* a directory we can not write to still gets its keys, just without keeping the index */
+    write(path);
+
+    return true;
+}
+
+std::vector<pgp::keyring::Location> pgp::keyring::KeyIndex::find(const std::string& identifier) const
+{
+    std::vector<Location> locations;
+    const auto range = _keys.equal_range(to_upper(identifier));
+
+    for (auto it = range.first; it != range.second; it++)
+        locations.push_back(it->second);
+
+    return locations;
+}
+
+bool pgp::keyring::IndexProvider::load(rnp_ffi_t ffi, const Location& location)
+{
+    if (!_loaded.insert(location).second) return true;
+
+    const auto path = utils::from_path(utils::to_path(_index->directory()) / utils::to_path(location.file));
+    std::ifstream file(utils::to_path(path), std::ios::binary);
+    std::vector<uint8_t> data(static_cast<size_t>(location.length));
+
+    file.seekg(location.offset);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) return false;
+
+    metrics::Scope scope("load routed key");
+    trace::Span span("rnp_load_keys", path);
+
+    rnp::Input input;
+    if (input.set_input_from_memory(data.data(), data.size()) != RNP_SUCCESS) return false;
+
+    return metrics::rnp_result(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS | RNP_LOAD_SAVE_SECRET_KEYS)) == RNP_SUCCESS;
+}
+
+void pgp::keyring::IndexProvider::callback(rnp_ffi_t ffi, void* app_ctx, const char* identifier_type, const char* identifier, bool secret)
+{
+    if (app_ctx == nullptr || identifier_type == nullptr || identifier == nullptr) return;
+
+    /* keygrips are not in the index, the recipients of a message are named by keyid */
+    if (std::strcmp(identifier_type, "keyid") != 0 && std::strcmp(identifier_type, "fingerprint") != 0) return;
+
+    auto* provider = static_cast<IndexProvider*>(app_ctx);
+    auto locations = provider->_index->find(identifier);
+
+    /* better to load the keys we could not identify than to fail the decryption */
+    if (locations.empty() && !provider->_loaded_unidentified)
+    {
+        locations = provider->_index->unidentified();
+        provider->_loaded_unidentified = true;
+    }
+
+    for (const auto& location : locations) provider->load(ffi, location);
+}
+
+pgp::OpRes pgp::keyring::shared_index(const std::string& directory, std::shared_ptr<const KeyIndex>& index, bool& rebuilt)
+{
+    auto& shared = shared_indexes();
+    std::lock_guard lock(shared.mutex);
+
+    rebuilt = false;
+
+    if (auto cached = shared.indexes.find(directory); cached != shared.indexes.end() && cached->second->current())
+    {
+        index = cached->second;
+        return true;
+    }
+
+    auto opened = std::make_shared<KeyIndex>();
+    if (auto res = opened->open(directory, rebuilt); !res) return res;
+
+    shared.indexes[directory] = opened;
+    index = std::move(opened);
+
+    return true;
+}
+
+pgp::OpRes pgp::keyring::load_routed(rnp::FFI& ffi, const std::string& directory)
+{
+    std::shared_ptr<const KeyIndex> index;
+    bool rebuilt{ false };
+
+    if (auto res = shared_index(directory, index, rebuilt); !res) return res;
+    if (index->keys() == 0) return "No keys found in: " + directory;
+
+    auto provider = std::make_shared<IndexProvider>(std::move(index));
+
+    if (rnp_ffi_set_key_provider(ffi, IndexProvider::callback, provider.get()) != RNP_SUCCESS)
+        return "Failed to set key provider.\n";
+
+    ffi.provider_context = std::move(provider);
+
+    return true;
+}
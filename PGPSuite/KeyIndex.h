@@ -0,0 +1,129 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+#include "KeyringScanner.h"
+
+/* Index of the keys in a directory of keyrings, so a message can be decrypted without loading every keyring
+* rnp reads the recipients from the message and asks for their keys, the index tells which block of
+* which keyring holds them and only those blocks are loaded.
+* The index is saved in the directory and rebuilt when a keyring in it changes. Only binary keyrings
+* can be indexed, armored ones are left out.
+* Within a process every ffi shares one read only index per directory, see shared_index */
+namespace pgp::keyring
+{
+    /* name of the saved index inside the directory */
+    constexpr const char* index_name{ ".pgpsuite-keyindex" };
+
+    /* Where a key block lives */
+    struct Location
+    {
+        std::string file;
+        uint64_t offset{ 0 };
+        uint64_t length{ 0 };
+
+        bool operator<(const Location& other) const
+        {
+            return std::tie(file, offset) < std::tie(other.file, other.offset);
+        }
+    };
+
+    class KeyIndex
+    {
+    protected:
+        /* size and modification time a keyring had when it was indexed */
+        struct Stamp
+        {
+            uint64_t size{ 0 };
+            int64_t modified{ 0 };
+
+            bool operator==(const Stamp& other) const { return size == other.size && modified == other.modified; }
+        };
+
+        std::string _directory;
+        /* by filename inside the directory */
+        std::map<std::string, Stamp> _files;
+        /* keyids and fingerprints in upper case hex, blocks that could not be identified are under "*" */
+        std::multimap<std::string, Location> _keys;
+
+        /* @return Keyrings currently in the directory */
+        std::map<std::string, Stamp> list_files() const;
+        OpRes read(const std::string& path);
+        OpRes write(const std::string& path) const;
+        void scan(const std::map<std::string, Stamp>& files);
+    public:
+        /* @brief Use the saved index of the directory, it is rebuilt and saved again if any keyring changed
+        @param rebuilt: receives whether the keyrings had to be scanned */
+        OpRes open(const std::string& directory, bool& rebuilt);
+
+        /* @return True if no keyring in the directory changed since the index was opened */
+        bool current() const { return list_files() == _files; }
+
+        /* @return Blocks holding the key with the keyid or fingerprint */
+        std::vector<Location> find(const std::string& identifier) const;
+
+        /* @return Blocks whose keys could not be identified, any of them could be the one */
+        std::vector<Location> unidentified() const { return find("*"); }
+
+        const std::string& directory() const { return _directory; }
+        size_t keyrings() const { return _files.size(); }
+        size_t keys() const { return _keys.size(); }
+    };
+
+    /* Key provider that loads keys on request using a KeyIndex */
+    class IndexProvider
+    {
+    protected:
+        std::shared_ptr<const KeyIndex> _index;
+        /* what this ffi loaded so far, the index itself is shared */
+        std::set<Location> _loaded;
+        bool _loaded_unidentified{ false };
+
+        bool load(rnp_ffi_t ffi, const Location& location);
+    public:
+        IndexProvider(std::shared_ptr<const KeyIndex> index) : _index(std::move(index)) {}
+
+        /* rnp_get_key_cb, app_ctx is the IndexProvider */
+        static void callback(rnp_ffi_t ffi, void* app_ctx, const char* identifier_type, const char* identifier, bool secret);
+    };
+
+    /* @brief Get the index of a directory, opened once per process and refreshed only when a keyring changed
+    * Workers that start together wait for the first one, instead of all scanning the keyrings and saving the index
+    @param rebuilt: receives whether the keyrings had to be scanned */
+    OpRes shared_index(const std::string& directory, std::shared_ptr<const KeyIndex>& index, bool& rebuilt);
+
+    /* @brief Make the keys of a directory of keyrings available to the ffi, they are loaded once rnp asks for them */
+    OpRes load_routed(rnp::FFI& ffi, const std::string& directory);
+}
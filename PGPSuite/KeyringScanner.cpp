@@ -0,0 +1,357 @@
+#include "KeyringScanner.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include <openssl/evp.h>
+
+namespace
+{
+    enum Tag : uint8_t
+    {
+        SecretKey = 5,
+        PublicKey = 6,
+        SecretSubkey = 7,
+        UserID = 13,
+        PublicSubkey = 14,
+    };
+
+    /* key material and userids are small, anything larger means the file is not what we think it is */
+    constexpr uint64_t max_read_packet{ 1024 * 1024 };
+
+    std::string to_hex(const uint8_t* data, size_t size)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex;
+        hex.reserve(size * 2);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            hex += digits[data[i] >> 4];
+            hex += digits[data[i] & 0x0f];
+        }
+
+        return hex;
+    }
+
+    /* @brief Identifiers are compared as plain upper case hex */
+    std::string normalize_hex(const std::string& identifier)
+    {
+        std::string hex;
+        size_t start = identifier.rfind("0x", 0) == 0 || identifier.rfind("0X", 0) == 0 ? 2 : 0;
+
+        for (size_t i = start; i < identifier.size(); i++)
+        {
+            const auto c = static_cast<unsigned char>(identifier[i]);
+            if (std::isspace(c)) continue;
+            hex += static_cast<char>(std::toupper(c));
+        }
+
+        return hex;
+    }
+
+    /* @brief Length of the public part of a v4 key packet body, a secret key packet continues with the secret material
+    @return 0 if the algorithm is unknown or the body is malformed */
+    size_t v4_public_length(const uint8_t* body, size_t size)
+    {
+        /* version, creation time and algorithm */
+        if (size < 6 || body[0] != 4) return 0;
+
+        size_t pos = 6;
+
+        auto mpi = [&]() -> bool
+        {
+            if (pos + 2 > size) return false;
+            const size_t bits = (static_cast<size_t>(body[pos]) << 8) | body[pos + 1];
+            pos += 2 + (bits + 7) / 8;
+            return pos <= size;
+        };
+
+        /* curve oid, and the kdf parameters of ECDH, both prefixed by a single length byte */
+        auto prefixed = [&]() -> bool
+        {
+            if (pos + 1 > size) return false;
+            const size_t length = body[pos];
+            if (length == 0 || length == 0xff) return false;
+            pos += 1 + length;
+            return pos <= size;
+        };
+
+        bool ok{ false };
+        switch (body[5])
+        {
+        case 1: case 2: case 3: /* RSA */
+            ok = mpi() && mpi();
+            break;
+        case 16: case 20: /* Elgamal */
+            ok = mpi() && mpi() && mpi();
+            break;
+        case 17: /* DSA */
+            ok = mpi() && mpi() && mpi() && mpi();
+            break;
+        case 18: /* ECDH */
+            ok = prefixed() && mpi() && prefixed();
+            break;
+        case 19: case 22: /* ECDSA, EdDSA */
+            ok = prefixed() && mpi();
+            break;
+        default:
+            return 0;
+        }
+
+        return ok ? pos : 0;
+    }
+}
+
+std::string pgp::keyring::v4_fingerprint(const uint8_t* body, size_t size, bool secret)
+{
+    const size_t length = secret ? v4_public_length(body, size) : (size > 0 && body[0] == 4 ? size : 0);
+
+    if (length == 0 || length > 0xffff) return {};
+
+    /* the fingerprint hashes the public key packet with an old style two byte length header */
+    const uint8_t prefix[3]{ 0x99, static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length & 0xff) };
+    uint8_t digest[EVP_MAX_MD_SIZE]{};
+    unsigned int digest_size{ 0 };
+
+    auto* ctx = EVP_MD_CTX_new();
+    const bool ok = ctx != nullptr
+        && EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr) == 1
+        && EVP_DigestUpdate(ctx, prefix, sizeof(prefix)) == 1
+        && EVP_DigestUpdate(ctx, body, length) == 1
+        && EVP_DigestFinal_ex(ctx, digest, &digest_size) == 1;
+    EVP_MD_CTX_free(ctx);
+
+    if (!ok) return {};
+
+    return to_hex(digest, digest_size);
+}
+
+pgp::keyring::Scanner::Scanner(const std::string& path)
+    : _file(utils::to_path(path), std::ios::binary)
+{
+    if (!_file)
+    {
+        _failed = true;
+        return;
+    }
+
+    _file.seekg(0, std::ios::end);
+    _size = static_cast<uint64_t>(_file.tellg());
+    _file.seekg(0);
+
+    /* every packet header has the high bit set, an armored keyring starts with text */
+    if (_size > 0 && (_file.peek() & 0x80) == 0) _failed = true;
+}
+
+bool pgp::keyring::Scanner::read_header(uint8_t& tag, uint64_t& header_length, uint64_t& body_length)
+{
+    if (_failed || _offset >= _size) return false;
+
+    uint8_t bytes[6]{};
+    _file.seekg(_offset);
+    _file.read(reinterpret_cast<char*>(bytes), std::min<uint64_t>(sizeof(bytes), _size - _offset));
+
+    if ((bytes[0] & 0x80) == 0)
+    {
+        _failed = true;
+        return false;
+    }
+
+    if (bytes[0] & 0x40)
+    { /* new format */
+        tag = bytes[0] & 0x3f;
+
+        if (bytes[1] < 192)
+        {
+            header_length = 2;
+            body_length = bytes[1];
+        }
+        else if (bytes[1] < 224)
+        {
+            header_length = 3;
+            body_length = ((static_cast<uint64_t>(bytes[1]) - 192) << 8) + bytes[2] + 192;
+        }
+        else if (bytes[1] == 255)
+        {
+            header_length = 6;
+            body_length = (static_cast<uint64_t>(bytes[2]) << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+        }
+        else
+        { /* partial lengths are not allowed for key packets */
+            _failed = true;
+            return false;
+        }
+    }
+    else
+    { /* old format */
+        tag = (bytes[0] >> 2) & 0x0f;
+
+        switch (bytes[0] & 0x03)
+        {
+        case 0:
+            header_length = 2;
+            body_length = bytes[1];
+            break;
+        case 1:
+            header_length = 3;
+            body_length = (static_cast<uint64_t>(bytes[1]) << 8) | bytes[2];
+            break;
+        case 2:
+            header_length = 5;
+            body_length = (static_cast<uint64_t>(bytes[1]) << 24) | (bytes[2] << 16) | (bytes[3] << 8) | bytes[4];
+            break;
+        default: /* indeterminate length */
+            _failed = true;
+            return false;
+        }
+    }
+
+    if (_offset + header_length + body_length > _size)
+    {
+        _failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool pgp::keyring::Scanner::next(KeyBlock& block)
+{
+    block = {};
+    bool in_block{ false };
+    std::vector<uint8_t> body;
+
+    while (true)
+    {
+        const auto start = _offset;
+        uint8_t tag{};
+        uint64_t header_length{}, body_length{};
+
+        if (!read_header(tag, header_length, body_length))
+        {
+            if (!in_block || _failed) return false;
+
+            block.length = start - block.offset;
+            return true;
+        }
+
+        const bool primary = tag == PublicKey || tag == SecretKey;
+
+        /* the next primary key ends the block, it is read again on the next call */
+        if (primary && in_block)
+        {
+            block.length = start - block.offset;
+            return true;
+        }
+
+        _offset = start + header_length + body_length;
+
+        /* trust packets and such in front of the first key */
+        if (!in_block && !primary) continue;
+
+        if (!in_block)
+        {
+            in_block = true;
+            block.offset = start;
+            block.secret = tag == SecretKey;
+        }
+
+        const bool key = primary || tag == PublicSubkey || tag == SecretSubkey;
+        if (!key && tag != UserID) continue; /* signatures are skipped without reading them */
+
+        if (body_length > max_read_packet)
+        {
+            _failed = true;
+            return false;
+        }
+
+        body.resize(static_cast<size_t>(body_length));
+        _file.seekg(start + header_length);
+        if (!_file.read(reinterpret_cast<char*>(body.data()), body.size()))
+        {
+            _failed = true;
+            return false;
+        }
+
+        if (tag == UserID)
+        {
+            block.userids.emplace_back(body.begin(), body.end());
+            continue;
+        }
+
+        auto fingerprint = v4_fingerprint(body.data(), body.size(), tag == SecretKey || tag == SecretSubkey);
+
+        if (fingerprint.empty())
+        {
+            block.identified = false;
+            continue;
+        }
+
+        block.keyids.push_back(fingerprint.substr(fingerprint.size() - 16));
+        block.fingerprints.push_back(std::move(fingerprint));
+    }
+}
+
+bool pgp::keyring::Scanner::read(const KeyBlock& block, std::vector<uint8_t>& data)
+{
+    if (!_file.good()) _file.clear();
+
+    data.resize(static_cast<size_t>(block.length));
+    _file.seekg(block.offset);
+
+    return static_cast<bool>(_file.read(reinterpret_cast<char*>(data.data()), data.size()));
+}
+
+bool pgp::keyring::matches(const KeyBlock& block, const std::string& identifier_type, const std::string& identifier)
+{
+    if (identifier_type == "userid")
+        return std::find(block.userids.begin(), block.userids.end(), identifier) != block.userids.end();
+
+    const auto& candidates = identifier_type == "keyid" ? block.keyids : block.fingerprints;
+
+    if (identifier_type != "keyid" && identifier_type != "fingerprint") return false;
+
+    /* a key we could not fingerprint might be the one, better to load too much than too little */
+    if (!block.identified) return true;
+
+    const auto hex = normalize_hex(identifier);
+    return std::find(candidates.begin(), candidates.end(), hex) != candidates.end();
+}
+
+pgp::OpRes pgp::keyring::load_matching(rnp::FFI& ffi, const std::string& path, const std::string& identifier_type, const std::string& identifier, uint32_t flags, bool& found)
+{
+    metrics::Scope scope("scan keyring");
+    trace::Span span("scan keyring", path);
+
+    Scanner scanner(path);
+    KeyBlock block;
+    std::vector<uint8_t> selected, data;
+
+    found = false;
+
+    /* armored or otherwise unscannable keyrings are left to the caller to load whole */
+    if (!scanner.valid()) return true;
+
+    while (scanner.next(block))
+    {
+        if (!matches(block, identifier_type, identifier)) continue;
+
+        if (!scanner.read(block, data)) return "Failed reading: " + path;
+        selected.insert(selected.end(), data.begin(), data.end());
+    }
+
+    if (!scanner.valid()) return true;
+    if (selected.empty()) return true;
+
+    rnp::Input input;
+    if (input.set_input_from_memory(selected.data(), selected.size()) != RNP_SUCCESS) return "Failed setting input from memory\n";
+
+    if (metrics::rnp_result(rnp_load_keys(ffi, "GPG", input, flags)) != RNP_SUCCESS) return "Failed to read: " + path;
+
+    found = true;
+    return true;
+}
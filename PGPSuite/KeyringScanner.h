@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+
+/* Walks a binary OpenPGP keyring packet header by packet header without handing it to rnp
+* Signature packets, which make up most of a keyring, are skipped by their length without being read */
+namespace pgp::keyring
+{
+    /* A transferable key: the primary key packet up to the next primary key packet */
+    struct KeyBlock
+    {
+        uint64_t offset{ 0 };
+        uint64_t length{ 0 };
+        bool secret{ false };
+        /* upper case hex of the primary key and all subkeys */
+        std::vector<std::string> keyids;
+        std::vector<std::string> fingerprints;
+        std::vector<std::string> userids;
+        /* false if a key version or algorithm could not be fingerprinted, the block might match any keyid then */
+        bool identified{ true };
+    };
+
+    class Scanner
+    {
+    protected:
+        std::ifstream _file;
+        uint64_t _offset{ 0 };
+        uint64_t _size{ 0 };
+        bool _failed{ false };
+
+        /* @brief Read the next packet header
+        @return False at the end of the file or if the header is invalid */
+        bool read_header(uint8_t& tag, uint64_t& header_length, uint64_t& body_length);
+    public:
+        /* @brief Open a keyring, check valid() before scanning */
+        Scanner(const std::string& path);
+
+        /* @return False if the file could not be opened or is not a binary keyring, armored keyrings can not be scanned */
+        bool valid() const { return !_failed; }
+
+        /* @brief Scan the next key block
+        @return False at the end of the keyring or when scanning failed, check valid() to tell them apart */
+        bool next(KeyBlock& block);
+
+        /* @brief Read the raw bytes of a block found earlier */
+        bool read(const KeyBlock& block, std::vector<uint8_t>& data);
+    };
+
+    /* @brief Compute the fingerprint of a v4 key packet body
+    @return Upper case hex, empty if the key version or algorithm is not supported */
+    std::string v4_fingerprint(const uint8_t* body, size_t size, bool secret);
+
+    /* @brief Check a block against an identifier the way rnp_locate_key would
+    @param identifier_type: "userid", "keyid" or "fingerprint" */
+    bool matches(const KeyBlock& block, const std::string& identifier_type, const std::string& identifier);
+
+    /* @brief Load only the key blocks matching the identifier from a binary keyring
+    @param found: receives whether anything matched, nothing is loaded if not
+        also false if the file is not a binary keyring, callers then load all of it instead
+    @return An error if matching blocks could not be read or loaded */
+    OpRes load_matching(rnp::FFI& ffi, const std::string& path, const std::string& identifier_type, const std::string& identifier, uint32_t flags, bool& found);
+}
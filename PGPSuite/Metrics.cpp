@@ -0,0 +1,157 @@
+#include "Metrics.h"
+
+#include <iomanip>
+#include <sstream>
+
+#include <Windows.h>
+#include <psapi.h>
+
+namespace
+{
+    thread_local pgp::metrics::Recorder* current_recorder{ nullptr };
+
+    double filetime_ms(const FILETIME& time)
+    {
+        ULARGE_INTEGER value{};
+        value.LowPart = time.dwLowDateTime;
+        value.HighPart = time.dwHighDateTime;
+        return value.QuadPart / 10000.0; /* 100ns units */
+    }
+
+    std::string format_bytes(uint64_t bytes)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+
+        if (bytes >= 1024 * 1024) out << bytes / (1024.0 * 1024.0) << " MiB";
+        else if (bytes >= 1024) out << bytes / 1024.0 << " KiB";
+        else out << bytes << " B";
+
+        return out.str();
+    }
+}
+
+void pgp::Metrics::add_phase(const std::string& name, double wall_ms, double cpu_ms)
+{
+    for (auto& phase : phases)
+    {
+        if (phase.name != name) continue;
+
+        phase.wall_ms += wall_ms;
+        phase.cpu_ms += cpu_ms;
+        return;
+    }
+
+    phases.push_back({ name, wall_ms, cpu_ms });
+}
+
+double pgp::Metrics::total_wall_ms() const
+{
+    double total{ 0 };
+    for (const auto& phase : phases) total += phase.wall_ms;
+    return total;
+}
+
+std::string pgp::Metrics::summary() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << total_wall_ms() << " ms";
+
+    if (!phases.empty())
+    {
+        out << " (";
+        for (size_t i = 0; i < phases.size(); i++)
+        {
+            if (i > 0) out << ", ";
+            out << phases[i].name << ' ' << phases[i].wall_ms << '/' << phases[i].cpu_ms << " cpu";
+        }
+        out << ')';
+    }
+
+    out << ", " << format_bytes(bytes_in) << " -> " << format_bytes(bytes_out);
+
+    if (process_peak_memory > 0)
+    {
+        out << ", process peak " << format_bytes(process_peak_memory);
+        if (peak_growth > 0) out << " (+" << format_bytes(peak_growth) << ')';
+    }
+    if (rnp_result != RNP_SUCCESS) out << ", rnp error 0x" << std::hex << rnp_result;
+
+    return out.str();
+}
+
+double pgp::metrics::thread_cpu_ms()
+{
+    FILETIME creation{}, exit{}, kernel{}, user{};
+
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+
+    return filetime_ms(kernel) + filetime_ms(user);
+}
+
+size_t pgp::metrics::peak_memory()
+{
+    PROCESS_MEMORY_COUNTERS counters{};
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+
+    return counters.PeakWorkingSetSize;
+}
+
+pgp::metrics::Recorder::Recorder(std::shared_ptr<Metrics> metrics)
+    : _metrics(std::move(metrics)), _previous(current_recorder), _peak_at_start(peak_memory())
+{
+    current_recorder = this;
+}
+
+pgp::metrics::Recorder::~Recorder()
+{
+    current_recorder = _previous;
+}
+
+std::shared_ptr<pgp::Metrics> pgp::metrics::Recorder::finish()
+{
+    _metrics->process_peak_memory = peak_memory();
+    _metrics->peak_growth = _metrics->process_peak_memory > _peak_at_start ? _metrics->process_peak_memory - _peak_at_start : 0;
+    return _metrics;
+}
+
+pgp::metrics::Recorder* pgp::metrics::Recorder::current()
+{
+    return current_recorder;
+}
+
+pgp::metrics::Scope::Scope(const char* name)
+    : _name(name), _recorder(current_recorder)
+{
+    if (_recorder == nullptr) return;
+
+    _start = std::chrono::steady_clock::now();
+    _cpu_start = thread_cpu_ms();
+}
+
+pgp::metrics::Scope::~Scope()
+{
+    if (_recorder == nullptr) return;
+
+    const auto wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+    _recorder->data().add_phase(_name, wall, thread_cpu_ms() - _cpu_start);
+}
+
+void pgp::metrics::add_bytes_in(uint64_t bytes)
+{
+    if (current_recorder) current_recorder->data().bytes_in += bytes;
+}
+
+void pgp::metrics::add_bytes_out(uint64_t bytes)
+{
+    if (current_recorder) current_recorder->data().bytes_out += bytes;
+}
+
+int pgp::metrics::rnp_result(int code)
+{
+    if (current_recorder && code != RNP_SUCCESS && current_recorder->data().rnp_result == RNP_SUCCESS)
+        current_recorder->data().rnp_result = code;
+
+    return code;
+}
@@ -0,0 +1,115 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+
+namespace pgp
+{
+    /* Where the time and resources of a single operation went */
+    struct Metrics
+    {
+        struct Phase
+        {
+            std::string name;
+            double wall_ms{ 0 };
+            double cpu_ms{ 0 }; /* cpu time of the thread that ran the phase */
+        };
+
+        std::vector<Phase> phases;
+        uint64_t bytes_in{ 0 };
+        uint64_t bytes_out{ 0 };
+        /* peak working set of the whole process over its lifetime, includes everything that ran before */
+        size_t process_peak_memory{ 0 };
+        /* how far the operation raised that peak, 0 if it stayed below an earlier one */
+        size_t peak_growth{ 0 };
+        int rnp_result{ RNP_SUCCESS }; /* first failing rnp code, RNP_SUCCESS if none failed */
+
+        /* @brief Add time to a phase, phases that run more than once are accumulated */
+        void add_phase(const std::string& name, double wall_ms, double cpu_ms);
+
+        double total_wall_ms() const;
+
+        /* @brief One line summary for status bars and console output */
+        std::string summary() const;
+    };
+
+    namespace metrics
+    {
+        /* @return Cpu time used by the calling thread so far */
+        double thread_cpu_ms();
+
+        /* @return Peak working set of the process in bytes, a high water mark since the process started */
+        size_t peak_memory();
+
+        /* Collects the metrics of everything that runs on this thread while it is alive
+        * Recorders nest, the innermost one receives the measurements */
+        class Recorder
+        {
+        protected:
+            std::shared_ptr<Metrics> _metrics;
+            Recorder* _previous;
+            size_t _peak_at_start;
+        public:
+            Recorder(std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>());
+            Recorder(const Recorder&) = delete;
+            ~Recorder();
+
+            Metrics& data() { return *_metrics; }
+
+            /* @brief Take the final measurements and hand out the metrics */
+            std::shared_ptr<Metrics> finish();
+
+            /* @return The recorder of this thread, nullptr if nothing is being recorded */
+            static Recorder* current();
+        };
+
+        /* Measures the lifetime of a scope as a phase of the current recorder, does nothing without one */
+        class Scope
+        {
+        protected:
+            const char* _name;
+            Recorder* _recorder;
+            std::chrono::steady_clock::time_point _start;
+            double _cpu_start{ 0 };
+        public:
+            Scope(const char* name);
+            Scope(const Scope&) = delete;
+            ~Scope();
+        };
+
+        /* Helpers that report to the current recorder, if there is one */
+        void add_bytes_in(uint64_t bytes);
+        void add_bytes_out(uint64_t bytes);
+        /* @brief Record an rnp result code, only the first failure is kept
+        @return The code, so calls can be wrapped */
+        int rnp_result(int code);
+    }
+}
@@ -26,12 +26,20 @@
 #include <asio.hpp>
 #include <asio/ssl.hpp>
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+
 #define PGPSUITE_SIG "--start--"
 #define PGPSUITE_SIG_LEN sizeof(PGPSUITE_SIG)
 
 namespace suite::net
 {
-    inline std::string query(std::string host, std::string port, std::string request)
+    /* @brief Send a request over TLS and read until the server closes the connection
+    * Every step is asynchronous so the whole exchange can be bounded by the timeout
+    @return The response, empty if anything failed or the timeout expired */
+    inline std::string query(std::string host, std::string port, std::string request, std::chrono::milliseconds timeout = std::chrono::seconds(5))
     {
         asio::io_service svc;
         asio::ssl::context ctx(asio::ssl::context::method::sslv23_client);
@@ -39,35 +47,63 @@ namespace suite::net
 
         asio::ip::tcp::resolver resolver(svc);
 
-        try
-        {
-            auto it = resolver.resolve({ host, port });
-            asio::connect(ssock.lowest_layer(), it);
-        }
-        catch (const std::exception& e)
+        std::string response;
+        std::array<char, 4096> buf;
+        bool done{ false };
+
+        /* the server closing the connection ends the response, how it closes does not matter */
+        std::function<void(const asio::error_code&, size_t)> on_read = [&](const asio::error_code& ec, size_t bytes_transferred)
         {
-            return "";
-        }
+            response.append(buf.data(), buf.data() + bytes_transferred);
 
-        ssock.handshake(asio::ssl::stream_base::handshake_type::client);
+            if (ec)
+            {
+                done = true;
+                return;
+            }
 
-        asio::write(ssock, asio::buffer(request));
+            ssock.async_read_some(asio::buffer(buf), on_read);
+        };
 
-        std::string response;
-        asio::error_code ec;
+        resolver.async_resolve(host, port, [&](const asio::error_code& ec, auto endpoints)
+            {
+                if (ec) return;
 
-        while (!ec)
-        {
-            std::array<char, 1024> buf;
-            size_t bytes_transferred = ssock.read_some(asio::buffer(buf), ec);
-            if (!ec) response.append(buf.data(), buf.data() + bytes_transferred);
-        }
+                asio::async_connect(ssock.lowest_layer(), endpoints, [&](const asio::error_code& ec, const auto&)
+                    {
+                        if (ec) return;
+
+                        ssock.async_handshake(asio::ssl::stream_base::handshake_type::client, [&](const asio::error_code& ec)
+                            {
+                                if (ec) return;
+
+                                asio::async_write(ssock, asio::buffer(request), [&](const asio::error_code& ec, size_t)
+                                    {
+                                        if (ec) return;
+
+                                        ssock.async_read_some(asio::buffer(buf), on_read);
+                                    });
+                            });
+                    });
+            });
+
+        svc.run_for(timeout);
+
+        /* pending operations are abandoned together with the io_service */
+        if (!done) return "";
 
         return response;
     }
 
-    inline std::string get_network_data()
+    /* @brief Request a file from a web server
+    @param server: name or address to connect to
+    @param path: absolute path of the file on the server */
+    inline std::string get_network_data(const std::string& server = "www.vapt.nl", const std::string& port = "443", const std::string& path = "/pgpsuite_version.txt",
+        std::chrono::milliseconds timeout = std::chrono::seconds(5))
     {
-        return query("www.vapt.nl", "443", "GET /pgpsuite_version.txt HTTP/1.1\r\nHost: vapt.nl\r\nAccept: text/plain\r\nConnection: close\r\n\r\n");
+        /* the site is served from the bare domain */
+        const auto host = server.rfind("www.", 0) == 0 ? server.substr(4) : server;
+
+        return query(server, port, "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nAccept: text/plain\r\nConnection: close\r\n\r\n", timeout);
     }
 }
@@ -0,0 +1,472 @@
+#include "PGPArchive.h"
+#include "PGPEncrypt.h"
+#include "PGPDecrypt.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /* size of the fixed part of an entry header after the type byte: u16 path length, u64 size, i64 mtime */
+    constexpr size_t entry_header_size{ 2 + 8 + 8 };
+
+    template<typename _Int>
+    void put_le(std::string& out, _Int value)
+    {
+        for (size_t i = 0; i < sizeof(_Int); i++)
+            out.push_back(static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xFF));
+    }
+
+    template<typename _Int>
+    _Int get_le(const char* in)
+    {
+        uint64_t value{ 0 };
+        for (size_t i = 0; i < sizeof(_Int); i++)
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+        return static_cast<_Int>(value);
+    }
+
+    int64_t to_unix_time(fs::file_time_type time)
+    {
+        const auto sys = std::chrono::clock_cast<std::chrono::system_clock>(time);
+        return std::chrono::duration_cast<std::chrono::seconds>(sys.time_since_epoch()).count();
+    }
+
+    fs::file_time_type from_unix_time(int64_t seconds)
+    {
+        const auto sys = std::chrono::system_clock::time_point(std::chrono::seconds(seconds));
+        return std::chrono::clock_cast<fs::file_time_type::clock>(sys);
+    }
+
+    std::string to_utf8(const fs::path& path)
+    {
+        const auto str = path.generic_u8string();
+        return std::string(str.begin(), str.end());
+    }
+
+    /* Strips a trailing separator so the filename of the directory can be used */
+    fs::path normalize_directory(const fs::path& directory)
+    {
+        auto root = directory.lexically_normal();
+        if (!root.has_filename()) root = root.parent_path();
+        return root;
+    }
+}
+
+/* ------------------------------------- WRITER ---------------------------------------------- */
+
+pgp::archive::ArchiveWriter::ArchiveWriter(const fs::path& directory)
+{
+    const auto root = normalize_directory(directory);
+    std::error_code ec;
+
+    _base = root.parent_path();
+    _iter = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+
+    if (ec)
+    {
+        _error = "Could not open directory: " + to_utf8(root);
+        return;
+    }
+
+    _header.append(magic, sizeof(magic));
+    _header.push_back(static_cast<char>(version));
+
+    /* the directory itself is the first entry so extracting recreates it as a whole */
+    put_le(_header, static_cast<uint8_t>(EntryType::Directory));
+    const auto name = to_utf8(root.lexically_relative(_base));
+    put_le(_header, static_cast<uint16_t>(name.size()));
+    put_le(_header, uint64_t{ 0 });
+    put_le(_header, to_unix_time(fs::last_write_time(root, ec)));
+    _header += name;
+}
+
+bool pgp::archive::ArchiveWriter::next_entry()
+{
+    _header.clear();
+    _header_pos = 0;
+    if (_file.is_open()) _file.close();
+
+    if (!_deferred_error.empty())
+    {
+        _error = std::move(_deferred_error);
+        return false;
+    }
+
+    std::error_code ec;
+
+    for (; _iter != fs::recursive_directory_iterator(); _iter.increment(ec))
+    {
+        if (ec)
+        {
+            _error = "Failed iterating directory: " + ec.message();
+            return false;
+        }
+
+        const auto& entry = *_iter;
+        EntryType type{ EntryType::End };
+        uint64_t size{ 0 };
+
+        /* symlinks and other special files are not archived */
+        if (entry.is_symlink(ec)) continue;
+        if (entry.is_directory(ec))
+            type = EntryType::Directory;
+        else if (entry.is_regular_file(ec))
+        {
+            type = EntryType::File;
+            size = entry.file_size(ec);
+            _file.open(entry.path(), std::ios::binary);
+
+            if (ec || !_file)
+            {
+                _error = "Could not open: " + to_utf8(entry.path());
+                return false;
+            }
+        }
+        else continue;
+
+        const auto name = to_utf8(entry.path().lexically_relative(_base));
+        if (name.size() > UINT16_MAX)
+        {
+            _error = "Path too long to archive: " + name;
+            return false;
+        }
+
+        put_le(_header, static_cast<uint8_t>(type));
+        put_le(_header, static_cast<uint16_t>(name.size()));
+        put_le(_header, size);
+        put_le(_header, to_unix_time(entry.last_write_time(ec)));
+        _header += name;
+        _file_remaining = size;
+
+        /* the current entry is still valid, an error here is reported once it has been handed out */
+        _iter.increment(ec);
+        if (ec) _deferred_error = "Failed iterating directory: " + ec.message();
+
+        return true;
+    }
+
+    put_le(_header, static_cast<uint8_t>(EntryType::End));
+    _finished = true;
+
+    return true;
+}
+
+bool pgp::archive::ArchiveWriter::read(uint8_t* buf, size_t len, size_t* read)
+{
+    *read = 0;
+    if (!_error.empty()) return false;
+
+    while (*read < len)
+    {
+        if (_header_pos < _header.size())
+        { /* hand out pending header bytes first */
+            const auto chunk = std::min<size_t>(_header.size() - _header_pos, len - *read);
+            std::memcpy(buf + *read, _header.data() + _header_pos, chunk);
+            _header_pos += chunk;
+            *read += chunk;
+            continue;
+        }
+
+        if (_file_remaining > 0)
+        { /* stream file data straight into rnp's buffer */
+            const auto chunk = static_cast<size_t>(std::min<uint64_t>(_file_remaining, len - *read));
+            _file.read(reinterpret_cast<char*>(buf + *read), chunk);
+
+            if (static_cast<size_t>(_file.gcount()) != chunk)
+            {
+                _error = "File was modified while archiving.";
+                return false;
+            }
+
+            _file_remaining -= chunk;
+            *read += chunk;
+            continue;
+        }
+
+        if (_finished) break;
+        if (!next_entry()) return false;
+    }
+
+    return true;
+}
+
+bool pgp::archive::ArchiveWriter::reader_callback(void* app_ctx, void* buf, size_t len, size_t* read)
+{
+    trace::Span span("archive read");
+    return static_cast<ArchiveWriter*>(app_ctx)->read(static_cast<uint8_t*>(buf), len, read);
+}
+
+/* ------------------------------------- EXTRACTOR ---------------------------------------------- */
+
+pgp::archive::ArchiveExtractor::ArchiveExtractor(fs::path destination)
+    : _destination(std::move(destination))
+{}
+
+bool pgp::archive::ArchiveExtractor::fail(std::string what)
+{
+    if (_error.empty()) _error = std::move(what);
+    if (_file.is_open()) _file.close();
+    return false;
+}
+
+bool pgp::archive::ArchiveExtractor::open_entry()
+{
+    const auto name = fs::path(std::u8string(_pending.begin(), _pending.end()));
+
+    /* never allow an archive to write outside of the destination */
+    if (name.empty() || name.has_root_name() || name.has_root_directory())
+        return fail("Archive contains an invalid path: " + _pending);
+
+    for (const auto& part : name)
+        if (part == "..") return fail("Archive contains an invalid path: " + _pending);
+
+    _current = _destination / name;
+    std::error_code ec;
+
+    if (_type == EntryType::Directory)
+    {
+        if (!create_directories(_current)) return fail("Could not create directory: " + to_utf8(_current));
+
+        _extracted++;
+        return true;
+    }
+
+    if (!create_directories(_current.parent_path())) return fail("Could not create directory: " + to_utf8(_current.parent_path()));
+
+    /* existing files are never replaced, a failed extraction would otherwise remove the originals */
+    if (fs::exists(fs::symlink_status(_current, ec)))
+        return fail("Refusing to overwrite existing file: " + to_utf8(_current));
+
+    _file.open(_current, std::ios::binary | std::ios::trunc);
+    if (!_file) return fail("Could not create file: " + to_utf8(_current));
+
+    _created.push_back(_current);
+
+    return true;
+}
+
+bool pgp::archive::ArchiveExtractor::create_directories(const fs::path& directory)
+{
+    std::error_code ec;
+    fs::path path;
+
+    /* only the directories that did not exist yet are recorded, discard leaves everything else alone */
+    for (const auto& part : directory)
+    {
+        path /= part;
+
+        if (fs::is_directory(path, ec)) continue;
+        if (!fs::create_directory(path, ec)) return false;
+
+        _created.push_back(path);
+    }
+
+    return true;
+}
+
+void pgp::archive::ArchiveExtractor::finish_file()
+{
+    std::error_code ec;
+
+    _file.close();
+    fs::last_write_time(_current, from_unix_time(_mtime), ec);
+    _extracted++;
+}
+
+bool pgp::archive::ArchiveExtractor::advance()
+{
+    switch (_state)
+    {
+    case State::Magic:
+        if (std::memcmp(_pending.data(), magic, sizeof(magic)) != 0)
+            return fail("Decrypted data is not an archive.");
+        if (static_cast<uint8_t>(_pending[sizeof(magic)]) != version)
+            return fail("Unsupported archive version.");
+
+        _state = State::Type;
+        _needed = 1;
+        break;
+    case State::Type:
+        _type = static_cast<EntryType>(_pending[0]);
+
+        if (_type == EntryType::End)
+        {
+            _state = State::Done;
+            break;
+        }
+        if (_type != EntryType::File && _type != EntryType::Directory)
+            return fail("Archive is corrupted.");
+
+        _state = State::Header;
+        _needed = entry_header_size;
+        break;
+    case State::Header:
+        _needed = get_le<uint16_t>(_pending.data());
+        _remaining = get_le<uint64_t>(_pending.data() + 2);
+        _mtime = get_le<int64_t>(_pending.data() + 10);
+
+        if (_needed == 0 || (_type == EntryType::Directory && _remaining != 0))
+            return fail("Archive is corrupted.");
+
+        _state = State::Path;
+        break;
+    case State::Path:
+        if (!open_entry()) return false;
+
+        _state = State::Type;
+        _needed = 1;
+
+        if (_type == EntryType::File)
+        {
+            if (_remaining == 0) finish_file();
+            else _state = State::Data;
+        }
+        break;
+    default:
+        return fail("Archive is corrupted.");
+    }
+
+    _pending.clear();
+
+    return true;
+}
+
+bool pgp::archive::ArchiveExtractor::write(const uint8_t* data, size_t len)
+{
+    if (!_error.empty()) return false;
+
+    while (len > 0)
+    {
+        if (_state == State::Done)
+            return fail("Trailing data after end of archive.");
+
+        if (_state == State::Data)
+        {
+            const auto chunk = static_cast<size_t>(std::min<uint64_t>(_remaining, len));
+
+            if (!_file.write(reinterpret_cast<const char*>(data), chunk))
+                return fail("Failed writing: " + to_utf8(_current));
+
+            data += chunk;
+            len -= chunk;
+            _remaining -= chunk;
+
+            if (_remaining == 0)
+            {
+                finish_file();
+                _state = State::Type;
+                _needed = 1;
+            }
+            continue;
+        }
+
+        /* fixed size parts are collected until complete, they can be split over several writes */
+        const auto chunk = std::min<size_t>(_needed - _pending.size(), len);
+        _pending.append(reinterpret_cast<const char*>(data), chunk);
+        data += chunk;
+        len -= chunk;
+
+        if (_pending.size() == _needed && !advance()) return false;
+    }
+
+    return true;
+}
+
+void pgp::archive::ArchiveExtractor::discard()
+{
+    if (_file.is_open()) _file.close();
+
+    std::error_code ec;
+    /* newest first so directories are empty by the time they are removed */
+    for (auto it = _created.rbegin(); it != _created.rend(); it++)
+        fs::remove(*it, ec);
+
+    _created.clear();
+    _extracted = 0;
+}
+
+bool pgp::archive::ArchiveExtractor::writer_callback(void* app_ctx, const void* buf, size_t len)
+{
+    trace::Span span("archive write");
+    return static_cast<ArchiveExtractor*>(app_ctx)->write(static_cast<const uint8_t*>(buf), len);
+}
+
+void pgp::archive::ArchiveExtractor::closer_callback(void* app_ctx, bool discard)
+{
+    if (discard) static_cast<ArchiveExtractor*>(app_ctx)->discard();
+}
+
+/* ------------------------------------- OPERATIONS ---------------------------------------------- */
+
+bool pgp::archive::is_archive_name(const std::string& filename)
+{
+    const auto without_asc = utils::remove_extension(filename);
+    const auto ext_len = strlen(extension);
+
+    return without_asc.size() != filename.size() &&
+        without_asc.size() > ext_len &&
+        without_asc.compare(without_asc.size() - ext_len, ext_len, extension) == 0;
+}
+
+pgp::OpRes pgp::archive::encrypt_directory(const fs::path& directory, std::string pubkey_file, std::string userid, std::string save_to, std::string password)
+{
+    const auto root = normalize_directory(directory);
+
+    if (!fs::is_directory(root)) return "Not a directory: " + to_utf8(root);
+
+    if (save_to.empty())
+        save_to = utils::utf8_encode(root.wstring()) + extension + ".asc";
+
+    if (auto res = pgp::utils::validate_strings<std::string>(pubkey_file, userid, save_to); !res) return res;
+
+    ArchiveWriter writer(root);
+    rnp::Input input;
+    rnp::Output output;
+
+    if (!writer.error().empty()) return writer.error().c_str();
+
+    if (input.set_input_from_callback(ArchiveWriter::reader_callback, nullptr, &writer) != RNP_SUCCESS) return "Failed setting input\n";
+
+    pgp::utils::FileSink sink;
+    if (auto res = sink.open(save_to); !res) return res;
+    if (output.set_output_to_sink(sink) != RNP_SUCCESS) return "Failed setting output\n";
+
+    const auto res = encrypt_stream(input, output, pubkey_file, userid, password, to_utf8(root.filename()) + extension);
+
+    /* an error from the archive itself explains more than rnp's generic failure */
+    if (!res && !writer.error().empty()) return writer.error().c_str();
+    if (!res) return res;
+
+    output.destroy();
+    return sink.commit();
+}
+
+pgp::OpRes pgp::archive::decrypt_archive(std::string encrypted_file, fs::path extract_to, rnp_password_cb passprovider, void* context, std::string secring_file)
+{
+    if (auto res = pgp::utils::validate_strings<std::string>(secring_file, encrypted_file); !res) return res;
+
+    if (extract_to.empty())
+        extract_to = fs::absolute(fs::path(encrypted_file)).parent_path();
+
+    ArchiveExtractor extractor(extract_to);
+    rnp::Input input;
+    rnp::Output output;
+
+    if (input.set_input_from_path(encrypted_file) != RNP_SUCCESS) return "Error setting input: " + encrypted_file + "\nDoes it exist?";
+
+    if (output.set_output_to_callback(ArchiveExtractor::writer_callback, ArchiveExtractor::closer_callback, &extractor) != RNP_SUCCESS)
+        return "Failed setting output\n";
+
+    auto res = decrypt_stream(input, output, passprovider, context, secring_file);
+
+    output.destroy(); /* flushes the remaining data, or discards the extracted files on failure */
+
+    if (!extractor.error().empty()) return extractor.error().c_str();
+    if (!res) return res;
+    if (!extractor.complete()) return "Archive is truncated.";
+
+    return true;
+}
@@ -0,0 +1,149 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+#include "Utils.h"
+
+/* Archive mode, packs a whole directory tree into a single stream which is encrypted as one OpenPGP message
+* This way many small files share one ffi, one compression context and one output file
+* 
+* Layout of the (plaintext) archive stream, all integers are little endian:
+*   header:  "PSAR" u8 version
+*   entry:   u8 type, u16 path length, u64 size, i64 mtime, path (utf8, '/' separated), size bytes of file data
+*   end:     u8 type (End) */
+namespace pgp::archive
+{
+    /* Magic bytes every archive stream starts with */
+    inline constexpr char magic[] = { 'P', 'S', 'A', 'R' };
+    inline constexpr uint8_t version{ 1 };
+    /* Extension placed in front of .asc to recognize encrypted archives */
+    inline constexpr const char* extension{ ".psa" };
+
+    enum class EntryType : uint8_t { End = 0, File = 1, Directory = 2 };
+
+    /* Produces the archive stream of a directory tree on demand, files are only opened once rnp asks for their data 
+    * Is meant to be fed to rnp via an rnp::Input callback */
+    class ArchiveWriter
+    {
+    protected:
+        std::filesystem::path _base;
+        std::filesystem::recursive_directory_iterator _iter;
+        std::ifstream _file;
+        std::string _header; /* bytes waiting to be handed to rnp before the file data */
+        size_t _header_pos{ 0 };
+        uint64_t _file_remaining{ 0 };
+        bool _finished{ false };
+        std::string _error;
+        std::string _deferred_error; /* raised after the entry that was queued when it happened */
+
+        /* @brief Queue the header of the next entry, or the end marker if there are none left */
+        bool next_entry();
+    public:
+        /* @param directory: root of the tree to archive, the directory itself will be the top level entry */
+        ArchiveWriter(const std::filesystem::path& directory);
+        ArchiveWriter(const ArchiveWriter&) = delete;
+
+        /* @brief Fill buf with up to len bytes of the archive stream
+        @return false on failure, read is 0 when the stream is done */
+        bool read(uint8_t* buf, size_t len, size_t* read);
+
+        const std::string& error() const { return _error; }
+
+        /* rnp_input_reader_t compatible callback, app_ctx has to be an ArchiveWriter */
+        static bool reader_callback(void* app_ctx, void* buf, size_t len, size_t* read);
+    };
+
+    /* Consumes an archive stream and recreates the tree on disk while the data is still being decrypted
+    * Is meant to be fed by rnp via an rnp::Output callback */
+    class ArchiveExtractor
+    {
+    protected:
+        enum class State { Magic, Type, Header, Path, Data, Done };
+
+        std::filesystem::path _destination;
+        State _state{ State::Magic };
+        std::string _pending; /* fixed size parts are gathered here until complete */
+        size_t _needed{ sizeof(magic) + 1 };
+        std::ofstream _file;
+        std::filesystem::path _current;
+        EntryType _type{ EntryType::End };
+        uint64_t _remaining{ 0 };
+        int64_t _mtime{ 0 };
+        size_t _extracted{ 0 };
+        std::vector<std::filesystem::path> _created; /* files and directories this extractor created, removed again on discard */
+        std::string _error;
+
+        bool fail(std::string what);
+        bool advance();
+        bool open_entry();
+        /* @brief Create the directory and its missing parents, recording the ones that are new */
+        bool create_directories(const std::filesystem::path& directory);
+        void finish_file();
+    public:
+        /* @param destination: directory the archive will be extracted into */
+        ArchiveExtractor(std::filesystem::path destination);
+        ArchiveExtractor(const ArchiveExtractor&) = delete;
+
+        bool write(const uint8_t* data, size_t len);
+
+        /* @return If the end of the archive was reached without errors */
+        bool complete() const { return _state == State::Done && _error.empty(); }
+        /* @return Amount of files and directories that have been extracted */
+        size_t extracted() const { return _extracted; }
+        const std::string& error() const { return _error; }
+
+        /* @brief Remove everything that has been extracted so far, used when decryption or integrity checks fail */
+        void discard();
+
+        /* rnp_output_writer_t compatible callback, app_ctx has to be an ArchiveExtractor */
+        static bool writer_callback(void* app_ctx, const void* buf, size_t len);
+        /* rnp_output_closer_t compatible callback, discards the extracted files if rnp asks for it */
+        static void closer_callback(void* app_ctx, bool discard);
+    };
+
+    /* @brief Check if a filename looks like an encrypted archive, e.g. folder.psa.asc */
+    bool is_archive_name(const std::string& filename);
+
+    /* @brief Encrypt a whole directory tree into one OpenPGP message
+    @param directory: directory to be archived and encrypted
+    @param pubkey_file: the filename of the recipient's public key
+    @param userid: the userid of the key
+    @param save_to: filename to save the encrypted archive to, if empty it will be directory + .psa.asc
+    @param password: password to encrypt the archive with, no password if left empty */
+    OpRes encrypt_directory(const std::filesystem::path& directory, std::string pubkey_file, std::string userid, std::string save_to = {}, std::string password = {});
+
+    /* @brief Decrypt an encrypted archive and extract it
+    @param encrypted_file: Filename of the encrypted archive
+    @param extract_to: Directory to extract into, if empty it will be the directory of the encrypted file
+    @param passprovider: function pointer to a password provider
+    @param secring_file: Filename of secret keyring, none is loaded if left empty */
+    OpRes decrypt_archive(std::string encrypted_file, std::filesystem::path extract_to, rnp_password_cb passprovider, void* context = nullptr, std::string secring_file = {});
+}
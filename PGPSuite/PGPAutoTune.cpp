@@ -0,0 +1,416 @@
+#include "PGPAutoTune.h"
+#include "PersistentData.h"
+#include "BufferPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /* ciphers and compression settings the calibration measures */
+    const std::array<const char*, 4> calibrated_ciphers{ RNP_ALGNAME_AES_128, RNP_ALGNAME_AES_256, RNP_ALGNAME_CAMELLIA_256, RNP_ALGNAME_TWOFISH };
+    const std::array<const char*, 3> calibrated_algorithms{ "ZIP", "ZLIB", "BZip2" };
+    const std::array<int, 3> calibrated_levels{ 1, 6, 9 };
+
+    /* data above this many bits of entropy per byte is treated as already compressed */
+    constexpr double incompressible_entropy{ 7.5 };
+    /* amount of data looked at to decide how compressible a job is */
+    constexpr size_t sample_limit{ 64 * 1024 };
+
+    /* mINI stores keys in lower case */
+    std::string lower(std::string str)
+    {
+        std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return str;
+    }
+
+    std::vector<uint8_t> noise_data(size_t size)
+    {
+        std::mt19937 gen(1234);
+        std::vector<uint8_t> data(size);
+        for (auto& byte : data) byte = static_cast<uint8_t>(gen());
+        return data;
+    }
+
+    /* Text like data, words of a small vocabulary in random order */
+    std::vector<uint8_t> text_data(size_t size)
+    {
+        static const std::array<const char*, 16> words{ "the ", "message ", "key ", "encrypted ", "of ", "and ", "public ", "file ",
+            "signature ", "to ", "a ", "data ", "password ", "is ", "secret ", "\n" };
+        std::mt19937 gen(4321);
+        std::vector<uint8_t> data;
+        data.reserve(size + 16);
+
+        while (data.size() < size)
+        {
+            const char* word = words[gen() % words.size()];
+            data.insert(data.end(), word, word + std::strlen(word));
+        }
+
+        data.resize(size);
+        return data;
+    }
+
+    /* @brief Encrypt data with the options and measure how long it took
+    @param seconds: receives the duration of the operation
+    @param output_size: receives the size of the message */
+    pgp::OpRes timed_encrypt(rnp::FFI& ffi, const std::vector<uint8_t>& data, const pgp::EncryptOptions& options, double& seconds, size_t& output_size)
+    {
+        rnp::Input input;
+        rnp::Output output;
+        pgp::utils::PooledBuffer result(data.size() + 64 * 1024);
+
+        if (input.set_input_from_memory(data.data(), data.size()) != RNP_SUCCESS) return "Failed setting input from memory\n";
+        if (output.set_output_to_buffer(result) != RNP_SUCCESS) return "Failed setting output\n";
+
+        rnp::EncryptOperation op;
+        if (op.create(ffi, input, output) != RNP_SUCCESS) return "Failed to create encryption operation.\n";
+        op.set_armor(options.armor);
+        op.set_compression(std::string(options.compression), options.compression_level);
+        op.set_cipher(std::string(options.cipher));
+        /* fixed, low iteration count so deriving the key does not end up in the measurement */
+        op.set_password("calibration", RNP_ALGNAME_SHA256, 1024, RNP_ALGNAME_AES_256);
+
+        const auto start = Clock::now();
+        if (op.execute() != RNP_SUCCESS) return "Failed to encrypt with " + options.cipher + "/" + options.compression + "\n";
+        output.destroy();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        output_size = result.size();
+        return true;
+    }
+
+    double mib_per_second(size_t bytes, double seconds)
+    {
+        return bytes / (1024.0 * 1024.0) / std::max<double>(seconds, 1e-6);
+    }
+
+    /* @return Shannon entropy of the bytes, in bits per byte */
+    double entropy(const uint8_t* data, size_t size)
+    {
+        std::array<size_t, 256> counts{};
+        for (size_t i = 0; i < size; i++) counts[data[i]]++;
+
+        double bits{ 0 };
+        for (const auto count : counts)
+        {
+            if (count == 0) continue;
+            const double p = static_cast<double>(count) / size;
+            bits -= p * std::log2(p);
+        }
+
+        return bits;
+    }
+
+    /* The calibration and policy in use, never changed again once ready is set so readers need no lock */
+    struct Current
+    {
+        std::mutex mutex;
+        std::atomic<bool> ready{ false };
+        pgp::tune::Calibration calibration;
+        pgp::tune::Policy policy;
+    };
+
+    Current& current()
+    {
+        static Current current;
+        return current;
+    }
+}
+
+bool pgp::tune::has_aes_ni()
+{
+#if defined(_M_X64) || defined(_M_IX86)
+    int info[4]{};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) != 0;
+#else
+    return false;
+#endif
+}
+
+pgp::OpRes pgp::tune::calibrate(Calibration& calibration)
+{
+    rnp::FFI ffi("GPG", "GPG");
+    Calibration result;
+    double seconds{};
+    size_t output_size{};
+
+    if (!ffi) return "Failed to create ffi.\n";
+
+    result.aes_ni = has_aes_ni();
+
+    const auto random = noise_data(4 * 1024 * 1024);
+    for (const auto cipher : calibrated_ciphers)
+    {
+        EncryptOptions options;
+        options.armor = false;
+        options.cipher = cipher;
+        options.compression = "Uncompressed";
+        options.compression_level = 0;
+
+        if (auto res = timed_encrypt(ffi, random, options, seconds, output_size); !res) return res;
+
+        result.ciphers.push_back({ cipher, mib_per_second(random.size(), seconds) });
+    }
+
+    const auto text = text_data(2 * 1024 * 1024);
+    for (const auto algorithm : calibrated_algorithms)
+    {
+        for (const auto level : calibrated_levels)
+        {
+            EncryptOptions options;
+            options.armor = false;
+            options.compression = algorithm;
+            options.compression_level = level;
+
+            if (auto res = timed_encrypt(ffi, text, options, seconds, output_size); !res) return res;
+
+            result.compression.push_back({ algorithm, level, mib_per_second(text.size(), seconds), static_cast<double>(output_size) / text.size() });
+        }
+    }
+
+    calibration = std::move(result);
+    return true;
+}
+
+bool pgp::tune::load(const mINI::INIStructure& settings, Calibration& calibration)
+{
+    const auto section = settings.get("autotune");
+    Calibration result;
+
+    if (!section.has("aes_ni")) return false;
+    result.aes_ni = section.get("aes_ni") == "yes";
+
+    try
+    {
+        for (const auto cipher : calibrated_ciphers)
+        {
+            const auto key = lower(std::string("cipher.") + cipher);
+            if (!section.has(key)) return false;
+
+            result.ciphers.push_back({ cipher, std::stod(section.get(key)) });
+        }
+
+        for (const auto algorithm : calibrated_algorithms)
+        {
+            for (const auto level : calibrated_levels)
+            {
+                const auto key = lower(std::string("compression.") + algorithm + "." + std::to_string(level));
+                if (!section.has(key)) return false;
+
+                /* stored as throughput;ratio */
+                std::istringstream in(section.get(key));
+                CompressionSample sample{ algorithm, level };
+                char sep{};
+
+                if (!(in >> sample.throughput >> sep >> sample.ratio) || sep != ';') return false;
+
+                result.compression.push_back(sample);
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+
+    calibration = std::move(result);
+    return true;
+}
+
+void pgp::tune::store(mINI::INIStructure& settings, const Calibration& calibration)
+{
+    auto& section = settings["autotune"];
+
+    section["aes_ni"] = calibration.aes_ni ? "yes" : "no";
+
+    for (const auto& sample : calibration.ciphers)
+        section[lower("cipher." + sample.cipher)] = std::to_string(sample.throughput);
+
+    for (const auto& sample : calibration.compression)
+    {
+        std::ostringstream out;
+        out << sample.throughput << ';' << sample.ratio;
+        section[lower("compression." + sample.algorithm + "." + std::to_string(sample.level))] = out.str();
+    }
+
+    /* make the policy visible so it can be edited */
+    if (!section.has("enabled")) section["enabled"] = "no";
+    if (!section.has("ciphers")) section["ciphers"] = "AES256,CAMELLIA256,TWOFISH";
+    if (!section.has("max_ratio_loss")) section["max_ratio_loss"] = "0.10";
+    if (!section.has("armor")) section["armor"] = "yes";
+}
+
+pgp::tune::Policy pgp::tune::load_policy(const mINI::INIStructure& settings)
+{
+    const auto section = settings.get("autotune");
+    Policy policy;
+
+    if (section.has("ciphers"))
+    {
+        std::vector<std::string> ciphers;
+        std::istringstream in(section.get("ciphers"));
+
+        for (std::string cipher; std::getline(in, cipher, ',');)
+        {
+            cipher.erase(std::remove_if(cipher.begin(), cipher.end(), [](unsigned char c) { return std::isspace(c); }), cipher.end());
+            if (!cipher.empty()) ciphers.push_back(cipher);
+        }
+
+        if (!ciphers.empty()) policy.ciphers = std::move(ciphers);
+    }
+
+    if (section.has("max_ratio_loss"))
+    {
+        try { policy.max_ratio_loss = std::max<double>(0.0, std::stod(section.get("max_ratio_loss"))); }
+        catch (const std::exception&) {}
+    }
+
+    if (section.has("armor")) policy.armor = section.get("armor") != "no";
+
+    return policy;
+}
+
+bool pgp::tune::enabled()
+{
+    return suite::persistent::settings().get("autotune").get("enabled") == "yes";
+}
+
+const pgp::tune::Calibration& pgp::tune::calibration()
+{
+    auto& state = current();
+    if (state.ready) return state.calibration;
+
+    if (!prepare())
+    {
+        Calibration measured;
+
+        /* even if calibrating failed, choose falls back to the defaults for an empty calibration */
+        calibrate(measured);
+        install(measured);
+    }
+
+    return state.calibration;
+}
+
+bool pgp::tune::prepare()
+{
+    auto& state = current();
+    std::lock_guard lock(state.mutex);
+    if (state.ready) return true;
+
+    auto& settings = suite::persistent::settings();
+    Calibration stored;
+
+    /* a calibration from different hardware is worthless */
+    if (!load(settings, stored) || stored.aes_ni != has_aes_ni()) return false;
+
+    state.calibration = std::move(stored);
+    state.policy = load_policy(settings);
+    state.ready = true;
+
+    return true;
+}
+
+void pgp::tune::install(const Calibration& calibration)
+{
+    auto& state = current();
+    std::lock_guard lock(state.mutex);
+    if (state.ready) return;
+
+    auto& settings = suite::persistent::settings();
+
+    if (!calibration.empty())
+    {
+        store(settings, calibration);
+        suite::persistent::save_settings();
+    }
+
+    state.calibration = calibration;
+    state.policy = load_policy(settings);
+    state.ready = true;
+}
+
+bool pgp::tune::ready()
+{
+    return current().ready;
+}
+
+pgp::EncryptOptions pgp::tune::choose(const Calibration& calibration, const Policy& policy, const uint8_t* sample, size_t sample_size)
+{
+    EncryptOptions options;
+    options.armor = policy.armor;
+
+    if (calibration.empty()) return options;
+
+    /* fastest cipher the policy allows */
+    double best_cipher{ 0 };
+    for (const auto& sample : calibration.ciphers)
+    {
+        const bool allowed = std::any_of(policy.ciphers.begin(), policy.ciphers.end(),
+            [&](const std::string& cipher) { return lower(cipher) == lower(sample.cipher); });
+
+        if (allowed && sample.throughput > best_cipher)
+        {
+            best_cipher = sample.throughput;
+            options.cipher = sample.cipher;
+        }
+    }
+
+    /* compressing data that is already compressed only costs time */
+    if (sample_size > 0 && entropy(sample, std::min<size_t>(sample_size, sample_limit)) > incompressible_entropy)
+    {
+        options.compression = "Uncompressed";
+        options.compression_level = 0;
+        return options;
+    }
+
+    /* fastest compression whose output is not much larger than the best one */
+    double best_ratio{ 1 };
+    for (const auto& sample : calibration.compression) best_ratio = std::min<double>(best_ratio, sample.ratio);
+
+    double best_compression{ 0 };
+    for (const auto& sample : calibration.compression)
+    {
+        if (sample.ratio > best_ratio * (1 + policy.max_ratio_loss) || sample.throughput <= best_compression) continue;
+
+        best_compression = sample.throughput;
+        options.compression = sample.algorithm;
+        options.compression_level = sample.level;
+    }
+
+    return options;
+}
+
+pgp::EncryptOptions pgp::tune::choose(const uint8_t* sample, size_t sample_size)
+{
+    const auto& measured = calibration();
+    return choose(measured, current().policy, sample, sample_size);
+}
+
+pgp::EncryptOptions pgp::tune::choose_for_file(const std::string& path)
+{
+    std::ifstream file(utils::to_path(path), std::ios::binary);
+    std::vector<uint8_t> sample(sample_limit);
+
+    file.read(reinterpret_cast<char*>(sample.data()), sample.size());
+    sample.resize(static_cast<size_t>(std::max<std::streamsize>(file.gcount(), 0)));
+
+    return choose(sample.data(), sample.size());
+}
@@ -0,0 +1,117 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <mini/ini.h>
+
+#include "pgpsuite_common.h"
+#include "PGPEncrypt.h"
+
+/* Picks cipher and compression per job from measurements taken on this machine
+* The calibration runs once, on first use, and is stored in settings.ini under [autotune] */
+namespace pgp::tune
+{
+    /* Throughput of a cipher on uncompressible data, in MiB/s */
+    struct CipherSample
+    {
+        std::string cipher;
+        double throughput{ 0 };
+    };
+
+    /* Throughput in MiB/s and output size relative to input of a compression setting on text like data */
+    struct CompressionSample
+    {
+        std::string algorithm;
+        int level{ 0 };
+        double throughput{ 0 };
+        double ratio{ 1 };
+    };
+
+    struct Calibration
+    {
+        /* measured on a cpu with aes instructions, recalibrated when that changes */
+        bool aes_ni{ false };
+        std::vector<CipherSample> ciphers;
+        std::vector<CompressionSample> compression;
+
+        bool empty() const { return ciphers.empty() || compression.empty(); }
+    };
+
+    /* What the tuner is allowed to pick from */
+    struct Policy
+    {
+        /* ciphers that are acceptable, the fastest one is used */
+        std::vector<std::string> ciphers{ RNP_ALGNAME_AES_256, RNP_ALGNAME_CAMELLIA_256, RNP_ALGNAME_TWOFISH };
+        /* how much larger than the best compression the output may get in exchange for speed, 0.1 is 10% */
+        double max_ratio_loss{ 0.10 };
+        bool armor{ true };
+    };
+
+    /* @return True if the cpu supports the AES instructions */
+    bool has_aes_ni();
+
+    /* @brief Measure the cipher and compression throughput of this machine, takes a second or two */
+    OpRes calibrate(Calibration& calibration);
+
+    /* @return False if there is no (complete) calibration stored */
+    bool load(const mINI::INIStructure& settings, Calibration& calibration);
+    void store(mINI::INIStructure& settings, const Calibration& calibration);
+
+    /* @brief Read the policy from settings, missing values keep their default */
+    Policy load_policy(const mINI::INIStructure& settings);
+
+    /* @return True if auto tuning is switched on in the settings */
+    bool enabled();
+
+    /* @brief The calibration of this machine, calibrates and saves to the settings on first use
+    * The first call reads and writes the settings, make it from the thread that owns them before any workers start,
+    * and not from the ui thread since calibrating takes a second or two. Later calls only read and are safe from any thread */
+    const Calibration& calibration();
+
+    /* @brief Make the stored calibration and the policy current, without calibrating
+    * Reads the settings, call it from the thread that owns them
+    @return False if there is no usable calibration stored, calibrate and install one then */
+    bool prepare();
+
+    /* @brief Store a fresh calibration in the settings and make it current together with the policy, does nothing if one is current already
+    * Writes the settings, call it from the thread that owns them */
+    void install(const Calibration& calibration);
+
+    /* @return True once calibration() returns without blocking */
+    bool ready();
+
+    /* @brief Pick the options for a single job
+    @param sample: start of the data to be encrypted, used to guess how well it compresses */
+    EncryptOptions choose(const Calibration& calibration, const Policy& policy, const uint8_t* sample, size_t sample_size);
+
+    /* @brief Same as choose, using the current calibration and the policy that was loaded with it
+    * Calls calibration(), so the first call has the same restrictions */
+    EncryptOptions choose(const uint8_t* sample, size_t sample_size);
+
+    /* @brief Read the start of a file and choose for it */
+    EncryptOptions choose_for_file(const std::string& path);
+}
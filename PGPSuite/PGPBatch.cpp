@@ -0,0 +1,385 @@
+#include "PGPBatch.h"
+#include "PGPEncrypt.h"
+#include "PGPDecrypt.h"
+#include "PGPAutoTune.h"
+#include "Utils.h"
+
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /* @brief Read ahead stage, loads the file into the item or marks it to be streamed */
+    pgp::OpRes read_item(pgp::batch::Item& item, size_t max_buffered_size)
+    {
+        std::error_code ec;
+        const auto size = fs::file_size(pgp::utils::to_path(item.job.source), ec);
+
+        if (ec) return "Could not open: " + item.job.source;
+
+        if (size > max_buffered_size)
+        {
+            item.direct = true;
+            return true;
+        }
+
+        pgp::utils::FileSource source;
+        if (auto res = source.open(item.job.source, item.input); !res) return res;
+
+        item.data.resize(static_cast<size_t>(source.size())); /* warm memory from the pool, not zero filled */
+
+        return source.read_all(item.data.data());
+    }
+
+    /* @brief Open the output of an item under its partial name */
+    pgp::OpRes open_output(pgp::batch::Item& item, pgp::utils::FileSink& sink)
+    {
+        std::error_code ec;
+        const auto path = pgp::utils::to_path(item.job.destination);
+
+        if (path.has_parent_path()) fs::create_directories(path.parent_path(), ec);
+
+        return sink.open(item.job.destination, item.output);
+    }
+
+    /* @brief Write behind stage, stores the processed data */
+    pgp::OpRes write_item(pgp::batch::Item& item)
+    {
+        pgp::utils::FileSink sink;
+        item.output.expected_size = item.data.size();
+
+        if (auto res = open_output(item, sink); !res) return res;
+        if (!sink.write(item.data.data(), item.data.size())) return "Failed writing: " + item.job.destination;
+
+        /* hand the buffer back to the pool now so the reader can reuse it */
+        item.data.reset();
+
+        return sink.commit();
+    }
+
+    /* @brief Set the input of an item for a worker, pooled memory for buffered items, the file for direct ones
+    @param source: reads the file of direct items, has to outlive the input */
+    pgp::OpRes prepare_input(pgp::batch::Item& item, rnp::Input& input, pgp::utils::FileSource& source)
+    {
+        if (item.direct)
+        {
+            if (auto res = source.open(item.job.source, item.input); !res) return res;
+            if (input.set_input_from_source(source) != RNP_SUCCESS) return "Could not open: " + item.job.source;
+            return true;
+        }
+
+        if (input.set_input_from_memory(item.data.data(), item.data.size(), false) != RNP_SUCCESS) return "Failed setting input from memory\n";
+
+        return true;
+    }
+
+    /* @brief Prepare input and output of an item for a worker, pooled memory for buffered items, files for direct ones
+    @param source: reads the file of direct items, has to outlive the input
+    @param result: buffer that receives the output of buffered items
+    @param sink: file that receives the output of direct items, to be committed once the output is destroyed */
+    pgp::OpRes prepare_io(pgp::batch::Item& item, rnp::Input& input, rnp::Output& output, pgp::utils::FileSource& source, pgp::utils::PooledBuffer& result, pgp::utils::FileSink& sink)
+    {
+        if (auto res = prepare_input(item, input, source); !res) return res;
+
+        if (item.direct)
+        {
+            if (auto res = open_output(item, sink); !res) return res;
+            if (output.set_output_to_sink(sink) != RNP_SUCCESS) return "Could not create: " + item.job.destination;
+            return true;
+        }
+
+        if (output.set_output_to_buffer(result) != RNP_SUCCESS) return "Failed setting output\n";
+
+        return true;
+    }
+
+    /* Per worker state */
+    struct EncryptContext
+    {
+        rnp::FFI ffi{ "GPG", "GPG" };
+        rnp::KeyHandle key; /* declared after the ffi, so it is released first */
+        std::string password;
+    };
+
+    struct DecryptContext
+    {
+        rnp::FFI ffi{ "GPG", "GPG" };
+        std::string password;
+    };
+
+    /* @brief The encrypting worker, shared by every way of loading the recipient */
+    pgp::batch::Worker encrypt_item(std::shared_ptr<EncryptContext> context, bool auto_tune)
+    {
+        return [context, auto_tune](pgp::batch::Item& item) -> pgp::OpRes
+        {
+            pgp::EncryptOptions options;
+            if (auto_tune)
+                options = item.direct ? pgp::tune::choose_for_file(item.job.source) : pgp::tune::choose(item.data.data(), item.data.size());
+
+            /* armoring grows the data by a third, reserve that up front so the sink rarely has to grow */
+            pgp::utils::PooledBuffer result(item.data.size() / 3 * 4 + 64 * 1024);
+            pgp::utils::FileSink sink;
+            pgp::utils::FileSource source;
+            rnp::Input input;
+            rnp::Output output;
+
+            if (auto res = prepare_io(item, input, output, source, result, sink); !res) return res;
+
+            const auto name = pgp::utils::from_path(pgp::utils::to_path(item.job.source).filename());
+            auto res = pgp::encrypt_with(context->ffi, context->key, input, output, context->password, name, options);
+
+            output.destroy(); /* flush everything into the buffer or sink before handing it over */
+            if (res && item.direct) res = sink.commit();
+            if (res && !item.direct) item.data = std::move(result);
+
+            return res;
+        };
+    }
+}
+
+std::vector<pgp::batch::JobResult> pgp::batch::run(const std::vector<Job>& jobs, WorkerFactory factory, const Options& options, Progress progress)
+{
+    const size_t worker_count = options.workers > 0 ? options.workers : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    utils::BoundedQueue<Item> to_workers(options.queue_depth);
+    utils::BoundedQueue<Item> to_writer(options.queue_depth);
+    std::vector<JobResult> results(jobs.size());
+    std::atomic<size_t> active_workers{ worker_count };
+
+    std::thread reader([&]
+        {
+            trace::name_thread("batch reader");
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                Item item;
+                item.index = i;
+                item.job = jobs[i];
+                {
+                    metrics::Recorder recorder(item.metrics);
+                    metrics::Scope scope("read");
+                    trace::Span span("read", item.job.source);
+
+                    item.input.backend = options.io_backend;
+                    item.input.depth = options.io_depth;
+                    item.output.block_size = options.write_block_size;
+                    item.output.unbuffered = options.unbuffered_writes;
+                    item.output.backend = options.io_backend;
+                    item.output.depth = options.io_depth;
+                    item.result = read_item(item, options.max_buffered_size);
+                    /* direct outputs are about as large as their input */
+                    if (item.direct) item.output.expected_size = utils::file_size(item.job.source);
+                    metrics::add_bytes_in(item.direct ? utils::file_size(item.job.source) : item.data.size());
+                }
+
+                if (!to_workers.push(std::move(item))) break;
+            }
+            to_workers.close();
+        });
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back([&, i]
+            {
+                trace::name_thread("batch worker " + std::to_string(i));
+                auto worker = factory();
+
+                while (auto item = to_workers.pop())
+                {
+                    /* failed items are still passed on so the writer can report them */
+                    if (item->result)
+                    {
+                        metrics::Recorder recorder(item->metrics);
+                        trace::Span span("process", item->job.source);
+
+                        /* an exception fails only this item, letting it escape would end the whole batch */
+                        try { item->result = worker(*item); }
+                        catch (const std::exception& e) { item->result = item->job.source + ": " + e.what(); }
+                    }
+                    to_writer.push(std::move(*item));
+                }
+
+                if (--active_workers == 0) to_writer.close();
+            });
+    }
+
+    std::thread writer([&]
+        {
+            trace::name_thread("batch writer");
+            while (auto item = to_writer.pop())
+            {
+                {
+                    metrics::Recorder recorder(item->metrics);
+
+                    if (item->job.destination.empty())
+                        item->data.reset(); /* only checked, nothing to write */
+                    else if (item->direct)
+                        metrics::add_bytes_out(item->result ? utils::file_size(item->job.destination) : 0);
+                    else if (item->result)
+                    {
+                        metrics::Scope scope("write");
+                        trace::Span span("write", item->job.destination);
+                        metrics::add_bytes_out(item->data.size());
+                        item->result = write_item(*item);
+                    }
+
+                    item->result.attach(recorder.finish());
+                }
+
+                auto& result = results[item->index];
+                result = { std::move(item->job.source), std::move(item->job.destination), std::move(item->result), std::move(item->note) };
+
+                if (progress) progress(result);
+            }
+        });
+
+    reader.join();
+    for (auto& worker : workers) worker.join();
+    writer.join();
+
+    return results;
+}
+
+pgp::batch::WorkerFactory pgp::batch::encrypt_worker(std::string pubkey_file, std::string userid, std::string password, bool auto_tune)
+{
+    /* calibrates on first use, here on the calling thread before any worker runs, the workers then only read it */
+    if (auto_tune) tune::calibration();
+
+    return [pubkey_file, userid, password, auto_tune]() -> Worker
+    {
+        auto context = std::make_shared<EncryptContext>();
+        context->password = password;
+
+        if (!pubkey_file.empty())
+        {
+            if (auto res = load_recipient(context->ffi, pubkey_file, userid, context->key.put()); !res)
+                return [res](Item&) { return res; };
+        }
+
+        return encrypt_item(context, auto_tune);
+    };
+}
+
+pgp::batch::WorkerFactory pgp::batch::encrypt_worker(std::shared_ptr<const std::vector<uint8_t>> recipient, std::string userid, std::string password, bool auto_tune)
+{
+    if (auto_tune) tune::calibration();
+
+    return [recipient, userid, password, auto_tune]() -> Worker
+    {
+        auto context = std::make_shared<EncryptContext>();
+        context->password = password;
+
+        if (recipient && !recipient->empty())
+        {
+            if (auto res = load_recipient(context->ffi, *recipient, userid, context->key.put()); !res)
+                return [res](Item&) { return res; };
+        }
+
+        return encrypt_item(context, auto_tune);
+    };
+}
+
+pgp::batch::WorkerFactory pgp::batch::decrypt_worker(std::string secring_file, std::string password)
+{
+    /* the workers share what can be shared, a keyring directory is indexed once instead of by every worker */
+    keystore::prepare_secret_keys(secring_file);
+
+    return [secring_file, password]() -> Worker
+    {
+        auto context = std::make_shared<DecryptContext>();
+        context->password = password;
+
+        if (!secring_file.empty())
+        {
+            if (auto res = load_secret_keys(context->ffi, secring_file); !res)
+                return [res](Item&) { return res; };
+        }
+
+        rnp_ffi_set_pass_provider(context->ffi, context_pass_provider, &context->password);
+
+        return [context](Item& item) -> OpRes
+        {
+            utils::PooledBuffer result(item.data.size());
+            utils::FileSink sink;
+            utils::FileSource source;
+            rnp::Input input;
+            rnp::Output output;
+
+            if (auto res = prepare_io(item, input, output, source, result, sink); !res) return res;
+
+            auto res = decrypt_with(context->ffi, input, output);
+
+            output.destroy(); /* flush everything into the buffer or sink before handing it over */
+            if (res && item.direct) res = sink.commit();
+            if (res && !item.direct) item.data = std::move(result);
+
+            return res;
+        };
+    };
+}
+
+pgp::batch::WorkerFactory pgp::batch::verify_worker(std::string secring_file, std::string password)
+{
+    /* the workers share what can be shared, a keyring directory is indexed once instead of by every worker */
+    keystore::prepare_secret_keys(secring_file);
+
+    return [secring_file, password]() -> Worker
+    {
+        auto context = std::make_shared<DecryptContext>();
+        context->password = password;
+
+        if (!secring_file.empty())
+        {
+            if (auto res = load_secret_keys(context->ffi, secring_file); !res)
+                return [res](Item&) { return res; };
+        }
+
+        rnp_ffi_set_pass_provider(context->ffi, context_pass_provider, &context->password);
+
+        return [context](Item& item) -> OpRes
+        {
+            utils::FileSource source;
+            rnp::Input input;
+
+            if (auto res = prepare_input(item, input, source); !res) return res;
+
+            return check_integrity(context->ffi, input, item.note);
+        };
+    };
+}
+
+std::vector<pgp::batch::Job> pgp::batch::collect_jobs(const std::vector<std::string>& inputs, const std::string& destination_dir, std::function<std::string(const std::string&)> make_destination)
+{
+    std::vector<Job> jobs;
+
+    auto add_job = [&](const fs::path& file, const fs::path& relative)
+    {
+        const auto target = destination_dir.empty() ? file.parent_path() / relative.filename() : utils::to_path(destination_dir) / relative;
+        jobs.push_back({ utils::from_path(file), make_destination(utils::from_path(target)) });
+    };
+
+    for (const auto& input : inputs)
+    {
+        const auto path = utils::to_path(input);
+        std::error_code ec;
+
+        if (!fs::is_directory(path, ec))
+        {
+            add_job(path, path.filename());
+            continue;
+        }
+
+        /* keep the layout of the directory in the destination */
+        for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+            it != fs::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (ec) break;
+            if (it->is_regular_file(ec)) add_job(it->path(), it->path().lexically_relative(path));
+        }
+    }
+
+    return jobs;
+}
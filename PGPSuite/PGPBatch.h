@@ -0,0 +1,129 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+#include "Concurrency.h"
+#include "Metrics.h"
+
+/* Pipelined batch execution of many files
+* Every batch runs three stages connected by bounded queues:
+*   reader  -> reads file N+1 ahead while file N is being processed
+*   workers -> one or more threads doing the crypto, each with its own ffi
+*   writer  -> writes file N-1 behind while file N is being processed
+* This way the disk and the cpu are both kept busy instead of taking turns */
+namespace pgp::batch
+{
+    /* @return Name the output of the job has while it is being written, outputs only get their real name once complete */
+    inline std::string partial_name(const std::string& destination) { return destination + utils::partial_suffix; }
+
+    /* A single file to be processed */
+    struct Job
+    {
+        std::string source;
+        /* empty for jobs that only check the source, nothing gets written for those */
+        std::string destination;
+    };
+
+    /* Outcome of a single job */
+    struct JobResult
+    {
+        std::string source;
+        std::string destination;
+        OpRes result;
+        /* what the worker found out besides success or failure, may be empty */
+        std::string note;
+    };
+
+    /* Tuning of the pipeline */
+    struct Options
+    {
+        /* amount of crypto threads, 0 uses one per core */
+        size_t workers{ 0 };
+        /* maximum amount of files waiting between two stages */
+        size_t queue_depth{ 4 };
+        /* files larger than this are not read ahead but streamed from path to path by a worker */
+        size_t max_buffered_size{ 64 * 1024 * 1024 };
+        /* size of the writes to output files */
+        size_t write_block_size{ 4 * 1024 * 1024 };
+        /* write outputs past the file cache */
+        bool unbuffered_writes{ false };
+        /* how inputs are read and outputs written, overlapped keeps several requests in flight per file */
+        utils::IOBackend io_backend{ utils::IOBackend::Blocking };
+        /* requests in flight per file with the overlapped backend */
+        size_t io_depth{ 4 };
+    };
+
+    /* Item travelling through the pipeline */
+    struct Item
+    {
+        size_t index{ 0 };
+        Job job;
+        utils::PooledBuffer data; /* file contents after reading, result after processing */
+        bool direct{ false }; /* too large to buffer, the worker reads and writes the files itself */
+        utils::FileSourceOptions input; /* how the input file is read */
+        utils::FileSinkOptions output; /* how the output file is written */
+        OpRes result;
+        std::string note;
+        /* filled in by every stage the item passes through */
+        std::shared_ptr<Metrics> metrics{ std::make_shared<Metrics>() };
+    };
+
+    /* Processes a single item in place */
+    using Worker = std::function<OpRes(Item&)>;
+    /* Called once on every worker thread so ffi's never cross threads */
+    using WorkerFactory = std::function<Worker()>;
+    /* Called from the writer thread every time a job finished */
+    using Progress = std::function<void(const JobResult&)>;
+
+    /* @brief Run all jobs through the pipeline, blocks until everything is done
+    @return The result of every job, in the same order as the jobs */
+    std::vector<JobResult> run(const std::vector<Job>& jobs, WorkerFactory factory, const Options& options = {}, Progress progress = {});
+
+    /* @brief Worker factory that encrypts to the given recipient and/or password, the keyring is loaded once per worker
+    @param auto_tune: pick cipher and compression per file with the auto tuner instead of using the defaults */
+    WorkerFactory encrypt_worker(std::string pubkey_file, std::string userid, std::string password = {}, bool auto_tune = false);
+
+    /* @brief Worker factory that encrypts to a key exported with export_recipient, workers load it from memory instead of parsing the keyring
+    @param recipient: exported key, shared by all workers and all runs */
+    WorkerFactory encrypt_worker(std::shared_ptr<const std::vector<uint8_t>> recipient, std::string userid, std::string password = {}, bool auto_tune = false);
+
+    /* @brief Worker factory that decrypts with the given keyring and/or password, the keyring is loaded once per worker */
+    WorkerFactory decrypt_worker(std::string secring_file, std::string password = {});
+
+    /* @brief Worker factory that decrypts without writing anything, to check messages are intact
+    * Give the jobs no destination. The note of every result holds the protection that was checked
+    @see check_integrity */
+    WorkerFactory verify_worker(std::string secring_file, std::string password = {});
+
+    /* @brief Turn files and directories into jobs, directories are searched recursively
+    @param destination_dir: directory to place the results in, next to the source if empty
+    @param make_destination: turns the path relative to the input into the output name, e.g. appending .asc */
+    std::vector<Job> collect_jobs(const std::vector<std::string>& inputs, const std::string& destination_dir, std::function<std::string(const std::string&)> make_destination);
+}
@@ -0,0 +1,487 @@
+#include "PGPDaemon.h"
+#include "PGPEncrypt.h"
+#include "PGPDecrypt.h"
+#include "BufferPool.h"
+#include "Concurrency.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <filesystem>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <Windows.h>
+#include <afunix.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    using namespace pgp::daemon;
+
+    void put_u32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    uint32_t get_u32(const uint8_t* in)
+    {
+        return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) | (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    /* frames are read in pieces of this size, so memory is only taken for data that actually arrived */
+    constexpr size_t read_chunk_size{ 1024 * 1024 };
+
+    Message error_response(const pgp::OpRes& res)
+    {
+        Message response;
+        response.code = static_cast<uint8_t>(Status::Error);
+        response.add(res.what());
+        return response;
+    }
+
+    Message ok_response()
+    {
+        Message response;
+        response.code = static_cast<uint8_t>(Status::Ok);
+        return response;
+    }
+
+    /* @return The user sid of a process, empty if it can not be queried */
+    std::vector<uint8_t> process_user(HANDLE process)
+    {
+        HANDLE token{ nullptr };
+        DWORD size{ 0 };
+
+        if (!OpenProcessToken(process, TOKEN_QUERY, &token)) return {};
+
+        GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+        std::vector<uint8_t> info(size);
+        const bool queried = size > 0 && GetTokenInformation(token, TokenUser, info.data(), size, &size);
+        CloseHandle(token);
+
+        if (!queried) return {};
+
+        const auto sid = reinterpret_cast<const TOKEN_USER*>(info.data())->User.Sid;
+        const auto* bytes = static_cast<const uint8_t*>(sid);
+        return std::vector<uint8_t>(bytes, bytes + GetLengthSid(sid));
+    }
+
+    /* @brief Check the process on the other end of the connection runs as the same user as the daemon
+    * the socket file can be reachable by anyone, while the daemon may hold unlocked secret keys */
+    bool same_user(Socket& socket)
+    {
+        ULONG pid{ 0 };
+        DWORD returned{ 0 };
+
+        if (WSAIoctl(socket.native_handle(), SIO_AF_UNIX_GETPEERPID, nullptr, 0, &pid, sizeof(pid), &returned, nullptr, nullptr) != 0) return false;
+
+        HANDLE peer = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+        if (peer == nullptr) return false;
+
+        const auto peer_user = process_user(peer);
+        CloseHandle(peer);
+
+        return !peer_user.empty() && peer_user == process_user(GetCurrentProcess());
+    }
+
+    /* Resident state of a worker, the recipient keys that were asked for are kept located */
+    struct Context
+    {
+        rnp::FFI ffi{ "GPG", "GPG" };
+        std::string password;
+        std::map<std::string, rnp::KeyHandle> recipients; /* declared after the ffi, so they are released first */
+    };
+
+    /* @brief Unlock every secret key that was loaded, so decrypting does not have to derive the key every time */
+    pgp::OpRes unlock_secret_keys(rnp::FFI& ffi, const std::string& password)
+    {
+        rnp::IdentifierIterator it;
+        const char* grip{};
+
+        if (rnp_identifier_iterator_create(ffi, it.put(), "grip") != RNP_SUCCESS) return "Failed to list the keys.\n";
+
+        while (rnp_identifier_iterator_next(it, &grip) == RNP_SUCCESS && grip != nullptr)
+        {
+            rnp::KeyHandle key;
+            bool secret{ false };
+
+            if (rnp_locate_key(ffi, "grip", grip, key.put()) != RNP_SUCCESS || key == nullptr) continue;
+
+            if (rnp_key_have_secret(key, &secret) == RNP_SUCCESS && secret) rnp_key_unlock(key, password.c_str());
+        }
+
+        /* keys from a GnuPG home are loaded on demand, those stay locked */
+        return true;
+    }
+
+    pgp::OpRes setup_context(Context& context, const Options& options)
+    {
+        if (!context.ffi) return "Failed to create ffi.\n";
+
+        if (!options.pubkey_file.empty())
+            if (auto res = pgp::keystore::load_public_keys(context.ffi, options.pubkey_file); !res) return res;
+
+        if (!options.secring_file.empty())
+        {
+            if (auto res = pgp::load_secret_keys(context.ffi, options.secring_file); !res) return res;
+            if (!options.unlock_password.empty())
+                if (auto res = unlock_secret_keys(context.ffi, options.unlock_password); !res) return res;
+        }
+
+        rnp_ffi_set_pass_provider(context.ffi, pgp::context_pass_provider, &context.password);
+
+        return true;
+    }
+
+    pgp::OpRes locate_recipient(Context& context, const std::string& userid, rnp_key_handle_t& key)
+    {
+        if (auto found = context.recipients.find(userid); found != context.recipients.end())
+        {
+            key = found->second;
+            return true;
+        }
+
+        rnp::KeyHandle located;
+        if (rnp_locate_key(context.ffi, "userid", userid.c_str(), located.put()) != RNP_SUCCESS || located == nullptr)
+            return "Failed to locate recipient key: " + userid;
+
+        key = located;
+        context.recipients.emplace(userid, std::move(located));
+        return true;
+    }
+
+    Message encrypt(Context& context, const Message& request)
+    {
+        const auto& data = request.fields[0];
+        const auto userid = request.text(1);
+        rnp_key_handle_t key{ nullptr };
+
+        if (userid.empty() && request.text(2).empty()) return error_response("A recipient, a password or both are required.\n");
+
+        if (!userid.empty())
+            if (auto res = locate_recipient(context, userid, key); !res) return error_response(res);
+
+        pgp::EncryptOptions options;
+        options.armor = request.text(3) != "0";
+
+        rnp::Input input;
+        rnp::Output output;
+        pgp::utils::PooledBuffer result(data.size() / 3 * 4 + 64 * 1024);
+
+        if (input.set_input_from_memory(data.data(), data.size(), false) != RNP_SUCCESS) return error_response("Failed setting input from memory\n");
+        if (output.set_output_to_buffer(result) != RNP_SUCCESS) return error_response("Failed setting output\n");
+
+        if (auto res = pgp::encrypt_with(context.ffi, key, input, output, request.text(2), "message.txt", options); !res) return error_response(res);
+        output.destroy();
+
+        auto response = ok_response();
+        response.add(std::vector<uint8_t>(result.data(), result.data() + result.size()));
+        return response;
+    }
+
+    Message decrypt(Context& context, const Message& request)
+    {
+        const auto& data = request.fields[0];
+        rnp::Input input;
+        rnp::Output output;
+        pgp::utils::PooledBuffer result(data.size());
+
+        if (input.set_input_from_memory(data.data(), data.size(), false) != RNP_SUCCESS) return error_response("Failed setting input from memory\n");
+        if (output.set_output_to_buffer(result) != RNP_SUCCESS) return error_response("Failed setting output\n");
+
+        /* unlocked keys never ask, otherwise the request can bring the password along */
+        context.password = request.text(1);
+        auto res = pgp::decrypt_with(context.ffi, input, output);
+        context.password.clear();
+
+        if (!res) return error_response(res);
+        output.destroy();
+
+        auto response = ok_response();
+        response.add(std::vector<uint8_t>(result.data(), result.data() + result.size()));
+        return response;
+    }
+
+    /* @brief Check the signatures of a message, the content itself is discarded
+    @return One line per signature with the keyid and whether it is valid */
+    Message verify(Context& context, const Message& request)
+    {
+        const auto& data = request.fields[0];
+
+        rnp::Input input;
+        rnp::Output output;
+        rnp::VerifyOperation op;
+
+        if (input.set_input_from_memory(data.data(), data.size(), false) != RNP_SUCCESS) return error_response("Failed setting input from memory\n");
+        if (output.set_output_to_null() != RNP_SUCCESS) return error_response("Failed setting output\n");
+
+        if (rnp_op_verify_create(op.put(), context.ffi, input, output) != RNP_SUCCESS) return error_response("Failed to create verify operation.\n");
+
+        std::ostringstream report;
+        const auto executed = rnp_op_verify_execute(op);
+        size_t count{ 0 };
+
+        rnp_op_verify_get_signature_count(op, &count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            rnp_op_verify_signature_t signature{};
+            rnp::KeyHandle key;
+            rnp::Buffer<char> keyid;
+
+            if (rnp_op_verify_get_signature_at(op, i, &signature) != RNP_SUCCESS) continue;
+
+            if (rnp_op_verify_signature_get_key(signature, key.put()) == RNP_SUCCESS && key != nullptr)
+                rnp_key_get_keyid(key, &keyid.buffer);
+
+            const auto status = rnp_op_verify_signature_get_status(signature);
+            report << (keyid.buffer != nullptr ? keyid.buffer : "unknown key") << ' '
+                << (status == RNP_SUCCESS ? "valid" : rnp_result_to_string(status)) << '\n';
+        }
+
+        op.reset();
+
+        if (count == 0) return error_response(executed == RNP_SUCCESS ? "The message is not signed.\n" : "Failed to read the message.\n");
+
+        auto response = ok_response();
+        response.add(report.str());
+        return response;
+    }
+
+    /* @brief Answer a request, requests with too few fields are refused */
+    Message handle(Context& context, const Message& request)
+    {
+        static const std::map<Operation, size_t> required_fields
+        {
+            { Operation::Ping, 0 }, { Operation::Encrypt, 4 }, { Operation::Decrypt, 2 }, { Operation::Verify, 1 }, { Operation::Shutdown, 0 },
+        };
+
+        const auto operation = static_cast<Operation>(request.code);
+        const auto required = required_fields.find(operation);
+
+        if (required == required_fields.end()) return error_response("Unknown operation.\n");
+        if (request.fields.size() < required->second) return error_response("Missing fields in request.\n");
+
+        pgp::trace::Span span("daemon request");
+
+        switch (operation)
+        {
+        case Operation::Encrypt: return encrypt(context, request);
+        case Operation::Decrypt: return decrypt(context, request);
+        case Operation::Verify: return verify(context, request);
+        default: return ok_response();
+        }
+    }
+}
+
+pgp::OpRes pgp::daemon::write_message(Socket& socket, const Message& message)
+{
+    std::vector<uint8_t> header;
+    uint64_t size{ 1 };
+
+    for (const auto& field : message.fields) size += 4 + field.size();
+    if (size > max_frame_size) return "Message too large.\n";
+
+    put_u32(header, static_cast<uint32_t>(size));
+    header.push_back(message.code);
+
+    /* the fields are sent straight from where they are, only their sizes are collected */
+    std::vector<uint8_t> sizes;
+    for (const auto& field : message.fields) put_u32(sizes, static_cast<uint32_t>(field.size()));
+
+    std::vector<asio::const_buffer> buffers{ asio::buffer(header) };
+    for (size_t i = 0; i < message.fields.size(); i++)
+    {
+        buffers.push_back(asio::buffer(sizes.data() + 4 * i, 4));
+        buffers.push_back(asio::buffer(message.fields[i]));
+    }
+
+    asio::error_code ec;
+    asio::write(socket, buffers, ec);
+    if (ec) return "Failed to send: " + ec.message();
+
+    return true;
+}
+
+pgp::OpRes pgp::daemon::read_message(Socket& socket, Message& message)
+{
+    asio::error_code ec;
+    uint8_t size_bytes[4]{};
+
+    asio::read(socket, asio::buffer(size_bytes), ec);
+    if (ec) return "Connection closed: " + ec.message();
+
+    const auto size = get_u32(size_bytes);
+    if (size < 1 || size > max_frame_size) return "Invalid frame size.\n";
+
+    /* grown as the data comes in, a size alone does not get a large buffer allocated */
+    std::vector<uint8_t> frame;
+    while (frame.size() < size)
+    {
+        const auto offset = frame.size();
+        frame.resize(offset + std::min<size_t>(size - offset, read_chunk_size));
+
+        asio::read(socket, asio::buffer(frame.data() + offset, frame.size() - offset), ec);
+        if (ec) return "Connection closed: " + ec.message();
+    }
+
+    message = {};
+    message.code = frame[0];
+
+    for (size_t pos = 1; pos < frame.size();)
+    {
+        if (frame.size() - pos < 4) return "Malformed frame.\n";
+
+        const auto field_size = get_u32(frame.data() + pos);
+        pos += 4;
+
+        if (frame.size() - pos < field_size) return "Malformed frame.\n";
+
+        message.fields.emplace_back(frame.begin() + pos, frame.begin() + pos + field_size);
+        pos += field_size;
+    }
+
+    return true;
+}
+
+std::string pgp::daemon::default_socket_path()
+{
+    std::error_code ec;
+    return utils::from_path(fs::temp_directory_path(ec) / "pgpsuite.sock");
+}
+
+pgp::OpRes pgp::daemon::Server::run()
+{
+    const size_t worker_count = _options.workers > 0 ? _options.workers : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    /* load everything before accepting anything, so a bad keyring is reported right away */
+    std::vector<std::unique_ptr<Context>> contexts;
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        auto context = std::make_unique<Context>();
+        if (auto res = setup_context(*context, _options); !res) return res;
+        contexts.push_back(std::move(context));
+    }
+
+    asio::error_code ec;
+    const asio::local::stream_protocol::endpoint endpoint(_options.socket_path);
+
+    /* a socket file is only replaced if it was left behind by a daemon that did not shut down cleanly */
+    {
+        Socket probe(_io);
+        probe.connect(endpoint, ec);
+        if (!ec) return "A daemon is already running on " + _options.socket_path;
+    }
+
+    std::error_code fs_ec;
+    fs::remove(utils::to_path(_options.socket_path), fs_ec);
+    ec.clear();
+
+    _acceptor.open(endpoint.protocol(), ec);
+    if (!ec) _acceptor.bind(endpoint, ec);
+    if (!ec) _acceptor.listen(asio::socket_base::max_listen_connections, ec);
+    if (ec) return "Failed to listen on " + _options.socket_path + ": " + ec.message();
+
+    utils::BoundedQueue<Socket> connections(worker_count);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back([&, i]
+            {
+                trace::name_thread("daemon worker " + std::to_string(i));
+                auto& context = *contexts[i];
+
+                while (auto socket = connections.pop())
+                {
+                    Message request;
+
+                    if (!same_user(*socket))
+                    {
+                        write_message(*socket, error_response("Access denied, the daemon only serves its own user.\n"));
+                        continue;
+                    }
+
+                    {
+                        std::lock_guard lock(_connections_mutex);
+                        _connections.insert(&*socket);
+                    }
+
+                    /* a client may send any amount of requests over one connection */
+                    while (!_stopping && read_message(*socket, request))
+                    {
+                        if (!write_message(*socket, handle(context, request))) break;
+
+                        if (static_cast<Operation>(request.code) == Operation::Shutdown) stop();
+                    }
+
+                    std::lock_guard lock(_connections_mutex);
+                    _connections.erase(&*socket);
+                }
+            });
+    }
+
+    std::function<void()> accept = [&]
+    {
+        _acceptor.async_accept([&](const asio::error_code& ec, Socket socket)
+            {
+                if (ec || _stopping) return;
+
+                /* never wait for a worker here, that would stall accepting and stop() behind clients that keep their connection */
+                if (!connections.try_push(socket))
+                    write_message(socket, error_response("The daemon is busy, try again later.\n"));
+
+                accept();
+            });
+    };
+
+    accept();
+    _io.run();
+
+    connections.close();
+    for (auto& worker : workers) worker.join();
+
+    fs::remove(utils::to_path(_options.socket_path), fs_ec);
+
+    return true;
+}
+
+void pgp::daemon::Server::stop()
+{
+    _stopping = true;
+    asio::post(_io, [this]
+        {
+            asio::error_code ec;
+            _acceptor.close(ec);
+        });
+
+    /* wakes up workers waiting for the next request of an idle client */
+    std::lock_guard lock(_connections_mutex);
+    for (auto* socket : _connections)
+    {
+        asio::error_code ec;
+        socket->shutdown(Socket::shutdown_both, ec);
+    }
+}
+
+pgp::OpRes pgp::daemon::Client::connect(const std::string& socket_path)
+{
+    asio::error_code ec;
+    _socket.connect(asio::local::stream_protocol::endpoint(socket_path), ec);
+
+    if (ec) return "Could not connect to the daemon at " + socket_path + ": " + ec.message();
+
+    return true;
+}
+
+pgp::OpRes pgp::daemon::Client::request(const Message& request, Message& response)
+{
+    if (auto res = write_message(_socket, request); !res) return res;
+    if (auto res = read_message(_socket, response); !res) return res;
+
+    if (static_cast<Status>(response.code) != Status::Ok) return response.text(0).c_str();
+
+    return true;
+}
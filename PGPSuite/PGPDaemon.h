@@ -0,0 +1,140 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <asio.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+
+/* Resident agent serving encrypt, decrypt and verify requests over a local socket
+* The keyrings are parsed once and secret keys can be kept unlocked, so a request only pays for the crypto itself.
+* Every message is a frame of:
+*   uint32 size of the rest of the frame
+*   uint8  operation in a request, status in a response
+*   fields, each a uint32 size followed by that many bytes
+* All integers are little endian, the fields each operation expects are listed with the operations */
+namespace pgp::daemon
+{
+    enum class Operation : uint8_t
+    {
+        Ping = 1,       /* no fields */
+        Encrypt = 2,    /* data, userid, password, armor ("1" or "0"), userid and/or password may be empty */
+        Decrypt = 3,    /* data, password, the password is only used for password encrypted messages and locked keys */
+        Verify = 4,     /* data */
+        Shutdown = 5,   /* no fields */
+    };
+
+    enum class Status : uint8_t
+    {
+        Ok = 0,         /* the result, if the operation has one */
+        Error = 1,      /* the error message */
+    };
+
+    /* frames larger than this are refused, the size is read before the peer sent anything else */
+    constexpr size_t max_frame_size{ 64 * 1024 * 1024 };
+
+    struct Message
+    {
+        uint8_t code{ 0 };
+        std::vector<std::vector<uint8_t>> fields;
+
+        void add(const std::string& str) { fields.emplace_back(str.begin(), str.end()); }
+        void add(std::vector<uint8_t> data) { fields.push_back(std::move(data)); }
+
+        /* @return Field at index as a string, empty if there is no such field */
+        std::string text(size_t index) const
+        {
+            return index < fields.size() ? std::string(fields[index].begin(), fields[index].end()) : std::string();
+        }
+    };
+
+    using Socket = asio::local::stream_protocol::socket;
+
+    /* @brief Send a message as a single frame */
+    OpRes write_message(Socket& socket, const Message& message);
+
+    /* @brief Receive a frame
+    @return An error if the connection closed or the frame is malformed */
+    OpRes read_message(Socket& socket, Message& message);
+
+    /* @return Socket path used when none is given, in the temp directory of the user */
+    std::string default_socket_path();
+
+    struct Options
+    {
+        std::string socket_path{ default_socket_path() };
+        /* keyrings loaded by every worker when the daemon starts */
+        std::string pubkey_file;
+        std::string secring_file;
+        /* unlock all secret keys with this password at startup, keys stay locked if empty */
+        std::string unlock_password;
+        /* amount of connections served at once, every worker has its own ffi, 0 uses one per core
+        * as many connections can wait for a worker, more are turned away */
+        size_t workers{ 0 };
+    };
+
+    class Server
+    {
+    protected:
+        Options _options;
+        asio::io_context _io;
+        asio::local::stream_protocol::acceptor _acceptor{ _io };
+        std::atomic<bool> _stopping{ false };
+        /* connections being served, so stop can wake up their workers */
+        std::mutex _connections_mutex;
+        std::set<Socket*> _connections;
+    public:
+        Server(Options options) : _options(std::move(options)) {}
+        Server(const Server&) = delete;
+
+        /* @brief Serve requests until stop is called or a client asks for a shutdown, blocks
+        * Only processes running as the same user are served
+        @return An error if the keyrings could not be loaded, the socket could not be created or another daemon answers on it */
+        OpRes run();
+
+        /* @brief Make run return, can be called from any thread */
+        void stop();
+    };
+
+    /* Thin client, a connection serves any amount of requests */
+    class Client
+    {
+    protected:
+        asio::io_context _io;
+        Socket _socket{ _io };
+    public:
+        OpRes connect(const std::string& socket_path = default_socket_path());
+
+        /* @brief Send a request and wait for its response
+        @return The error message of the daemon if the request failed */
+        OpRes request(const Message& request, Message& response);
+    };
+}
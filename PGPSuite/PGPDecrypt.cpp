@@ -1,5 +1,8 @@
 #include "PGPDecrypt.h"
 
+#include <fstream>
+#include <string_view>
+
 bool pgp::cin_pass_provider(rnp_ffi_t ffi, void* app_ctx, rnp_key_handle_t key, const char* pgp_context, char buf[], size_t buf_len)
 {
     std::string input{};
@@ -19,46 +22,163 @@ bool pgp::cin_pass_provider(rnp_ffi_t ffi, void* app_ctx, rnp_key_handle_t key,
     return input.size() > 0;
 }
 
+bool pgp::context_pass_provider(rnp_ffi_t ffi, void* app_ctx, rnp_key_handle_t key, const char* pgp_context, char buf[], size_t buf_len)
+{
+    const auto* password = static_cast<const std::string*>(app_ctx);
+
+    if (password == nullptr || password->empty()) return false;
+
+    utils::copy_to_ctype(*password, buf, buf_len);
+
+    return true;
+}
+
 pgp::OpRes pgp::decrypt_text(std::string encrypted_file, std::string output_fname, rnp_password_cb passprovider, void* context, std::string secring_file)
 {
-    rnp::FFI ffi("GPG", "GPG");
     rnp::Input input;
     rnp::Output output;
-    std::vector<uint8_t> buffer;
 
     if (auto res = pgp::utils::validate_strings<std::string>(secring_file, encrypted_file, output_fname); !res) return res;
 
     if (output_fname.size() == 0)
         output_fname = utils::remove_extension(encrypted_file);
 
+    /* create file input and file output objects for the encrypted message and decrypted
+     * message */
+    if (input.set_input_from_path(encrypted_file) != RNP_SUCCESS) return "Error setting input: " + encrypted_file + "\nDoes it exist?";
+
+    /* a wrong password leaves no half written file behind */
+    utils::FileSink sink;
+    if (auto res = sink.open(output_fname, { .expected_size = utils::file_size(encrypted_file) }); !res) return res;
+    if (output.set_output_to_sink(sink) != RNP_SUCCESS) return "Error setting output: " + output_fname;
+
+    metrics::Recorder recorder;
+    metrics::add_bytes_in(utils::file_size(encrypted_file));
+
+    auto res = decrypt_stream(input, output, passprovider, context, secring_file);
+
+    output.destroy(); /* flush before measuring */
+    if (res) res = sink.commit();
+    metrics::add_bytes_out(sink.size());
+
+    return res.attach(recorder.finish());
+}
+
+pgp::OpRes pgp::decrypt_stream(rnp::Input& input, rnp::Output& output, rnp_password_cb passprovider, void* context, const std::string& secring_file)
+{
+    rnp::FFI ffi("GPG", "GPG");
+
     /* if a secret keyring is provided, load it up */
     if (!secring_file.empty())
     {
-        rnp::Input keyfile;
-
-        /* load secret keyring, as it is required for public-key decryption. However, you may
-            * need to load public keyring as well to validate key's signatures. */
-        if (keyfile.set_input_from_path(secring_file)) 
-            return "Failed setting input for: " + secring_file + "\nDoes it exist?";
-
-        if (rnp_load_keys(ffi, "GPG", keyfile, RNP_LOAD_SAVE_SECRET_KEYS) != RNP_SUCCESS)
-            return "Failed to read secring.pgp\n";
+        if (auto res = load_secret_keys(ffi, secring_file); !res) return res;
     }
 
     rnp_ffi_set_pass_provider(ffi, passprovider, context);
 
-    /* create file input and memory output objects for the encrypted message and decrypted
-     * message */
-    if (input.set_input_from_path(encrypted_file) != RNP_SUCCESS) return "Error setting input: " + encrypted_file + "\nDoes it exist?";
+    return decrypt_with(ffi, input, output);
+}
+
+pgp::OpRes pgp::decrypt_to_text(const std::string& encrypted_file, StreamingText& text, rnp_password_cb passprovider, void* context, const std::string& secring_file)
+{
+    rnp::Input input;
+    rnp::Output output;
+
+    auto res = [&]() -> OpRes
+    {
+        if (input.set_input_from_path(encrypted_file) != RNP_SUCCESS) return "Error setting input: " + encrypted_file + "\nDoes it exist?";
+        if (output.set_output_to_callback(StreamingText::writer_callback, nullptr, &text) != RNP_SUCCESS) return "Failed setting output\n";
+
+        /* the plaintext is rarely much larger than the encrypted file */
+        text.reserve(static_cast<size_t>(utils::file_size(encrypted_file)));
 
-    if (output.set_output_to_path(output_fname) != RNP_SUCCESS) return "Error setting output: " + output_fname;
+        return decrypt_stream(input, output, passprovider, context, secring_file);
+    }();
 
+    output.destroy(); /* flush the last of the plaintext before finishing */
+
+    if (text.cancelled()) res = "Cancelled\n";
+
+    text.finish(res);
+    return res;
+}
+
+pgp::OpRes pgp::load_secret_keys(rnp::FFI& ffi, const std::string& secring_file)
+{
+    /* a flat secret keyring is loaded completely, from a GnuPG home only the key that is needed gets loaded.
+        * However, you may need to load public keyring as well to validate key's signatures. */
+    return keystore::load_secret_keys(ffi, secring_file);
+}
+
+pgp::OpRes pgp::decrypt_with(rnp::FFI& ffi, rnp::Input& input, rnp::Output& output)
+{
     /* input: where is the encrypted data
        output: where to save the decrypted data */
-    if (auto res = rnp_decrypt(ffi, input, output); res != RNP_SUCCESS) 
+    metrics::Scope scope("decrypt");
+    trace::Span span("rnp_decrypt");
+
+    if (auto res = metrics::rnp_result(rnp_decrypt(ffi, input, output)); res != RNP_SUCCESS) 
     {
         return "Decryption failed\nWas the password correct?\n";
     }
 
     return true;
 }
+
+bool pgp::looks_like_message(const std::string& file)
+{
+    std::ifstream input(utils::to_path(file), std::ios::binary);
+    char header[64]{};
+
+    input.read(header, sizeof(header));
+    const std::string_view start(header, static_cast<size_t>(input.gcount()));
+
+    if (start.empty()) return false;
+
+    /* armor may follow a byte order mark and blank lines */
+    const auto text = start.find_first_not_of("\xef\xbb\xbf \t\r\n");
+    if (text != std::string_view::npos && start.substr(text).rfind("-----BEGIN PGP MESSAGE-----", 0) == 0) return true;
+
+    const auto first = static_cast<uint8_t>(start[0]);
+    if ((first & 0x80) == 0) return false;
+
+    /* new format headers keep the tag in the low six bits, old format ones in bits 2 to 5 */
+    const auto tag = (first & 0x40) ? first & 0x3f : (first >> 2) & 0x0f;
+
+    /* session keys for a key or a password, or the encrypted data itself */
+    return tag == 1 || tag == 3 || tag == 9 || tag == 18 || tag == 20;
+}
+
+pgp::OpRes pgp::check_integrity(rnp::FFI& ffi, rnp::Input& input, std::string& protection)
+{
+    metrics::Scope scope("check integrity");
+    trace::Span span("rnp_op_verify");
+
+    rnp::Output output;
+    rnp::VerifyOperation op;
+
+    if (output.set_output_to_null() != RNP_SUCCESS) return "Failed setting output\n";
+    if (rnp_op_verify_create(op.put(), ffi, input, output) != RNP_SUCCESS) return "Failed to create verify operation.\n";
+
+    /* a signature by a key we do not have says nothing about whether the data is intact */
+    rnp_op_verify_set_flags(op, RNP_VERIFY_IGNORE_SIGS_ON_DECRYPT);
+
+    const auto executed = metrics::rnp_result(rnp_op_verify_execute(op));
+
+    rnp::Buffer<char> mode, cipher;
+    bool valid{ false };
+    const auto info = rnp_op_verify_get_protection_info(op, &mode.buffer, &cipher.buffer, &valid);
+
+    if (info == RNP_SUCCESS && mode.buffer != nullptr)
+        protection = std::string(mode.buffer) + ' ' + (cipher.buffer != nullptr ? cipher.buffer : "");
+
+    if (executed != RNP_SUCCESS) return "Decryption failed\nWas the password correct?\n";
+    if (info != RNP_SUCCESS || mode.buffer == nullptr) return "Could not determine the protection of the message.\n";
+
+    const std::string protection_mode = mode.buffer;
+    if (protection_mode == "none") return "The message is not encrypted.\n";
+    if (protection_mode == "cfb") return "The message has no integrity protection.\n";
+    if (!valid) return "The integrity check failed, the message was modified or damaged.\n";
+
+    return true;
+}
@@ -25,8 +25,11 @@
 
 #include "pgpsuite_common.h"
 #include "rnp_wrappers.h"
+#include "Metrics.h"
+#include "PGPKeyStore.h"
 #include "IOTools.h"
 #include "Utils.h"
+#include "StreamingText.h"
 
 namespace pgp
 {
@@ -38,6 +41,14 @@ namespace pgp
         char                buf[],
         size_t              buf_len);
 
+    /* Password provider that answers every request with the std::string passed as context, for unattended operations */
+    bool context_pass_provider(rnp_ffi_t           ffi,
+        void* app_ctx,
+        rnp_key_handle_t    key,
+        const char* pgp_context,
+        char                buf[],
+        size_t              buf_len);
+
     /* @brief Decrypt files using secret key 
     @param secring_file: Filename of secret keyring
     @param encrypted_file: Filename with encrypted file
@@ -49,4 +60,33 @@ namespace pgp
         std::string output_fname = "",
         rnp_password_cb passprovider = cin_pass_provider, void* context = nullptr,
         std::string secring_file = {});
+
+    /* @brief Decrypt everything the input produces into the output
+    @param input: source of the encrypted message, has to be set already
+    @param output: destination of the decrypted data, has to be set already
+    @param passprovider: function pointer to a password provider
+    @param secring_file: Filename of secret keyring, none is loaded if left empty */
+    OpRes decrypt_stream(rnp::Input& input, rnp::Output& output, rnp_password_cb passprovider, void* context, const std::string& secring_file);
+
+    /* @brief Load a secret keyring into the ffi so it can be used for many decryptions
+    @param secring_file: flat secret keyring, or a GnuPG home / private-keys-v1.d whose keys are loaded on demand */
+    OpRes load_secret_keys(rnp::FFI& ffi, const std::string& secring_file);
+
+    /* @brief Decrypt using an ffi which already has its keys and password provider set */
+    OpRes decrypt_with(rnp::FFI& ffi, rnp::Input& input, rnp::Output& output);
+
+    /* @brief Decrypt without keeping the plaintext and check the message is intact
+    * Fails if the integrity protection (MDC or AEAD) does not check out, or if the message has none at all.
+    * Signatures are not checked, only whether the data can be decrypted unchanged
+    @param protection: receives the protection mode and cipher, e.g. "cfb-mdc AES256" */
+    OpRes check_integrity(rnp::FFI& ffi, rnp::Input& input, std::string& protection);
+
+    /* @brief Sniff the start of a file for an encrypted OpenPGP message, armored or binary
+    * Only looks at the first packet header, whether the rest of the message is intact is up to check_integrity */
+    bool looks_like_message(const std::string& file);
+
+    /* @brief Decrypt a file into memory, the text can be read while the decryption is still going
+    @param text: receives the plaintext, finished with the result once done. Cancelling it aborts the decryption
+    @param passprovider: function pointer to a password provider, called from the decrypting thread */
+    OpRes decrypt_to_text(const std::string& encrypted_file, StreamingText& text, rnp_password_cb passprovider, void* context, const std::string& secring_file);
 }
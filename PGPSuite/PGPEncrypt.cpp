@@ -1,69 +1,136 @@
 #include "PGPEncrypt.h"
 
-pgp::OpRes pgp::encrypt_text(uint8_t* data, size_t size, std::string pubkey_file, std::string userid, std::string save_to, std::string password)
+pgp::OpRes pgp::encrypt_text(const uint8_t* data, size_t size, std::string pubkey_file, std::string userid, std::string save_to, std::string password, const EncryptOptions& options)
 {
     rnp::Input input_message;
     rnp::Output output_message;
-    rnp_key_handle_t key = nullptr;
-
-    rnp::Input input_key;
-    rnp::FFI ffi("GPG", "GPG");
 
     if (auto res = pgp::utils::validate_strings<std::string>(pubkey_file, userid, save_to); !res) return res;
 
     /* Load the to be encrypted message */
     if (input_message.set_input_from_memory(data, size, false) != RNP_SUCCESS) return "Failed setting input from memory\n";
 
-    /* Prepare the output for the encrypted message */
-    if (output_message.set_output_to_path(std::forward<std::string>(save_to)) != RNP_SUCCESS) return "Failed setting output\n";
+    /* Prepare the output for the encrypted message, it only replaces save_to once complete */
+    utils::FileSink sink;
+    if (auto res = sink.open(save_to, { .expected_size = size / 3 * 4 }); !res) return res;
+    if (output_message.set_output_to_sink(sink) != RNP_SUCCESS) return "Failed setting output\n";
+
+    metrics::Recorder recorder;
+    metrics::add_bytes_in(size);
+
+    auto res = encrypt_stream(input_message, output_message, pubkey_file, userid, password, "message.txt", options);
+
+    output_message.destroy(); /* flush before measuring */
+    if (res) res = sink.commit();
+    metrics::add_bytes_out(sink.size());
+
+    return res.attach(recorder.finish());
+}
+
+pgp::OpRes pgp::encrypt_stream(rnp::Input& input, rnp::Output& output, const std::string& pubkey_file, const std::string& userid, const std::string& password, std::string internal_name, const EncryptOptions& options)
+{
+    rnp::FFI ffi("GPG", "GPG");
+    rnp::KeyHandle key;
 
     if (!pubkey_file.empty())
     {
-        /* Load key file */ /* should in the future allow for adding multiple keys */
-        if (input_key.set_input_from_path(pubkey_file) != RNP_SUCCESS) return "Failed setting input\n";
+        if (auto res = load_recipient(ffi, pubkey_file, userid, key.put()); !res) return res;
+    }
 
-        /* Attempt to read pubring.pgp for its keys */
-        if (rnp_load_keys(ffi, "GPG", input_key, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS)
-        {
-            return "Failed to read: " + pubkey_file;
-        }
+    return encrypt_with(ffi, key, input, output, password, std::move(internal_name), options);
+}
 
-        /* Locate key using the userid and load it into the key_handle_t */
-        if (rnp_locate_key(ffi, "userid", userid.c_str(), &key) != RNP_SUCCESS)
-        {
-            return "Failed to locate recipient key: " + userid;
-        }
+pgp::OpRes pgp::load_recipient(rnp::FFI& ffi, const std::string& pubkey_file, const std::string& userid, rnp_key_handle_t* key)
+{
+    bool found{ false };
+
+    /* A flat keyring only needs the key that is asked for, anything else is loaded whole */
+    if (keystore::detect_format(pubkey_file) == keystore::Format::GPG)
+        if (auto res = keyring::load_matching(ffi, pubkey_file, "userid", userid, RNP_LOAD_SAVE_PUBLIC_KEYS, found); !res) return res;
+
+    /* Load key file, a flat keyring, a keybox or a GnuPG home */ /* should in the future allow for adding multiple keys */
+    if (!found)
+        if (auto res = keystore::load_public_keys(ffi, pubkey_file); !res) return res;
+
+    /* Locate key using the userid and load it into the key_handle_t */
+    metrics::Scope scope("locate key");
+
+    if (metrics::rnp_result(rnp_locate_key(ffi, "userid", userid.c_str(), key)) != RNP_SUCCESS || *key == nullptr)
+    {
+        return "Failed to locate recipient key: " + userid;
     }
 
-    rnp::EncryptOperation op(ffi, input_message, output_message);
+    return true;
+}
 
-    if (!pubkey_file.empty())
+pgp::OpRes pgp::export_recipient(const std::string& pubkey_file, const std::string& userid, std::vector<uint8_t>& key_data)
+{
+    rnp::FFI ffi("GPG", "GPG");
+    rnp::KeyHandle key;
+    rnp::Output output;
+
+    if (!ffi) return "Failed to create ffi.\n";
+
+    if (auto res = load_recipient(ffi, pubkey_file, userid, key.put()); !res) return res;
+
+    if (output.set_output_to_memory() != RNP_SUCCESS) return "Failed setting output to memory.\n";
+    if (rnp_key_export(key, output, RNP_KEY_EXPORT_PUBLIC | RNP_KEY_EXPORT_SUBKEYS) != RNP_SUCCESS)
+        return "Failed to export recipient key: " + userid;
+
+    key_data = output.get_memory_buffer();
+    return true;
+}
+
+pgp::OpRes pgp::load_recipient(rnp::FFI& ffi, const std::vector<uint8_t>& key_data, const std::string& userid, rnp_key_handle_t* key)
+{
+    rnp::Input input;
+
+    if (input.set_input_from_memory(key_data.data(), key_data.size()) != RNP_SUCCESS) return "Failed setting input from memory\n";
+
+    {
+        metrics::Scope scope("load keys");
+        if (metrics::rnp_result(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS)) != RNP_SUCCESS) return "Failed to load recipient key: " + userid;
+    }
+
+    metrics::Scope scope("locate key");
+
+    if (metrics::rnp_result(rnp_locate_key(ffi, "userid", userid.c_str(), key)) != RNP_SUCCESS || *key == nullptr)
+        return "Failed to locate recipient key: " + userid;
+
+    return true;
+}
+
+pgp::OpRes pgp::encrypt_with(rnp::FFI& ffi, rnp_key_handle_t key, rnp::Input& input, rnp::Output& output, const std::string& password, std::string internal_name, const EncryptOptions& options)
+{
+    rnp::EncryptOperation op;
+    if (op.create(ffi, input, output) != RNP_SUCCESS) return "Failed to create encryption operation.\n";
+
+    if (key != nullptr)
     {
         /* Recipient public key, the public keys encrypt the data so
             that the recipient can decrypt it using their secret key
             thats why we say we add the public key of the recipient */
         if (op.add_recipient(key) != RNP_SUCCESS)
         {
-            return "Failed to locate recipient key: " + userid;
+            return "Failed to add recipient key.\n";
         }
     }
 
     /* Set encryption parameters */
-    op.set_armor(true);
-    op.set_file_name("message.txt");
+    op.set_armor(options.armor);
+    op.set_file_name(std::move(internal_name));
     op.set_file_mtime(time(NULL));
-    op.set_compression("ZIP", 6);
-    op.set_cipher(RNP_ALGNAME_AES_256);
-    op.set_aead("None");
+    op.set_compression(std::string(options.compression), options.compression_level);
+    op.set_cipher(std::string(options.cipher));
+    op.set_aead(std::string(options.aead));
 
     /* Setting password */
     if(!password.empty())
         op.set_password(password.c_str(), RNP_ALGNAME_SHA256, 0, RNP_ALGNAME_AES_256);   
 
-    rnp_key_handle_destroy(key);
-    key = nullptr;
+    metrics::Scope scope("encrypt");
 
-    if (op.execute() != RNP_SUCCESS) 
+    if (metrics::rnp_result(op.execute()) != RNP_SUCCESS) 
         return "Failed to encrypt.\n";
 
     return true;
@@ -25,11 +25,26 @@
 
 #include "pgpsuite_common.h"
 #include "rnp_wrappers.h"
+#include "Metrics.h"
+#include "PGPKeyStore.h"
+#include "KeyringScanner.h"
 #include "IOTools.h"
 #include "Utils.h"
 
 namespace pgp
 {
+    /* Parameters of the produced message, the defaults are what PGPSuite always used */
+    struct EncryptOptions
+    {
+        bool armor{ true };
+        std::string cipher{ RNP_ALGNAME_AES_256 };
+        /* ZIP, ZLIB, BZip2 or Uncompressed */
+        std::string compression{ "ZIP" };
+        /* 0 - 9 */
+        int compression_level{ 6 };
+        std::string aead{ "None" };
+    };
+
     /* @brief encrypt bytes from data start till data + size
     @param data: Start of bytes to be encrypted 
     @param size: data + size , is end of bytes to be encrypted
@@ -37,6 +52,37 @@ namespace pgp
     @param userid: the userid of the key
     @param save_to: preferred filename to save encrypted data to 
     @param password: password to encrypt text with, no password if left empty
+    @param options: cipher, compression and armor of the message
+    @return boolean indicating success or failure of encryption */
+    OpRes encrypt_text(const uint8_t* data, size_t size, std::string pubkey_file, std::string userid, std::string save_to = "message.asc", std::string password = {}, const EncryptOptions& options = {});
+
+    /* @brief encrypt everything the input produces into the output as a single OpenPGP message
+    @param input: source of the data to be encrypted, has to be set already
+    @param output: destination of the encrypted message, has to be set already
+    @param pubkey_file: the filename of the recipient's public key, no key is used if left empty
+    @param userid: the userid of the key
+    @param password: password to encrypt data with, no password if left empty
+    @param internal_name: filename stored inside the literal data packet
+    @param options: cipher, compression and armor of the message
+    @return boolean indicating success or failure of encryption */
+    OpRes encrypt_stream(rnp::Input& input, rnp::Output& output, const std::string& pubkey_file, const std::string& userid, const std::string& password = {}, std::string internal_name = "message.txt", const EncryptOptions& options = {});
+
+    /* @brief Load the recipient's public keyring into the ffi and locate their key
+    @param key: receives the located key, pass rnp::KeyHandle::put() so it gets released
+    @return boolean indicating success or failure of loading the key */
+    OpRes load_recipient(rnp::FFI& ffi, const std::string& pubkey_file, const std::string& userid, rnp_key_handle_t* key);
+
+    /* @brief Export the recipient's key from their keyring, so several ffi's can load it without parsing the keyring again
+    @param key_data: receives the key with its subkeys in binary form
+    @return boolean indicating success or failure of exporting the key */
+    OpRes export_recipient(const std::string& pubkey_file, const std::string& userid, std::vector<uint8_t>& key_data);
+
+    /* @brief Load a key exported by export_recipient into the ffi and locate it
+    @param key: receives the located key, pass rnp::KeyHandle::put() so it gets released */
+    OpRes load_recipient(rnp::FFI& ffi, const std::vector<uint8_t>& key_data, const std::string& userid, rnp_key_handle_t* key);
+
+    /* @brief encrypt using an ffi which already holds the recipient's key, allows reusing one ffi for many messages
+    @param key: recipient key, can be nullptr if only a password is used
     @return boolean indicating success or failure of encryption */
-    OpRes encrypt_text(uint8_t* data, size_t size, std::string pubkey_file, std::string userid, std::string save_to = "message.asc", std::string password = {});
+    OpRes encrypt_with(rnp::FFI& ffi, rnp_key_handle_t key, rnp::Input& input, rnp::Output& output, const std::string& password = {}, std::string internal_name = "message.txt", const EncryptOptions& options = {});
 }
@@ -31,41 +31,62 @@ bool pgp::generic_cin_pass_provider(rnp_ffi_t ffi, void* app_ctx, rnp_key_handle
     return input.size() > 0;
 }
 
-pgp::OpRes pgp::generate_keys(std::string pubkey_file, std::string secret_file, std::string_view key_settings, rnp_password_cb passprovider)
+namespace
 {
-    rnp::FFI ffi("GPG", "GPG");
-    rnp::Output output; /* where to save the keys */
-    rnp::Buffer<char> key_grips; /* JSON result buffer */
+    pgp::OpRes generate_and_save(const std::string& pubkey_file, const std::string& secret_file, std::string_view key_settings, rnp_password_cb passprovider)
+    {
+        rnp::FFI ffi("GPG", "GPG");
+        rnp::Output output; /* where to save the keys */
+        rnp::Buffer<char> key_grips; /* JSON result buffer */
 
-    if (auto res = pgp::utils::validate_strings<std::string>(pubkey_file, secret_file); !res) return res;
+        /* Have to make proper pass provider for here */
+        rnp_ffi_set_pass_provider(ffi, passprovider, nullptr);
 
-    /* Have to make proper pass provider for here */
-    rnp_ffi_set_pass_provider(ffi, passprovider, nullptr);
+        {
+            pgp::metrics::Scope scope("generate");
 
-    /* Check this first to be able to provide the user with a more clear error message */
-    if (!pgp::utils::all_ascii(key_settings)) return "Non-ascii characters in JSON data.\n";
+            if (auto err = pgp::metrics::rnp_result(rnp_generate_key_json(ffi, key_settings.data(), &key_grips.buffer));
+                err != RNP_SUCCESS)
+            {
+                return "Failed to generate key from json.\n";
+            }
+        }
 
-    if (auto err = rnp_generate_key_json(ffi, key_settings.data(), &key_grips.buffer);
-        err != RNP_SUCCESS)
-    {
-        return "Failed to generate key from json.\n";
-    }
+        key_grips.destroy();
 
-    key_grips.destroy();
+        pgp::metrics::Scope scope("save keys");
 
-    if (output.set_output_to_path(std::forward<std::string>(pubkey_file)) != RNP_SUCCESS) return "Failed to set output.";
+        if (output.set_output_to_path(pubkey_file) != RNP_SUCCESS) return "Failed to set output.";
 
-    if (rnp_save_keys(ffi, "GPG", output, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS)
-    {
-        return "Failed to save keys\n";
-    }
+        if (pgp::metrics::rnp_result(rnp_save_keys(ffi, "GPG", output, RNP_LOAD_SAVE_PUBLIC_KEYS)) != RNP_SUCCESS)
+        {
+            return "Failed to save keys\n";
+        }
 
-    if (output.set_output_to_path(std::forward<std::string>(secret_file)) != RNP_SUCCESS) return "Failed to set output.";
+        if (output.set_output_to_path(secret_file) != RNP_SUCCESS) return "Failed to set output.";
 
-    if (rnp_save_keys(ffi, "GPG", output, RNP_LOAD_SAVE_SECRET_KEYS) != RNP_SUCCESS)
-    {
-        return "Failed to save keys\n";
+        if (pgp::metrics::rnp_result(rnp_save_keys(ffi, "GPG", output, RNP_LOAD_SAVE_SECRET_KEYS)) != RNP_SUCCESS)
+        {
+            return "Failed to save keys\n";
+        }
+
+        return true;
     }
+}
+
+pgp::OpRes pgp::generate_keys(std::string pubkey_file, std::string secret_file, std::string_view key_settings, rnp_password_cb passprovider)
+{
+    if (auto res = pgp::utils::validate_strings<std::string>(pubkey_file, secret_file); !res) return res;
+
+    /* Check this first to be able to provide the user with a more clear error message */
+    if (!pgp::utils::all_ascii(key_settings)) return "Non-ascii characters in JSON data.\n";
+
+    metrics::Recorder recorder;
+    metrics::add_bytes_in(key_settings.size());
+
+    auto res = generate_and_save(pubkey_file, secret_file, key_settings, passprovider);
+
+    metrics::add_bytes_out(utils::file_size(pubkey_file) + utils::file_size(secret_file));
 
-    return true;
+    return res.attach(recorder.finish());
 }
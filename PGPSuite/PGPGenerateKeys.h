@@ -27,6 +27,7 @@
 #include "IOTools.h"
 #include <rnp\rnp.h>
 #include "rnp_wrappers.h"
+#include "Metrics.h"
 #include "Utils.h"
 
 namespace pgp
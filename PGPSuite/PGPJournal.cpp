@@ -0,0 +1,125 @@
+#include "PGPJournal.h"
+#include "FileSink.h"
+#include "Utils.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr const char* journal_header{ "# pgpsuite journal 1" };
+}
+
+pgp::OpRes pgp::journal::Journal::open(const std::string& path, bool resume)
+{
+    std::error_code ec;
+    const auto file = utils::to_path(path);
+
+    close();
+    _path = path;
+    _done.clear();
+
+    if (file.has_parent_path()) fs::create_directories(file.parent_path(), ec);
+
+    if (resume && fs::exists(file, ec))
+    {
+        std::ifstream input(file, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+        if (contents.rfind(journal_header, 0) != 0) return "Not a journal: " + path;
+
+        /* only complete lines count, a crash while appending leaves the last one unfinished */
+        size_t start = contents.find('\n') + 1;
+        for (size_t end = contents.find('\n', start); end != std::string::npos; start = end + 1, end = contents.find('\n', start))
+        {
+            const auto line = contents.substr(start, end - start);
+            const auto tab = line.find('\t');
+            if (tab == std::string::npos) continue;
+
+            _done.emplace(line.substr(0, tab), line.substr(tab + 1));
+        }
+
+        /* rewrite without the unfinished line, appending behind it would corrupt the next record
+        * the complete lines go to a temporary file that replaces the journal once it is on disk, a crash keeps either version */
+        if (start < contents.size())
+        {
+            utils::FileSink rewrite;
+
+            if (auto res = rewrite.open(path, path + ".tmp"); !res) return res;
+            if (!rewrite.write(contents.data(), start)) return "Failed writing journal: " + path;
+            if (auto res = rewrite.commit(); !res) return res;
+        }
+
+        _file = CreateFileW(file.wstring().c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE) return "Could not open journal: " + path;
+    }
+    else
+    {
+        _file = CreateFileW(file.wstring().c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE) return "Could not open journal: " + path;
+
+        if (!append(std::string(journal_header) + '\n')) return "Failed writing journal: " + path;
+    }
+
+    return true;
+}
+
+bool pgp::journal::Journal::append(const std::string& data)
+{
+    DWORD written{ 0 };
+
+    /* the output of a job is already on disk when it is recorded, the record has to be as well */
+    return WriteFile(_file, data.data(), static_cast<DWORD>(data.size()), &written, nullptr) && written == data.size() && FlushFileBuffers(_file);
+}
+
+void pgp::journal::Journal::close()
+{
+    if (_file == INVALID_HANDLE_VALUE) return;
+
+    CloseHandle(_file);
+    _file = INVALID_HANDLE_VALUE;
+}
+
+bool pgp::journal::Journal::done(const batch::Job& job) const
+{
+    std::error_code ec;
+    return _done.count({ job.source, job.destination }) > 0 && fs::exists(utils::to_path(job.destination), ec);
+}
+
+std::vector<pgp::batch::Job> pgp::journal::Journal::remaining(const std::vector<batch::Job>& jobs, size_t& skipped) const
+{
+    std::vector<batch::Job> left;
+    skipped = 0;
+
+    for (const auto& job : jobs)
+    {
+        if (done(job))
+        {
+            skipped++;
+            continue;
+        }
+
+        /* whatever the interrupted run was writing is started over */
+        std::error_code ec;
+        fs::remove(utils::to_path(batch::partial_name(job.destination)), ec);
+
+        left.push_back(job);
+    }
+
+    return left;
+}
+
+pgp::OpRes pgp::journal::Journal::record(const batch::JobResult& result)
+{
+    if (!result.result) return true;
+
+    /* one write per line, so a crash can only ever cut off the line being written */
+    const auto line = result.source + '\t' + result.destination + '\n';
+
+    if (_file == INVALID_HANDLE_VALUE || !append(line)) return "Failed writing journal: " + _path;
+
+    _done.emplace(result.source, result.destination);
+    return true;
+}
@@ -0,0 +1,75 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+
+#include "pgpsuite_common.h"
+#include "PGPBatch.h"
+
+/* Journal of a long running batch, so an interrupted run can pick up where it stopped
+* Every finished job is appended as a single line and flushed to disk right away. A line that was cut short
+* by a crash is ignored when reading, so the journal never claims more than was done.
+* Outputs only get their real name once complete, the batch writes them with batch::partial_suffix first */
+namespace pgp::journal
+{
+    class Journal
+    {
+    protected:
+        HANDLE _file{ INVALID_HANDLE_VALUE };
+        std::string _path;
+        /* source and destination of every job that finished */
+        std::set<std::pair<std::string, std::string>> _done;
+
+        /* @brief Append data and wait until it is on disk */
+        bool append(const std::string& data);
+        void close();
+    public:
+        Journal() = default;
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+        ~Journal() { close(); }
+
+        /* @brief Open the journal for a run
+        @param resume: keep what an earlier run recorded, otherwise the journal starts empty */
+        OpRes open(const std::string& path, bool resume);
+
+        /* @return True if the job finished in an earlier run and its output is still there */
+        bool done(const batch::Job& job) const;
+
+        /* @brief Leave out finished jobs and remove what unfinished ones left behind
+        @param skipped: receives the amount of jobs left out */
+        std::vector<batch::Job> remaining(const std::vector<batch::Job>& jobs, size_t& skipped) const;
+
+        /* @brief Append a finished job, failed jobs are not recorded so they run again */
+        OpRes record(const batch::JobResult& result);
+
+        size_t size() const { return _done.size(); }
+    };
+}
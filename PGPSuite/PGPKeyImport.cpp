@@ -0,0 +1,153 @@
+#include "PGPKeyImport.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr uint32_t import_flags{ RNP_LOAD_SAVE_PUBLIC_KEYS | RNP_LOAD_SAVE_PERMISSIVE };
+
+    /* @brief Import a key file, armored files may hold several keys */
+    pgp::OpRes import_file(rnp::FFI& ffi, const std::string& path)
+    {
+        std::error_code ec;
+        if (!fs::is_regular_file(pgp::utils::to_path(path), ec)) return "Could not open: " + path;
+
+        rnp::Input input;
+        if (input.set_input_from_path(path) != RNP_SUCCESS) return "Could not open: " + path;
+
+        rnp::Buffer<char> results;
+        if (pgp::metrics::rnp_result(rnp_import_keys(ffi, input, import_flags, &results.buffer)) != RNP_SUCCESS)
+            return "No public keys found in: " + path;
+
+        return true;
+    }
+
+    /* @brief Add every key of one ffi to another, keys both have in common are merged */
+    pgp::OpRes merge_into(rnp::FFI& destination, rnp::FFI& source)
+    {
+        rnp::Output output;
+        if (output.set_output_to_memory() != RNP_SUCCESS) return "Failed setting output to memory.\n";
+
+        if (rnp_save_keys(source, "GPG", output, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS) return "Failed to export imported keys.\n";
+
+        const auto keys = output.get_memory_buffer();
+        if (keys.empty()) return true;
+
+        rnp::Input input;
+        if (input.set_input_from_memory(keys.data(), keys.size()) != RNP_SUCCESS) return "Failed setting input from memory\n";
+
+        rnp::Buffer<char> results;
+        if (rnp_import_keys(destination, input, import_flags, &results.buffer) != RNP_SUCCESS) return "Failed to merge imported keys.\n";
+
+        return true;
+    }
+
+    size_t key_count(rnp::FFI& ffi)
+    {
+        size_t count{ 0 };
+        rnp_get_public_key_count(ffi, &count);
+        return count;
+    }
+}
+
+pgp::OpRes pgp::import_keys(const std::vector<std::string>& files, const std::string& keyring, ImportSummary& summary, size_t workers, ImportProgress progress)
+{
+    rnp::FFI merged("GPG", "GPG");
+    std::error_code ec;
+
+    if (!merged) return "Failed to create ffi.\n";
+
+    summary = {};
+    summary.files = files.size();
+
+    if (fs::exists(utils::to_path(keyring), ec))
+    {
+        rnp::Input input;
+        if (input.set_input_from_path(keyring) != RNP_SUCCESS) return "Failed setting input for: " + keyring;
+
+        metrics::Scope scope("load keys");
+        trace::Span span("rnp_load_keys", keyring);
+
+        if (metrics::rnp_result(rnp_load_keys(merged, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS)) != RNP_SUCCESS) return "Failed to read: " + keyring;
+
+        summary.keys_before = key_count(merged);
+    }
+
+    /* no point in threads that would not get a file */
+    const size_t thread_count = std::min<size_t>(files.size(), workers > 0 ? workers : std::max<size_t>(1, std::thread::hardware_concurrency()));
+
+    std::vector<std::unique_ptr<rnp::FFI>> ffis;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next_file{ 0 }, failed{ 0 };
+    std::mutex progress_mutex;
+
+    for (size_t i = 0; i < thread_count; i++)
+        ffis.push_back(std::make_unique<rnp::FFI>("GPG", "GPG"));
+
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        threads.emplace_back([&, i]
+            {
+                trace::name_thread("import worker " + std::to_string(i));
+                auto& ffi = *ffis[i];
+
+                for (size_t file = next_file++; file < files.size(); file = next_file++)
+                {
+                    trace::Span span("import", files[file]);
+                    ImportResult result{ files[file], ffi ? import_file(ffi, files[file]) : OpRes("Failed to create ffi.\n") };
+
+                    if (!result.result) failed++;
+
+                    if (progress)
+                    {
+                        std::lock_guard lock(progress_mutex);
+                        progress(result);
+                    }
+                }
+            });
+    }
+
+    for (auto& thread : threads) thread.join();
+
+    summary.failed = failed;
+
+    {
+        metrics::Scope scope("merge keys");
+        trace::Span span("merge keys");
+
+        for (auto& ffi : ffis)
+        {
+            if (!*ffi) continue;
+            if (auto res = merge_into(merged, *ffi); !res) return res;
+            ffi->destroy(); /* free the memory as soon as the keys are merged */
+        }
+    }
+
+    summary.keys_after = key_count(merged);
+
+    /* write next to the keyring first, so a failure does not leave a truncated keyring behind */
+    metrics::Scope scope("save keys");
+    trace::Span span("rnp_save_keys", keyring);
+
+    const auto temporary = keyring + ".tmp";
+    {
+        rnp::Output output;
+        if (output.set_output_to_path(temporary) != RNP_SUCCESS) return "Failed setting output to: " + temporary;
+
+        if (rnp_save_keys(merged, "GPG", output, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS) return "Failed to save keys to: " + temporary;
+    }
+
+    fs::rename(utils::to_path(temporary), utils::to_path(keyring), ec);
+    if (ec) return "Failed to replace: " + keyring;
+
+    return true;
+}
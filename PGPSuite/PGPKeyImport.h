@@ -0,0 +1,65 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+
+/* Bulk import of public keys from many files into a single keyring
+* Files are parsed concurrently, every thread importing into its own ffi,
+* after which the per thread keyrings are merged into the destination and saved once.
+* Importing the same key twice merges it, new userids, subkeys and signatures are added to the existing key */
+namespace pgp
+{
+    /* Outcome of importing a single key file */
+    struct ImportResult
+    {
+        std::string path;
+        OpRes result;
+    };
+
+    /* Totals of an import */
+    struct ImportSummary
+    {
+        size_t files{ 0 };
+        size_t failed{ 0 };
+        /* keys and subkeys in the keyring before and after the import */
+        size_t keys_before{ 0 };
+        size_t keys_after{ 0 };
+    };
+
+    /* Called from the import threads every time a file was parsed */
+    using ImportProgress = std::function<void(const ImportResult&)>;
+
+    /* @brief Import all key files into a keyring, armored and binary files alike
+    @param files: key files, files that fail to import are reported but do not stop the import
+    @param keyring: the keyring to merge into, it is created if it does not exist
+    @param workers: amount of parsing threads, 0 uses one per core
+    @return An error if the keyring could not be loaded or saved */
+    OpRes import_keys(const std::vector<std::string>& files, const std::string& keyring, ImportSummary& summary, size_t workers = 0, ImportProgress progress = {});
+}
@@ -0,0 +1,278 @@
+#include "PGPKeyPool.h"
+#include "PGPDecrypt.h"
+
+#include <random>
+#include <thread>
+
+namespace
+{
+    /* Password the pooled secret keys are protected with until checked out, never shown to anyone */
+    std::string random_password()
+    {
+        static const char hex[] = "0123456789abcdef";
+        std::random_device rd;
+        std::string password(32, '0');
+
+        for (auto& c : password) c = hex[rd() & 0x0f];
+
+        return password;
+    }
+
+    /* @brief Find the primary key among the keys in the ffi */
+    pgp::OpRes locate_primary(rnp::FFI& ffi, rnp::KeyHandle& primary)
+    {
+        rnp::IdentifierIterator it;
+        const char* keyid{};
+        primary.reset();
+
+        if (rnp_identifier_iterator_create(ffi, it.put(), "keyid") != RNP_SUCCESS) return "Failed to iterate generated keys.\n";
+
+        while (primary == nullptr && rnp_identifier_iterator_next(it, &keyid) == RNP_SUCCESS && keyid != nullptr)
+        {
+            rnp::KeyHandle key;
+            bool is_primary{ false };
+
+            if (rnp_locate_key(ffi, "keyid", keyid, key.put()) != RNP_SUCCESS || key == nullptr) continue;
+
+            if (rnp_key_is_primary(key, &is_primary) == RNP_SUCCESS && is_primary)
+                primary = std::move(key);
+        }
+
+        if (primary == nullptr) return "Generated keys contain no primary key.\n";
+        return true;
+    }
+
+    /* @brief Swap the protection of a secret key from the pool password to the user password */
+    pgp::OpRes reprotect(rnp_key_handle_t key, const std::string& old_password, const std::string& new_password)
+    {
+        bool is_protected{ false };
+
+        if (rnp_key_is_protected(key, &is_protected) != RNP_SUCCESS) return "Failed to query key protection.\n";
+
+        if (is_protected && rnp_key_unprotect(key, old_password.c_str()) != RNP_SUCCESS) return "Failed to unprotect pooled key.\n";
+
+        if (!new_password.empty() && rnp_key_protect(key, new_password.c_str(), "AES256", nullptr, "SHA256", 0) != RNP_SUCCESS)
+            return "Failed to protect key with password.\n";
+
+        return true;
+    }
+
+    /* @brief Replace the placeholder userid the key was generated with */
+    pgp::OpRes assign_userid(rnp_key_handle_t primary, const std::string& userid)
+    {
+        rnp::Buffer<char> placeholder;
+        uint32_t expiration{};
+
+        if (rnp_key_get_uid_at(primary, 0, &placeholder.buffer) != RNP_SUCCESS) return "Failed to read userid of pooled key.\n";
+        if (userid == placeholder.buffer) return true;
+
+        /* the key expiration is stored in the userid certification, so carry it over to the new one */
+        if (rnp_key_get_expiration(primary, &expiration) != RNP_SUCCESS) return "Failed to read key expiration.\n";
+
+        if (rnp_key_add_uid(primary, userid.c_str(), "SHA256", expiration, 0x03, true) != RNP_SUCCESS)
+            return "Failed to add userid to key.\n";
+
+        rnp_uid_handle_t uid{};
+        if (rnp_key_get_uid_handle_at(primary, 0, &uid) != RNP_SUCCESS) return "Failed to locate placeholder userid.\n";
+
+        const auto removed = rnp_uid_remove(primary, uid);
+        rnp_uid_handle_destroy(uid);
+
+        if (removed != RNP_SUCCESS) return "Failed to remove placeholder userid.\n";
+        return true;
+    }
+}
+
+pgp::KeyPool::KeyPool(std::string profile, size_t depth)
+    : _state(std::make_shared<State>())
+{
+    _state->profile = std::move(profile);
+    _state->depth = depth;
+}
+
+pgp::KeyPool::~KeyPool()
+{
+    {
+        std::lock_guard lock(_state->mutex);
+        _state->stop = true;
+        _state->keys.clear();
+    }
+    _state->changed.notify_all();
+}
+
+void pgp::KeyPool::start()
+{
+    if (_state->started || _state->depth == 0) return;
+
+    _state->started = true;
+    std::thread(&KeyPool::generator_loop, _state).detach();
+}
+
+void pgp::KeyPool::set_profile(std::string profile)
+{
+    {
+        std::lock_guard lock(_state->mutex);
+        if (profile == _state->profile) return;
+
+        _state->profile = std::move(profile);
+        _state->profile_version++;
+        _state->keys.clear();
+        _state->last_error.clear();
+    }
+    _state->changed.notify_all();
+}
+
+size_t pgp::KeyPool::available()
+{
+    std::lock_guard lock(_state->mutex);
+    return _state->keys.size();
+}
+
+void pgp::KeyPool::generator_loop(std::shared_ptr<State> state)
+{
+    trace::name_thread("key pool");
+    std::unique_lock lock(state->mutex);
+
+    while (!state->stop)
+    {
+        /* sleep while the pool is full, or until a checkout has reported the last failure */
+        if (state->keys.size() >= state->depth || !state->last_error.empty())
+        {
+            state->changed.wait(lock);
+            continue;
+        }
+
+        const auto profile = state->profile;
+        const auto version = state->profile_version;
+
+        lock.unlock();
+        PooledKey key;
+        auto res = generate(profile, key);
+        lock.lock();
+
+        /* generated with a stale profile, or nobody wants it anymore */
+        if (state->stop || version != state->profile_version) continue;
+
+        if (res)
+            state->keys.push_back(std::move(key));
+        else
+            state->last_error = res.what();
+
+        state->changed.notify_all();
+    }
+}
+
+pgp::OpRes pgp::KeyPool::generate(const std::string& profile, PooledKey& key)
+{
+    trace::Span span("generate key");
+    rnp::Buffer<char> key_grips; /* JSON result buffer */
+
+    if (!pgp::utils::all_ascii(profile)) return "Non-ascii characters in JSON data.\n";
+
+    key.ffi = std::make_unique<rnp::FFI>("GPG", "GPG");
+    key.password = random_password();
+
+    if (!*key.ffi) return "Failed to create ffi.\n";
+
+    rnp_ffi_set_pass_provider(*key.ffi, context_pass_provider, &key.password);
+
+    const auto err = rnp_generate_key_json(*key.ffi, profile.c_str(), &key_grips.buffer);
+
+    /* the key may be moved around after this, so the provider must not keep pointing into it */
+    rnp_ffi_set_pass_provider(*key.ffi, nullptr, nullptr);
+
+    if (err != RNP_SUCCESS) return "Failed to generate key from json.\n";
+    return true;
+}
+
+pgp::OpRes pgp::KeyPool::finalize(PooledKey& key, const std::string& userid, const std::string& password, const std::string& pubkey_file, const std::string& secret_file)
+{
+    rnp::KeyHandle primary;
+    rnp::Output output;
+
+    if (auto res = locate_primary(*key.ffi, primary); !res) return res;
+
+    /* unprotect everything first, adding a userid requires the secret primary key */
+    if (auto res = reprotect(primary, key.password, {}); !res) return res;
+    if (auto res = assign_userid(primary, userid); !res) return res;
+
+    size_t subkeys{};
+    if (rnp_key_get_subkey_count(primary, &subkeys) != RNP_SUCCESS) return "Failed to query subkeys.\n";
+
+    for (size_t i = 0; i < subkeys; i++)
+    {
+        rnp::KeyHandle sub;
+        if (rnp_key_get_subkey_at(primary, i, sub.put()) != RNP_SUCCESS) return "Failed to get subkey.\n";
+
+        if (auto res = reprotect(sub, key.password, password); !res) return res;
+    }
+
+    if (!password.empty())
+        if (auto res = reprotect(primary, {}, password); !res) return res;
+
+    primary.reset();
+
+    if (output.set_output_to_path(pubkey_file) != RNP_SUCCESS) return "Failed to set output.";
+
+    if (rnp_save_keys(*key.ffi, "GPG", output, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS) return "Failed to save keys\n";
+
+    if (output.set_output_to_path(secret_file) != RNP_SUCCESS) return "Failed to set output.";
+
+    if (rnp_save_keys(*key.ffi, "GPG", output, RNP_LOAD_SAVE_SECRET_KEYS) != RNP_SUCCESS) return "Failed to save keys\n";
+
+    return true;
+}
+
+pgp::OpRes pgp::KeyPool::checkout(const std::string& userid, const std::string& password, std::string pubkey_file, std::string secret_file)
+{
+    if (auto res = pgp::utils::validate_strings<std::string>(pubkey_file, secret_file); !res) return res;
+    if (userid.empty()) return "No userid given.\n";
+
+    metrics::Recorder recorder;
+    PooledKey key;
+
+    std::unique_lock lock(_state->mutex);
+
+    if (_state->depth == 0)
+    {
+        const auto profile = _state->profile;
+        lock.unlock();
+
+        metrics::Scope scope("generate");
+        if (auto res = generate(profile, key); !res) return res.attach(recorder.finish());
+    }
+    else
+    {
+        metrics::Scope scope("wait for pool");
+
+        start();
+        _state->changed.wait(lock, [this] { return !_state->keys.empty() || !_state->last_error.empty(); });
+
+        if (_state->keys.empty())
+        {
+            /* reported once, the generator tries again for the next checkout */
+            OpRes res(std::move(_state->last_error));
+            _state->last_error.clear();
+            lock.unlock();
+            _state->changed.notify_all();
+
+            return res.attach(recorder.finish());
+        }
+
+        key = std::move(_state->keys.front());
+        _state->keys.pop_front();
+
+        lock.unlock();
+        _state->changed.notify_all(); /* wake the generator to refill */
+    }
+
+    OpRes res;
+    {
+        metrics::Scope scope("finalize");
+        res = finalize(key, userid, password, pubkey_file, secret_file);
+    }
+
+    metrics::add_bytes_out(utils::file_size(pubkey_file) + utils::file_size(secret_file));
+
+    return res.attach(recorder.finish());
+}
@@ -0,0 +1,100 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+#include "Metrics.h"
+
+namespace pgp
+{
+    /* Generates keypairs in the background so they can be handed out instantly
+    * Keys are generated from a json profile (see pgp::key_profiles) under a placeholder userid and an internal password,
+    * the real userid and password are only assigned once a key is checked out */
+    class KeyPool
+    {
+    protected:
+        /* A generated keypair, every key lives in its own ffi so it can be saved on its own */
+        struct PooledKey
+        {
+            std::unique_ptr<rnp::FFI> ffi;
+            std::string password; /* internal password the secret keys are protected with while pooled */
+        };
+
+        /* Everything the generator works on, shared so the generator can outlive the pool
+        * A generation in progress can not be interrupted, a destroyed pool just lets it finish and throws the key away */
+        struct State
+        {
+            std::deque<PooledKey> keys;
+            std::string profile;
+            size_t depth{ 0 };
+            /* bumped when the profile changes so keys of an older profile are thrown away */
+            size_t profile_version{ 0 };
+            /* set by a failed generation, cleared once a checkout reported it so the next one tries again */
+            std::string last_error;
+            bool started{ false };
+            bool stop{ false };
+
+            std::mutex mutex;
+            std::condition_variable changed;
+        };
+
+        std::shared_ptr<State> _state;
+
+        /* @brief Start the generator if the pool is enabled and it is not running yet, expects the mutex to be held */
+        void start();
+        static void generator_loop(std::shared_ptr<State> state);
+    public:
+        /* @param profile: key settings in json format, as passed to rnp_generate_key_json
+        @param depth: amount of keypairs to keep ready, 0 disables background generation
+        * Nothing is generated until the first checkout, so creating a pool is free */
+        KeyPool(std::string profile, size_t depth);
+        KeyPool(const KeyPool&) = delete;
+        ~KeyPool();
+
+        /* @brief Replace the profile, keys generated with the old profile are discarded */
+        void set_profile(std::string profile);
+
+        /* @return Amount of keypairs ready to be checked out */
+        size_t available();
+
+        /* @brief Take a generated keypair, give it the userid and password and save it as a keyring pair
+        * Blocks until a keypair is available, generates on the calling thread if the pool is disabled, so keep it off the ui thread
+        @param userid: userid to assign to the primary key
+        @param password: password to protect the secret keys with, unprotected if empty */
+        OpRes checkout(const std::string& userid, const std::string& password, std::string pubkey_file = "pubring.pgp", std::string secret_file = "secring.pgp");
+
+        /* @brief Generate a single keypair for the pool from a profile, can run on any thread */
+        static OpRes generate(const std::string& profile, PooledKey& key);
+
+        /* @brief Assign userid and password to a pooled keypair and save it */
+        static OpRes finalize(PooledKey& key, const std::string& userid, const std::string& password, const std::string& pubkey_file, const std::string& secret_file);
+    };
+}
@@ -0,0 +1,161 @@
+#include "PGPKeyProfiles.h"
+#include "PGPEncrypt.h"
+#include "PGPDecrypt.h"
+#include "BufferPool.h"
+
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+namespace
+{
+    /* userid every profile generates its key with, it gets replaced when the key is handed out */
+    constexpr const char* placeholder_userid = "user@id";
+
+    /* @brief Build a profile in rnp's json format
+    @param primary: algorithm fields of the signing primary key
+    @param sub: algorithm fields of the encryption subkey */
+    std::string make_profile_json(const std::string& primary, const std::string& sub)
+    {
+        return R"({
+    'primary': {
+        )" + primary + R"(,
+        'userid': ')" + placeholder_userid + R"(',
+        'expiration': 31536000,
+        'usage': ['sign'],
+        'protection': {
+            'cipher': 'AES256',
+            'hash': 'SHA256'
+        }
+    },
+    'sub': {
+        )" + sub + R"(,
+        'expiration': 15768000,
+        'usage': ['encrypt'],
+        'protection': {
+            'cipher': 'AES256',
+            'hash': 'SHA256'
+        }
+    }
+}
+)";
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+}
+
+std::string pgp::ProfileCost::serialize() const
+{
+    std::ostringstream out;
+    out << keygen << ';' << encrypt << ';' << decrypt;
+    return out.str();
+}
+
+bool pgp::ProfileCost::deserialize(const std::string& str)
+{
+    std::istringstream in(str);
+    char sep1{}, sep2{};
+    ProfileCost cost;
+
+    if (!(in >> cost.keygen >> sep1 >> cost.encrypt >> sep2 >> cost.decrypt) || sep1 != ';' || sep2 != ';') return false;
+
+    *this = cost;
+    return true;
+}
+
+std::string pgp::ProfileCost::describe() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(0)
+        << "keygen " << keygen << " ms, "
+        << std::setprecision(1)
+        << "encrypt " << encrypt << " ms, decrypt " << decrypt << " ms";
+    return out.str();
+}
+
+const std::vector<pgp::KeyProfile>& pgp::key_profiles()
+{
+    static const std::vector<KeyProfile> profiles
+    {
+        { "ed25519", "Ed25519 + Curve25519", make_profile_json("'type': 'EDDSA'", "'type': 'ECDH', 'curve': 'Curve25519'") },
+        { "p256", "NIST P-256", make_profile_json("'type': 'ECDSA', 'curve': 'NIST P-256'", "'type': 'ECDH', 'curve': 'NIST P-256'") },
+        { "rsa3072", "RSA 3072", make_profile_json("'type': 'RSA', 'length': 3072", "'type': 'RSA', 'length': 3072") },
+        { "rsa4096", "RSA 4096", make_profile_json("'type': 'RSA', 'length': 4096", "'type': 'RSA', 'length': 4096") },
+    };
+
+    return profiles;
+}
+
+const pgp::KeyProfile& pgp::default_key_profile()
+{
+    return key_profiles().front();
+}
+
+const pgp::KeyProfile& pgp::find_key_profile(const std::string& id)
+{
+    for (const auto& profile : key_profiles())
+        if (profile.id == id) return profile;
+
+    return default_key_profile();
+}
+
+pgp::OpRes pgp::benchmark_profile(const KeyProfile& profile, ProfileCost& cost, size_t rounds)
+{
+    rnp::FFI ffi("GPG", "GPG");
+    rnp::Buffer<char> key_grips;
+    rnp::KeyHandle key;
+    std::string password = "benchmark";
+
+    if (!ffi) return "Failed to create ffi.\n";
+    if (rounds == 0) rounds = 1;
+
+    rnp_ffi_set_pass_provider(ffi, context_pass_provider, &password);
+
+    auto start = Clock::now();
+    if (rnp_generate_key_json(ffi, profile.json.c_str(), &key_grips.buffer) != RNP_SUCCESS) return "Failed to generate key from json.\n";
+    cost.keygen = elapsed_ms(start);
+
+    if (rnp_locate_key(ffi, "userid", placeholder_userid, key.put()) != RNP_SUCCESS || key == nullptr) return "Failed to locate generated key.\n";
+
+    /* a typical short message, large enough that the symmetric part is not free */
+    const std::string message(4096, 'x');
+    double encrypt_total{ 0 }, decrypt_total{ 0 };
+    OpRes res;
+
+    for (size_t i = 0; i < rounds && res; i++)
+    {
+        rnp::Input input;
+        rnp::Output output;
+        utils::PooledBuffer encrypted, decrypted;
+
+        input.set_input_from_memory(reinterpret_cast<const uint8_t*>(message.data()), message.size());
+        output.set_output_to_buffer(encrypted);
+
+        start = Clock::now();
+        if (res = encrypt_with(ffi, key, input, output); !res) break;
+        output.destroy(); /* flush the armored tail */
+        encrypt_total += elapsed_ms(start);
+
+        input.set_input_from_memory(encrypted.data(), encrypted.size());
+        output.set_output_to_buffer(decrypted);
+
+        start = Clock::now();
+        if (res = decrypt_with(ffi, input, output); !res) break;
+        output.destroy();
+        decrypt_total += elapsed_ms(start);
+
+        if (decrypted.size() != message.size()) res = "Decrypted message does not match.\n";
+    }
+
+    if (!res) return res;
+
+    cost.encrypt = encrypt_total / rounds;
+    cost.decrypt = decrypt_total / rounds;
+
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+
+namespace pgp
+{
+    /* A preset for key generation, json is in the format rnp_generate_key_json expects */
+    struct KeyProfile
+    {
+        std::string id;    /* stable name, used to remember the choice */
+        std::string label; /* name shown to the user */
+        std::string json;
+    };
+
+    /* Measured cost of a profile on this machine, all times in milliseconds */
+    struct ProfileCost
+    {
+        double keygen{ 0 };
+        double encrypt{ 0 };
+        double decrypt{ 0 };
+
+        /* @brief Format as "keygen;encrypt;decrypt" to store it */
+        std::string serialize() const;
+        /* @return False if the string is not in the format of serialize */
+        bool deserialize(const std::string& str);
+        /* @brief Short human readable summary */
+        std::string describe() const;
+    };
+
+    /* @return All built in profiles, ordered from fastest to slowest */
+    const std::vector<KeyProfile>& key_profiles();
+
+    /* @return The profile to use when nothing was chosen, the fastest one that is still considered secure */
+    const KeyProfile& default_key_profile();
+
+    /* @return Profile with the given id, default_key_profile if there is none */
+    const KeyProfile& find_key_profile(const std::string& id);
+
+    /* @brief Measure how long a profile takes to generate a key, and to encrypt and decrypt a small message with it
+    * Keys are generated in a throwaway ffi, nothing is written to disk
+    @param rounds: amount of encrypt/decrypt operations to average over */
+    OpRes benchmark_profile(const KeyProfile& profile, ProfileCost& cost, size_t rounds = 5);
+}
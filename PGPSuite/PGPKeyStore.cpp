@@ -0,0 +1,186 @@
+#include "PGPKeyStore.h"
+#include "KeyIndex.h"
+#include "Metrics.h"
+#include "Utils.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr const char* private_keys_dir = "private-keys-v1.d";
+
+    /* @brief Load a single keyring file in the given format */
+    pgp::OpRes load_file(rnp::FFI& ffi, const std::string& path, pgp::keystore::Format format, uint32_t flags)
+    {
+        rnp::Input input;
+
+        if (input.set_input_from_path(path) != RNP_SUCCESS)
+            return "Failed setting input for: " + path + "\nDoes it exist?";
+
+        pgp::metrics::Scope scope("load keys");
+        pgp::trace::Span span("rnp_load_keys", path);
+
+        if (pgp::metrics::rnp_result(rnp_load_keys(ffi, pgp::keystore::format_name(format), input, flags)) != RNP_SUCCESS)
+            return "Failed to read: " + path;
+
+        return true;
+    }
+}
+
+const char* pgp::keystore::format_name(Format format)
+{
+    switch (format)
+    {
+    case Format::KBX: return "KBX";
+    case Format::G10: return "G10";
+    default: return "GPG";
+    }
+}
+
+pgp::keystore::Format pgp::keystore::detect_format(const std::string& path)
+{
+    std::ifstream file(utils::to_path(path), std::ios::binary);
+    std::array<char, 16> header{};
+
+    file.read(header.data(), header.size());
+    const auto length = static_cast<size_t>(file.gcount());
+
+    /* every keybox starts with a header blob carrying the magic at offset 8 */
+    if (length >= 12 && std::memcmp(header.data() + 8, "KBXf", 4) == 0) return Format::KBX;
+
+    /* G10 keys are s-expressions, newer GnuPG versions wrap them in a name-value file */
+    if (length >= 1 && header[0] == '(') return Format::G10;
+    if (length >= 4 && std::memcmp(header.data(), "Key:", 4) == 0) return Format::G10;
+    if (length >= 8 && std::memcmp(header.data(), "Created:", 8) == 0) return Format::G10;
+
+    return Format::GPG;
+}
+
+std::optional<pgp::keystore::GnuPGHome> pgp::keystore::find_gnupg_home(const std::string& path)
+{
+    std::error_code ec;
+    auto home = utils::to_path(path);
+
+    /* walk up from a key file or the private keys directory to the home */
+    if (fs::is_regular_file(home, ec)) home = home.parent_path();
+    if (home.filename() == private_keys_dir) home = home.parent_path();
+
+    if (!fs::is_directory(home / private_keys_dir, ec)) return std::nullopt;
+
+    GnuPGHome result;
+    result.private_keys = home / private_keys_dir;
+
+    for (const auto* name : { "pubring.kbx", "pubring.gpg" })
+    {
+        if (!fs::is_regular_file(home / name, ec)) continue;
+
+        result.pubring = home / name;
+        break;
+    }
+
+    if (result.pubring.empty()) return std::nullopt;
+
+    return result;
+}
+
+pgp::OpRes pgp::keystore::load_public_keys(rnp::FFI& ffi, const std::string& path)
+{
+    std::error_code ec;
+
+    if (fs::is_directory(utils::to_path(path), ec))
+    {
+        const auto home = find_gnupg_home(path);
+        if (!home) return "Not a GnuPG home directory: " + path;
+
+        const auto pubring = utils::from_path(home->pubring);
+        return load_file(ffi, pubring, detect_format(pubring), RNP_LOAD_SAVE_PUBLIC_KEYS);
+    }
+
+    return load_file(ffi, path, detect_format(path), RNP_LOAD_SAVE_PUBLIC_KEYS);
+}
+
+pgp::OpRes pgp::keystore::load_secret_keys(rnp::FFI& ffi, const std::string& path)
+{
+    const auto format = detect_format(path);
+
+    /* plain keyrings hold everything, so there is nothing to gain by being lazy */
+    if (format == Format::GPG && !fs::is_directory(utils::to_path(path)))
+        return load_file(ffi, path, format, RNP_LOAD_SAVE_SECRET_KEYS);
+
+    const auto home = find_gnupg_home(path);
+
+    /* any other directory is taken to be full of keyrings, only the keys a message is for get loaded */
+    std::error_code ec;
+    if (!home && fs::is_directory(utils::to_path(path), ec)) return keyring::load_routed(ffi, path);
+
+    if (!home) return "Could not find the GnuPG home of: " + path;
+
+    /* G10 secret keys can only be loaded next to their public key */
+    const auto pubring = utils::from_path(home->pubring);
+    if (auto res = load_file(ffi, pubring, detect_format(pubring), RNP_LOAD_SAVE_PUBLIC_KEYS); !res) return res;
+
+    auto provider = std::make_shared<G10Provider>(home->private_keys);
+
+    if (rnp_ffi_set_key_provider(ffi, G10Provider::callback, provider.get()) != RNP_SUCCESS)
+        return "Failed to set key provider.\n";
+
+    ffi.provider_context = std::move(provider);
+
+    return true;
+}
+
+void pgp::keystore::prepare_secret_keys(const std::string& path)
+{
+    std::error_code ec;
+
+    if (path.empty() || find_gnupg_home(path) || !fs::is_directory(utils::to_path(path), ec)) return;
+
+    /* errors are reported again by the workers, when they load the keys */
+    std::shared_ptr<const keyring::KeyIndex> index;
+    bool rebuilt{ false };
+    keyring::shared_index(path, index, rebuilt);
+}
+
+bool pgp::keystore::G10Provider::load(rnp_ffi_t ffi, const std::string& grip)
+{
+    std::error_code ec;
+    const auto file = _directory / utils::to_path(grip + ".key");
+
+    if (!fs::is_regular_file(file, ec)) return false;
+
+    rnp::Input input;
+    const auto path = utils::from_path(file);
+
+    if (input.set_input_from_path(path) != RNP_SUCCESS) return false;
+
+    metrics::Scope scope("load secret key");
+    trace::Span span("rnp_load_keys", path);
+
+    return metrics::rnp_result(rnp_load_keys(ffi, "G10", input, RNP_LOAD_SAVE_SECRET_KEYS)) == RNP_SUCCESS;
+}
+
+void pgp::keystore::G10Provider::callback(rnp_ffi_t ffi, void* app_ctx, const char* identifier_type, const char* identifier, bool secret)
+{
+    /* all public keys are loaded up front */
+    if (!secret || app_ctx == nullptr || identifier_type == nullptr || identifier == nullptr) return;
+
+    auto* provider = static_cast<G10Provider*>(app_ctx);
+
+    if (std::strcmp(identifier_type, "grip") == 0)
+    {
+        provider->load(ffi, identifier);
+        return;
+    }
+
+    /* the files are named by keygrip, which the public key knows */
+    rnp::KeyHandle key;
+    if (rnp_locate_key(ffi, identifier_type, identifier, key.put()) != RNP_SUCCESS || key == nullptr) return;
+
+    rnp::Buffer<char> grip;
+    if (rnp_key_get_grip(key, &grip.buffer) == RNP_SUCCESS && grip.buffer != nullptr)
+        provider->load(ffi, grip.buffer);
+}
@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+
+/* Loading keys from the stores GnuPG 2 uses next to plain OpenPGP keyrings
+* - GPG: a flat file of OpenPGP key packets, what PGPSuite generates
+* - KBX: GnuPG 2 keybox, pubring.kbx, holds public keys
+* - G10: GnuPG 2 secret keys, one private-keys-v1.d/<KEYGRIP>.key file per key */
+namespace pgp::keystore
+{
+    enum class Format { GPG, KBX, G10 };
+
+    /* @return Name of the format as rnp_load_keys expects it */
+    const char* format_name(Format format);
+
+    /* @brief Determine the format of a key file from its first bytes */
+    Format detect_format(const std::string& path);
+
+    /* Layout of a GnuPG 2 home directory */
+    struct GnuPGHome
+    {
+        std::filesystem::path pubring;      /* pubring.kbx, or pubring.gpg for older homes */
+        std::filesystem::path private_keys; /* private-keys-v1.d */
+    };
+
+    /* @brief Find the GnuPG home a path belongs to
+    @param path: the home directory, its private-keys-v1.d directory or a .key file inside that
+    @return Nothing if the path is not part of a GnuPG home */
+    std::optional<GnuPGHome> find_gnupg_home(const std::string& path);
+
+    /* @brief Load public keys from a keyring file of any supported format or from a GnuPG home */
+    OpRes load_public_keys(rnp::FFI& ffi, const std::string& path);
+
+    /* @brief Make secret keys available to the ffi
+    * A plain keyring file is loaded completely. For a GnuPG home only the public keys are loaded,
+    * a secret key file is read from private-keys-v1.d the moment rnp asks for that key.
+    * Any other directory is treated as a directory of keyrings, see keyring::load_routed */
+    OpRes load_secret_keys(rnp::FFI& ffi, const std::string& path);
+
+    /* @brief Do once what every ffi loading these secret keys would otherwise repeat, call it before starting workers that each load them
+    * Only a directory of keyrings needs it, its index is built or refreshed here and shared by the workers */
+    void prepare_secret_keys(const std::string& path);
+
+    /* Key provider that reads G10 secret keys on demand, files are named after the keygrip of the key */
+    class G10Provider
+    {
+    protected:
+        std::filesystem::path _directory;
+    public:
+        G10Provider(std::filesystem::path directory) : _directory(std::move(directory)) {}
+
+        /* @brief Load the secret key with the given keygrip, if there is a file for it */
+        bool load(rnp_ffi_t ffi, const std::string& grip);
+
+        /* rnp_get_key_cb, app_ctx is the G10Provider */
+        static void callback(rnp_ffi_t ffi, void* app_ctx, const char* identifier_type, const char* identifier, bool secret);
+    };
+}
@@ -0,0 +1,224 @@
+#include "PGPManifest.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include <openssl/evp.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr const char* manifest_header{ "# pgpsuite manifest 1" };
+
+    std::string to_hex(const uint8_t* data, size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(size * 2);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            hex += digits[data[i] >> 4];
+            hex += digits[data[i] & 0x0f];
+        }
+
+        return hex;
+    }
+
+    /* @brief Sources are recorded by absolute path, so running from another directory finds the same entries */
+    std::string manifest_key(const std::string& source)
+    {
+        std::error_code ec;
+        const auto path = fs::absolute(pgp::utils::to_path(source), ec);
+        return ec ? source : pgp::utils::from_path(path.lexically_normal());
+    }
+
+    /* @brief Size and modification time of a file, the cheap part of the comparison */
+    bool stat_file(const std::string& file, pgp::manifest::Entry& entry)
+    {
+        std::error_code ec;
+        const auto path = pgp::utils::to_path(file);
+
+        entry.size = fs::file_size(path, ec);
+        if (ec) return false;
+
+        const auto modified = fs::last_write_time(path, ec);
+        if (ec) return false;
+
+        entry.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+        return true;
+    }
+}
+
+pgp::OpRes pgp::manifest::Manifest::load(const std::string& path)
+{
+    std::error_code ec;
+    _entries.clear();
+
+    if (!fs::exists(utils::to_path(path), ec)) return true;
+
+    std::ifstream file(utils::to_path(path), std::ios::binary);
+    std::string line;
+
+    if (!std::getline(file, line) || line != manifest_header) return "Not a manifest: " + path;
+
+    /* hash, size, time and recipients, the path goes last as it is the only field that could contain a tab */
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        Entry entry;
+        std::string source;
+
+        if (!std::getline(fields, entry.hash, '\t')) continue;
+        if (!(fields >> entry.size >> entry.modified)) return "Corrupt manifest: " + path;
+        fields.ignore(1);
+        if (!std::getline(fields, entry.recipients, '\t') || !std::getline(fields, source)) return "Corrupt manifest: " + path;
+
+        _entries[source] = std::move(entry);
+    }
+
+    return true;
+}
+
+pgp::OpRes pgp::manifest::Manifest::save(const std::string& path) const
+{
+    std::error_code ec;
+    const auto target = utils::to_path(path);
+    const auto temp = utils::to_path(path + ".tmp");
+
+    if (target.has_parent_path()) fs::create_directories(target.parent_path(), ec);
+
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file << manifest_header << '\n';
+
+        for (const auto& [source, entry] : _entries)
+            file << entry.hash << '\t' << entry.size << '\t' << entry.modified << '\t' << entry.recipients << '\t' << source << '\n';
+
+        if (!file.flush()) return "Failed writing: " + path;
+    }
+
+    fs::rename(temp, target, ec);
+    if (ec) return "Failed to replace: " + path;
+
+    return true;
+}
+
+const pgp::manifest::Entry* pgp::manifest::Manifest::find(const std::string& source) const
+{
+    const auto entry = _entries.find(source);
+    return entry == _entries.end() ? nullptr : &entry->second;
+}
+
+pgp::OpRes pgp::manifest::hash_file(const std::string& file, std::string& hash)
+{
+    metrics::Scope scope("hash");
+    trace::Span span("hash", file);
+
+    std::ifstream input(utils::to_path(file), std::ios::binary);
+    if (!input) return "Could not open: " + file;
+
+    std::vector<char> buffer(1024 * 1024);
+    uint8_t digest[EVP_MAX_MD_SIZE]{};
+    unsigned int digest_size{ 0 };
+
+    auto* ctx = EVP_MD_CTX_new();
+    bool ok = ctx != nullptr && EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1;
+
+    while (ok && input)
+    {
+        input.read(buffer.data(), buffer.size());
+        ok = EVP_DigestUpdate(ctx, buffer.data(), static_cast<size_t>(input.gcount())) == 1;
+    }
+
+    ok = ok && input.eof() && EVP_DigestFinal_ex(ctx, digest, &digest_size) == 1;
+    EVP_MD_CTX_free(ctx);
+
+    if (!ok) return "Failed hashing: " + file;
+
+    hash = to_hex(digest, digest_size);
+    return true;
+}
+
+std::string pgp::manifest::hash_data(const uint8_t* data, size_t size)
+{
+    uint8_t digest[EVP_MAX_MD_SIZE]{};
+    unsigned int digest_size{ 0 };
+
+    if (EVP_Digest(data, size, digest, &digest_size, EVP_sha256(), nullptr) != 1) return {};
+
+    return to_hex(digest, digest_size);
+}
+
+std::string pgp::manifest::describe_recipients(const std::vector<uint8_t>& key_data, bool password)
+{
+    std::string description;
+
+    /* the userid is only how the key was found, the key itself is what matters */
+    if (!key_data.empty()) description = "key:" + hash_data(key_data.data(), key_data.size());
+
+    if (password) description += description.empty() ? "password" : "+password";
+
+    return description;
+}
+
+pgp::manifest::Plan pgp::manifest::plan(const std::vector<batch::Job>& jobs, Manifest& manifest, const std::string& recipients)
+{
+    trace::Span span("plan incremental");
+    Plan plan;
+
+    for (const auto& job : jobs)
+    {
+        std::error_code ec;
+        Entry current;
+        current.recipients = recipients;
+
+        /* a file that can not be looked at is left to the batch, which reports why */
+        if (!stat_file(job.source, current))
+        {
+            plan.jobs.push_back(job);
+            plan.entries.push_back({});
+            continue;
+        }
+
+        const auto key = manifest_key(job.source);
+        const auto* previous = manifest.find(key);
+        const bool comparable = previous != nullptr && previous->recipients == recipients && previous->size == current.size
+            && fs::exists(utils::to_path(job.destination), ec);
+
+        if (comparable && previous->modified == current.modified)
+        {
+            plan.skipped++;
+            continue;
+        }
+
+        if (!hash_file(job.source, current.hash)) current.hash.clear();
+
+        /* touched but not changed, remember the new time so it is not hashed again next time */
+        if (comparable && !current.hash.empty() && previous->hash == current.hash)
+        {
+            manifest.set(key, current);
+            plan.skipped++;
+            continue;
+        }
+
+        plan.jobs.push_back(job);
+        plan.entries.push_back(std::move(current));
+    }
+
+    return plan;
+}
+
+void pgp::manifest::record(Manifest& manifest, const Plan& plan, const std::vector<batch::JobResult>& results)
+{
+    for (size_t i = 0; i < results.size() && i < plan.entries.size(); i++)
+    {
+        if (results[i].result && !plan.entries[i].hash.empty())
+            manifest.set(manifest_key(plan.jobs[i].source), plan.entries[i]);
+    }
+}
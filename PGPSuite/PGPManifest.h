@@ -0,0 +1,98 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "PGPBatch.h"
+
+/* Incremental encryption
+* A manifest next to the output tree remembers, for every source, its size, modification time,
+* content hash and the recipients it was encrypted to. A file is only encrypted again when its
+* content or the recipients changed, or when its output disappeared.
+* Size and time are checked first, the file is only hashed when those differ */
+namespace pgp::manifest
+{
+    /* name of the manifest inside the output directory */
+    constexpr const char* default_name{ ".pgpsuite-manifest" };
+
+    /* What is known about a source file the last time it was encrypted */
+    struct Entry
+    {
+        uint64_t size{ 0 };
+        int64_t modified{ 0 };
+        /* SHA-256 of the content in hex */
+        std::string hash;
+        /* describe_recipients of the recipients it was encrypted to */
+        std::string recipients;
+    };
+
+    /* Entries by source path */
+    class Manifest
+    {
+    protected:
+        std::map<std::string, Entry> _entries;
+    public:
+        /* @brief Read a manifest, a file that does not exist yet is an empty manifest */
+        OpRes load(const std::string& path);
+        /* @brief Write the manifest, replacing the old one only once the new one is complete */
+        OpRes save(const std::string& path) const;
+
+        /* @return Entry of the source, nullptr if it is not in the manifest */
+        const Entry* find(const std::string& source) const;
+        void set(const std::string& source, Entry entry) { _entries[source] = std::move(entry); }
+        size_t size() const { return _entries.size(); }
+    };
+
+    /* Jobs that have to run, with the entries to record for them once they succeed */
+    struct Plan
+    {
+        std::vector<batch::Job> jobs;
+        std::vector<Entry> entries;
+        size_t skipped{ 0 };
+    };
+
+    /* @brief SHA-256 of a file in hex */
+    OpRes hash_file(const std::string& file, std::string& hash);
+
+    /* @brief SHA-256 of data in memory in hex */
+    std::string hash_data(const uint8_t* data, size_t size);
+
+    /* @brief Identify a set of recipients, the key is hashed so changing keys is noticed without storing them
+    @param key_data: recipient key as exported by export_recipient, may be empty
+    @param password: whether a password is used as well, the password itself is never stored */
+    std::string describe_recipients(const std::vector<uint8_t>& key_data, bool password);
+
+    /* @brief Leave out the jobs whose source is unchanged since it was last encrypted to the same recipients
+    @param manifest: entries whose time changed but content did not are updated in place */
+    Plan plan(const std::vector<batch::Job>& jobs, Manifest& manifest, const std::string& recipients);
+
+    /* @brief Record the jobs of the plan that succeeded
+    @param results: results of running plan.jobs, in the same order */
+    void record(Manifest& manifest, const Plan& plan, const std::vector<batch::JobResult>& results);
+}
@@ -0,0 +1,432 @@
+#include "PGPSegmented.h"
+#include "PGPDecrypt.h"
+#include "PGPKeyStore.h"
+#include "PGPManifest.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr const char* index_header{ "pgpsuite segmented 1" };
+
+    /* Processes segment number index */
+    using SegmentWorker = std::function<pgp::OpRes(size_t)>;
+
+    /* @brief Hand out segments to threads until all are done or one fails
+    @param make_worker: called once on every thread, so ffi's never cross threads
+    @return The first error */
+    pgp::OpRes for_each_segment(size_t count, size_t workers, const std::function<SegmentWorker()>& make_worker)
+    {
+        const size_t thread_count = std::min<size_t>(count, workers > 0 ? workers : std::max<size_t>(1, std::thread::hardware_concurrency()));
+
+        std::atomic<size_t> next{ 0 };
+        std::atomic<bool> failed{ false };
+        std::mutex error_mutex;
+        pgp::OpRes error;
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&, t]
+                {
+                    pgp::trace::name_thread("segment worker " + std::to_string(t));
+                    auto worker = make_worker();
+
+                    for (size_t i = next++; i < count && !failed; i = next++)
+                    {
+                        if (auto res = worker(i); !res)
+                        {
+                            std::lock_guard lock(error_mutex);
+                            if (!failed.exchange(true)) error = std::move(res);
+                        }
+                    }
+                });
+        }
+
+        for (auto& thread : threads) thread.join();
+
+        return failed ? error : pgp::OpRes(true);
+    }
+
+    /* Per thread encryption state */
+    struct EncryptContext
+    {
+        rnp::FFI ffi{ "GPG", "GPG" };
+        rnp::KeyHandle key; /* declared after the ffi, so it is released first */
+        std::ifstream source;
+    };
+
+    /* Per thread decryption state */
+    struct DecryptContext
+    {
+        rnp::FFI ffi{ "GPG", "GPG" };
+        std::string password;
+        std::fstream output;
+    };
+
+    pgp::OpRes write_file(const fs::path& path, const uint8_t* data, size_t size)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+        if (!file.write(reinterpret_cast<const char*>(data), size)) return "Failed writing: " + pgp::utils::from_path(path);
+
+        return true;
+    }
+
+    pgp::OpRes read_file(const fs::path& path, pgp::utils::PooledBuffer& data)
+    {
+        std::error_code ec;
+        const auto size = fs::file_size(path, ec);
+        if (ec) return "Could not open: " + pgp::utils::from_path(path);
+
+        std::ifstream file(path, std::ios::binary);
+        data.resize(static_cast<size_t>(size));
+
+        if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) return "Failed reading: " + pgp::utils::from_path(path);
+
+        return true;
+    }
+
+    /* @brief Write the index signed by the signer as an armored message */
+    pgp::OpRes sign_index(const pgp::segmented::Index& index, const fs::path& path, const pgp::segmented::EncryptSettings& settings)
+    {
+        rnp::FFI ffi("GPG", "GPG");
+        rnp::Input input;
+        rnp::Output output;
+
+        if (auto res = pgp::keystore::load_secret_keys(ffi, settings.signer_secring); !res) return res;
+        rnp_ffi_set_pass_provider(ffi, settings.passprovider, settings.pass_context);
+
+        rnp::KeyHandle key;
+        if (rnp_locate_key(ffi, "userid", settings.signer_userid.c_str(), key.put()) != RNP_SUCCESS || key == nullptr)
+            return "Signing key not found: " + settings.signer_userid;
+
+        const auto text = index.serialize();
+        const auto temp = pgp::utils::from_path(path) + ".tmp";
+
+        if (input.set_input_from_memory(reinterpret_cast<const uint8_t*>(text.data()), text.size()) != RNP_SUCCESS)
+            return "Failed setting input from memory\n";
+
+        if (output.set_output_to_path(temp) != RNP_SUCCESS) return "Could not create: " + temp;
+
+        rnp::SignOperation op;
+        const bool signed_index = rnp_op_sign_create(op.put(), ffi, input, output) == RNP_SUCCESS
+            && rnp_op_sign_add_signature(op, key, nullptr) == RNP_SUCCESS
+            && rnp_op_sign_set_armor(op, true) == RNP_SUCCESS
+            && rnp_op_sign_set_hash(op, RNP_ALGNAME_SHA256) == RNP_SUCCESS
+            && pgp::metrics::rnp_result(rnp_op_sign_execute(op)) == RNP_SUCCESS;
+
+        op.reset(); /* finishes writing before the output is closed */
+        output.destroy();
+
+        std::error_code ec;
+        if (!signed_index)
+        {
+            fs::remove(pgp::utils::to_path(temp), ec);
+            return "Failed to sign the index, is the password correct?\n";
+        }
+
+        /* the index appearing is what marks the directory as complete */
+        fs::rename(pgp::utils::to_path(temp), path, ec);
+        if (ec) return "Failed to replace: " + pgp::utils::from_path(path);
+
+        return true;
+    }
+}
+
+std::string pgp::segmented::segment_name(size_t index)
+{
+    std::ostringstream name;
+    name << std::setw(8) << std::setfill('0') << index << ".pgp";
+    return name.str();
+}
+
+std::string pgp::segmented::Index::serialize() const
+{
+    std::ostringstream text;
+
+    text << index_header << '\n'
+        << "name\t" << name << '\n'
+        << "size\t" << size << '\n'
+        << "segment-size\t" << segment_size << '\n'
+        << "segments\t" << segments.size() << '\n';
+
+    for (size_t i = 0; i < segments.size(); i++)
+        text << i << '\t' << segments[i].size << '\t' << segments[i].hash << '\n';
+
+    return text.str();
+}
+
+pgp::OpRes pgp::segmented::Index::parse(const std::string& text, Index& index)
+{
+    std::istringstream lines(text);
+    std::string line, key;
+    size_t count{ 0 };
+
+    index = {};
+
+    if (!std::getline(lines, line) || line != index_header) return "Not a segment index.\n";
+
+    auto field = [&](const char* name, auto& value) -> bool
+    {
+        if (!std::getline(lines, line)) return false;
+        std::istringstream fields(line);
+        return std::getline(fields, key, '\t') && key == name && static_cast<bool>(fields >> value);
+    };
+
+    if (!std::getline(lines, line) || line.rfind("name\t", 0) != 0) return "Corrupt segment index.\n";
+    index.name = line.substr(5);
+
+    if (!field("size", index.size) || !field("segment-size", index.segment_size) || !field("segments", count) || index.segment_size == 0)
+        return "Corrupt segment index.\n";
+
+    uint64_t total{ 0 };
+    for (size_t i = 0; i < count; i++)
+    {
+        Segment segment;
+        size_t number{ 0 };
+
+        if (!std::getline(lines, line)) return "Corrupt segment index.\n";
+        std::istringstream fields(line);
+
+        if (!(fields >> number >> segment.size >> segment.hash) || number != i) return "Corrupt segment index.\n";
+
+        /* every segment but the last is full, anything else would put data at the wrong offset */
+        if (i + 1 < count ? segment.size != index.segment_size : segment.size > index.segment_size) return "Corrupt segment index.\n";
+
+        total += segment.size;
+        index.segments.push_back(std::move(segment));
+    }
+
+    if (total != index.size) return "Corrupt segment index.\n";
+
+    return true;
+}
+
+pgp::OpRes pgp::segmented::encrypt_file(const std::string& file, const std::string& directory, const EncryptSettings& settings)
+{
+    metrics::Recorder recorder;
+    trace::Span span("encrypt segmented", file);
+
+    std::error_code ec;
+    const auto source = utils::to_path(file);
+    const auto target = utils::to_path(directory);
+
+    if (settings.signer_secring.empty() || settings.signer_userid.empty()) return "A signing key is required for the index.\n";
+    if ((settings.pubkey_file.empty() || settings.userid.empty()) && settings.password.empty())
+        return "A recipient key, a password or both are required.\n";
+    if (settings.segment_size == 0) return "The segment size can not be 0.\n";
+
+    Index index;
+    index.name = utils::from_path(source.filename());
+    index.size = fs::file_size(source, ec);
+    index.segment_size = settings.segment_size;
+    if (ec) return "Could not open: " + file;
+
+    fs::create_directories(target, ec);
+    if (ec) return "Could not create: " + directory;
+
+    /* a leftover index would claim the directory is complete while its segments are being replaced */
+    fs::remove(target / index_name, ec);
+
+    const size_t count = std::max<size_t>(1, static_cast<size_t>((index.size + index.segment_size - 1) / index.segment_size));
+    index.segments.resize(count);
+
+    /* exported once, every thread loads it from memory */
+    auto recipient = std::make_shared<std::vector<uint8_t>>();
+    if (!settings.pubkey_file.empty())
+    {
+        if (auto res = export_recipient(settings.pubkey_file, settings.userid, *recipient); !res) return res;
+    }
+
+    auto options = settings.options;
+    options.armor = false;
+
+    /* measurements are per thread, so the workers only count and the totals are recorded here */
+    std::atomic<uint64_t> encrypted_size{ 0 };
+    metrics::add_bytes_in(index.size);
+
+    auto res = for_each_segment(count, settings.workers, [&]() -> SegmentWorker
+        {
+            auto context = std::make_shared<EncryptContext>();
+            context->source.open(source, std::ios::binary);
+
+            if (!recipient->empty())
+            {
+                if (auto res = load_recipient(context->ffi, *recipient, settings.userid, context->key.put()); !res)
+                    return [res](size_t) { return res; };
+            }
+
+            return [&, context](size_t i) -> OpRes
+            {
+                trace::Span span("encrypt segment", segment_name(i));
+
+                const auto offset = i * index.segment_size;
+                const auto size = static_cast<size_t>(std::min<uint64_t>(index.segment_size, index.size - offset));
+
+                utils::PooledBuffer plain(size);
+                plain.resize(size);
+
+                context->source.seekg(offset);
+                if (!context->source.read(reinterpret_cast<char*>(plain.data()), plain.size())) return "Failed reading: " + file;
+
+                utils::PooledBuffer encrypted(size + 64 * 1024);
+                rnp::Input input;
+                rnp::Output output;
+
+                if (input.set_input_from_memory(plain.data(), plain.size()) != RNP_SUCCESS) return "Failed setting input from memory\n";
+                if (output.set_output_to_buffer(encrypted) != RNP_SUCCESS) return "Failed setting output\n";
+
+                if (auto res = encrypt_with(context->ffi, context->key, input, output, settings.password, index.name, options); !res) return res;
+                output.destroy(); /* flush everything into the buffer */
+
+                index.segments[i] = { size, manifest::hash_data(encrypted.data(), encrypted.size()) };
+                encrypted_size += encrypted.size();
+
+                return write_file(target / segment_name(i), encrypted.data(), encrypted.size());
+            };
+        });
+
+    metrics::add_bytes_out(encrypted_size);
+    if (!res) return res.attach(recorder.finish());
+
+    res = sign_index(index, target / index_name, settings);
+    return res.attach(recorder.finish());
+}
+
+pgp::OpRes pgp::segmented::read_index(const std::string& directory, const std::string& signer_pubkey, Index& index)
+{
+    rnp::FFI ffi("GPG", "GPG");
+    rnp::Input input;
+    rnp::Output output;
+    utils::PooledBuffer text(4096);
+    const auto path = utils::from_path(utils::to_path(directory) / index_name);
+
+    if (signer_pubkey.empty()) return "The signer's public key is required to trust the index.\n";
+    if (auto res = keystore::load_public_keys(ffi, signer_pubkey); !res) return res;
+
+    if (input.set_input_from_path(path) != RNP_SUCCESS) return "Could not open: " + path + "\nIs the directory complete?";
+    if (output.set_output_to_buffer(text) != RNP_SUCCESS) return "Failed setting output\n";
+
+    rnp::VerifyOperation op;
+    if (rnp_op_verify_create(op.put(), ffi, input, output) != RNP_SUCCESS) return "Failed to create verify operation.\n";
+
+    const auto executed = metrics::rnp_result(rnp_op_verify_execute(op));
+    size_t count{ 0 }, valid{ 0 };
+    rnp_op_verify_get_signature_count(op, &count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        rnp_op_verify_signature_t signature{};
+        if (rnp_op_verify_get_signature_at(op, i, &signature) == RNP_SUCCESS && rnp_op_verify_signature_get_status(signature) == RNP_SUCCESS)
+            valid++;
+    }
+
+    op.reset();
+    output.destroy();
+
+    if (executed != RNP_SUCCESS || valid == 0) return "The index is not signed by the given key: " + path;
+
+    return Index::parse(std::string(reinterpret_cast<const char*>(text.data()), text.size()), index);
+}
+
+pgp::OpRes pgp::segmented::decrypt_file(const std::string& directory, const std::string& output_file, const DecryptSettings& settings)
+{
+    metrics::Recorder recorder;
+    trace::Span span("decrypt segmented", directory);
+
+    Index index;
+    if (auto res = read_index(directory, settings.signer_pubkey, index); !res) return res;
+
+    std::error_code ec;
+    const auto source = utils::to_path(directory);
+    const auto target = utils::to_path(output_file);
+    const auto temp = utils::to_path(output_file + ".part");
+
+    if (target.has_parent_path()) fs::create_directories(target.parent_path(), ec);
+
+    /* every thread writes its segments at their own offset, so the file needs its full size up front */
+    {
+        std::ofstream create(temp, std::ios::binary | std::ios::trunc);
+        if (!create) return "Could not create: " + output_file;
+    }
+    fs::resize_file(temp, index.size, ec);
+    if (ec) return "Could not create: " + output_file;
+
+    std::atomic<uint64_t> encrypted_size{ 0 };
+
+    keystore::prepare_secret_keys(settings.secring_file);
+
+    auto res = for_each_segment(index.segments.size(), settings.workers, [&]() -> SegmentWorker
+        {
+            auto context = std::make_shared<DecryptContext>();
+            context->password = settings.password;
+            context->output.open(temp, std::ios::binary | std::ios::in | std::ios::out);
+
+            if (!settings.secring_file.empty())
+            {
+                if (auto res = load_secret_keys(context->ffi, settings.secring_file); !res)
+                    return [res](size_t) { return res; };
+            }
+
+            rnp_ffi_set_pass_provider(context->ffi, context_pass_provider, &context->password);
+
+            return [&, context](size_t i) -> OpRes
+            {
+                trace::Span span("decrypt segment", segment_name(i));
+
+                const auto& segment = index.segments[i];
+                utils::PooledBuffer encrypted;
+
+                if (auto res = read_file(source / segment_name(i), encrypted); !res) return res;
+                encrypted_size += encrypted.size();
+
+                if (manifest::hash_data(encrypted.data(), encrypted.size()) != segment.hash)
+                    return "Segment does not match the index: " + segment_name(i);
+
+                utils::PooledBuffer plain(static_cast<size_t>(segment.size));
+                rnp::Input input;
+                rnp::Output output;
+
+                if (input.set_input_from_memory(encrypted.data(), encrypted.size()) != RNP_SUCCESS) return "Failed setting input from memory\n";
+                if (output.set_output_to_buffer(plain) != RNP_SUCCESS) return "Failed setting output\n";
+
+                if (auto res = decrypt_with(context->ffi, input, output); !res) return res;
+                output.destroy();
+
+                if (plain.size() != segment.size) return "Segment has the wrong size: " + segment_name(i);
+
+                context->output.seekp(i * index.segment_size);
+                if (!context->output.write(reinterpret_cast<const char*>(plain.data()), plain.size()) || !context->output.flush())
+                    return "Failed writing: " + output_file;
+
+                return true;
+            };
+        });
+
+    metrics::add_bytes_in(encrypted_size);
+    metrics::add_bytes_out(res ? index.size : 0);
+
+    if (res)
+    {
+        fs::rename(temp, target, ec);
+        if (ec) res = "Failed to replace: " + output_file;
+    }
+    else
+        fs::remove(temp, ec);
+
+    return res.attach(recorder.finish());
+}
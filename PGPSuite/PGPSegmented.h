@@ -0,0 +1,113 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+#include "rnp_wrappers.h"
+#include "PGPEncrypt.h"
+
+/* Segmented encryption of very large files
+* The file is cut into fixed size segments, every segment is encrypted as an OpenPGP message of its own
+* so all cores can work on one file, both when encrypting and when decrypting.
+* The result is a directory:
+*   00000000.pgp, 00000001.pgp, ...  the encrypted segments
+*   index.asc                        signed list of the segments in order with the SHA-256 of each encrypted segment
+* The index is written last, a directory without one is incomplete. Because the index is signed and
+* holds the hashes, segments can not be swapped, dropped or replaced without the decryption noticing */
+namespace pgp::segmented
+{
+    constexpr const char* index_name{ "index.asc" };
+    constexpr uint64_t default_segment_size{ 64ull * 1024 * 1024 };
+
+    /* A single encrypted segment */
+    struct Segment
+    {
+        /* size of the plaintext of the segment */
+        uint64_t size{ 0 };
+        /* SHA-256 of the encrypted segment in hex */
+        std::string hash;
+    };
+
+    /* Contents of index.asc */
+    struct Index
+    {
+        /* filename of the original file */
+        std::string name;
+        uint64_t size{ 0 };
+        uint64_t segment_size{ 0 };
+        std::vector<Segment> segments;
+
+        std::string serialize() const;
+        /* @brief Parse a serialized index, checks the segments add up to the size */
+        static OpRes parse(const std::string& text, Index& index);
+    };
+
+    /* @return Filename of segment number index */
+    std::string segment_name(size_t index);
+
+    /* How to encrypt and sign */
+    struct EncryptSettings
+    {
+        std::string pubkey_file;
+        std::string userid;
+        /* password to encrypt the segments with, no password if left empty */
+        std::string password;
+        /* secret keyring and userid of the key that signs the index */
+        std::string signer_secring;
+        std::string signer_userid;
+        /* unlocks the signing key */
+        rnp_password_cb passprovider{ nullptr };
+        void* pass_context{ nullptr };
+        uint64_t segment_size{ default_segment_size };
+        /* amount of threads, 0 uses one per core */
+        size_t workers{ 0 };
+        /* armoring is never used for segments */
+        EncryptOptions options;
+    };
+
+    /* How to decrypt and what to trust */
+    struct DecryptSettings
+    {
+        std::string secring_file;
+        std::string password;
+        /* public key of whoever signed the index */
+        std::string signer_pubkey;
+        size_t workers{ 0 };
+    };
+
+    /* @brief Encrypt a file into a directory of segments
+    @param directory: created if it does not exist, existing segments are overwritten */
+    OpRes encrypt_file(const std::string& file, const std::string& directory, const EncryptSettings& settings);
+
+    /* @brief Read the index of a segmented directory, fails unless it carries a valid signature of the signer */
+    OpRes read_index(const std::string& directory, const std::string& signer_pubkey, Index& index);
+
+    /* @brief Decrypt a directory of segments back into the original file
+    @param output_file: written under a temporary name, only renamed once every segment checked out */
+    OpRes decrypt_file(const std::string& directory, const std::string& output_file, const DecryptSettings& settings);
+}
@@ -61,6 +61,7 @@ wxPanel* MyFrame::create_encryption_page(wxBookCtrlBase* parent)
             wxArrayString choices;
             choices.Add("File");
             choices.Add("Text");
+            choices.Add("Folder");
 
             auto* radiobox = new wxRadioBox(panel, ID_ENC_TYPE_RADIO_CHANGED, wxEmptyString, wxDefaultPosition, wxDefaultSize, choices);
             mainInputSizer->Add(radiobox, 0, wxALIGN_RIGHT);
@@ -74,6 +75,11 @@ wxPanel* MyFrame::create_encryption_page(wxBookCtrlBase* parent)
                         pickFile->SetId(ID_OPEN_FILE);
                         _enc_mode = EncMode::File;
                     }
+                    else if (selection == _("Folder"))
+                    {
+                        pickFile->SetId(ID_OPEN_FOLDER);
+                        _enc_mode = EncMode::Folder;
+                    }
                     else
                     {
                         pickFile->SetId(ID_EDIT_TEXT);
@@ -125,18 +131,31 @@ wxPanel* MyFrame::create_generate_page(wxBookCtrlBase* parent)
 
     auto keyText = new wxStaticText(panel, wxID_ANY, _("Key ID"));
     auto keyInput = new wxTextCtrl(panel, wxID_ANY, _("user@id"));
-    keyInput->Disable();
+    _input_fields["Key ID"] = keyInput;
     keyText->SetMinSize(wxSize(125, keyText->GetMinSize().y));
     inputSizer->Add(keyText);
     inputSizer->Add(keyInput);
 
+    auto profileSizer = new wxBoxSizer(wxHORIZONTAL);
+    panelMainSizer->Add(profileSizer, 1, wxEXPAND | wxALL ^ wxTOP, 15);
+
+    auto profileText = new wxStaticText(panel, wxID_ANY, _("Key type"));
+    auto profileChoice = new wxChoice(panel, ID_KEY_PROFILE_SELECTION);
+    profileText->SetMinSize(wxSize(125, profileText->GetMinSize().y));
+    profileSizer->Add(profileText);
+    profileSizer->Add(profileChoice);
+    _choices["Key type"] = profileChoice;
+    fill_key_profiles(profileChoice);
+
     auto button_sizer = new wxBoxSizer(wxHORIZONTAL);
     panelMainSizer->Add(button_sizer);
 
     auto button = new wxButton(panel, ID_GENERATE_KEY, _("Generate"));
     auto advanced_button = new wxButton(panel, ID_SHOW_GENERATE_SETTINGS, _("Advanced..."));
+    auto benchmark_button = new wxButton(panel, ID_BENCHMARK_PROFILES, _("Benchmark"));
     button_sizer->Add(button);
     button_sizer->Add(advanced_button);
+    button_sizer->Add(benchmark_button);
 
     return panel;
 }
@@ -190,6 +209,9 @@ wxPanel* MyFrame::create_decrypt_page(wxBookCtrlBase* parent)
     auto encryptButton = new wxButton(panel, ID_DECRYPT_FILE, _("Decrypt"));
     buttonSizer->Add(encryptButton);
 
+    auto viewButton = new wxButton(panel, ID_DECRYPT_VIEW, _("Decrypt and view"));
+    buttonSizer->Add(viewButton);
+
     return panel;
 }
 
@@ -198,6 +220,8 @@ wxMenuBar* MyFrame::create_menu_bar()
     wxMenu* menu_settings = new wxMenu;
     menu_settings->Append(ID_REGISTER_EXTENSION, _("Register .asc extension"), _("Associate .asc files with PGPSuite"));
     menu_settings->Append(ID_UNREGISTER_EXTENSION, _("Unregister .asc extension"), _("Remove .asc file associations with PGPSuite"));
+    menu_settings->AppendSeparator();
+    menu_settings->AppendCheckItem(ID_TOGGLE_TRACE, _("Record trace"), _("Record where time goes, saved as a Chrome trace when unchecked"));
 
     wxMenuBar* menuBar = new wxMenuBar;
     menuBar->Append(menu_settings, "&Settings");
@@ -221,6 +245,16 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
 
     Bind(wxEVT_BUTTON, std::bind(bind_button_filediag, "File to encrypt"), ID_OPEN_FILE, ID_OPEN_FILE);
 
+    Bind(wxEVT_BUTTON, [this](wxCommandEvent&)
+        {
+            wxDirDialog dirDialog(this, _("Select folder to encrypt"), "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+
+            if (dirDialog.ShowModal() == wxID_CANCEL)
+                return;
+
+            _input_fields["File to encrypt"]->SetValue(dirDialog.GetPath());
+        }, ID_OPEN_FOLDER, ID_OPEN_FOLDER);
+
     Bind(wxEVT_BUTTON, [bind_button_filediag](wxCommandEvent& e)
         {
             bind_button_filediag("Recipient public key", "PGP file (*.pgp)|*.pgp| All files|*");
@@ -265,6 +299,33 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
                 wxMessageBox(_("Failed to register PGPSuite for .asc extension."), _("Failed"));
         }, ID_REGISTER_EXTENSION, ID_REGISTER_EXTENSION);
 
+    Bind(wxEVT_MENU, [this](wxCommandEvent& e)
+        {
+            if (e.IsChecked())
+            {
+                pgp::trace::start();
+                SetStatusText(_("Recording trace..."));
+                return;
+            }
+
+            wxFileDialog fileDialog(this, _("Save trace to"), "", _("trace.json"), "JSON files(*.json)|*.json|All files|*", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+            if (fileDialog.ShowModal() == wxID_CANCEL)
+            {
+                pgp::trace::stop({}); /* discard */
+                SetStatusText(_("Trace discarded."));
+                return;
+            }
+
+            const auto success = pgp::trace::stop(std::string(fileDialog.GetPath().utf8_str()));
+
+            if (success)
+                SetStatusText(_("Trace saved, open it in chrome://tracing or ui.perfetto.dev"));
+            else
+                wxMessageBox(_(success.what()), _("Failed!"));
+
+        }, ID_TOGGLE_TRACE, ID_TOGGLE_TRACE);
+
     Bind(wxEVT_MENU, [](wxCommandEvent&)
         {
             if (!reg::is_user_admin())
@@ -293,44 +354,44 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
         return input.size() > 0;
     };
 
-    /* passprovider that cant be called twice in a row */
-    auto passprovider_once = [](rnp_ffi_t, void*, rnp_key_handle_t, const char* pgp_context, char buf[], size_t buf_len) -> bool
-    {
-        static bool called_once = false;
-
-        if (called_once)
-        {
-            called_once = false;
-            return true;
-        }
-
-        wxString input = io::text_prompt(_("Please enter a password"), _("Provide a password to encrypt secret key.\n"));
-
-        pgp::utils::copy_to_ctype(input, buf, buf_len);
-
-        called_once = true;
-
-        return input.size() > 0;
-    };
-
     /* simple lambda to check if all parameters have a size of member that returns a number greater than 0 */
     auto all_filled = [](auto ... params) -> bool { return ((params.size() > 0) && ...); };
 
     /* ------------------------------------- GENERATE ---------------------------------------------- */
 
     // (TODO) generate save as dialogues for saving pubring and secring
-    Bind(wxEVT_BUTTON, [this, passprovider_once](wxCommandEvent& e)
+    Bind(wxEVT_BUTTON, [this](wxCommandEvent& e)
         {
+            const std::string userid = _input_fields["Key ID"]->GetValue().utf8_str();
+
+            if (userid.empty())
+            {
+                wxMessageBox(_("Please enter a key ID."), _("Missing key ID"));
+                return;
+            }
+
+            wxString password = io::text_prompt(_("Please enter a password"), _("Provide a password to encrypt secret key.\n"));
+
+            if (password.empty()) return;
+
             PushStatusText(_("Generating..."));
-            
-            const auto success = pgp::generate_keys("pubring.pgp", "secring.pgp", _json_data, passprovider_once);
-            
-            PopStatusText();
 
-            if (success)
-                wxMessageBox(_("Success!"), _("Successfully generated keypair!"));
-            else
-                wxMessageBox(_("Failed!"), _("Keypair generation failed."));
+            /* waiting for the pool or generating can take seconds, the pool is shared so it survives the window */
+            io::run_in_background(this, [pool = _key_pool, userid, password = std::string(password.utf8_str())]()
+                {
+                    return pool->checkout(userid, password);
+                },
+                [this](pgp::OpRes success)
+                {
+                    PopStatusText();
+
+                    show_metrics(success);
+
+                    if (success)
+                        wxMessageBox(_("Success!"), _("Successfully generated keypair!"));
+                    else
+                        wxMessageBox(_("Failed!"), _("Keypair generation failed.\n") + success.what());
+                });
 
         }, ID_GENERATE_KEY, ID_GENERATE_KEY);
 
@@ -359,8 +420,28 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
                 return;
             }
 
+            if (_enc_mode == EncMode::Folder)
+            { /* the whole folder is streamed into a single encrypted archive */
+                PushStatusText(_("Encrypting folder..."));
+
+                const auto success = pgp::archive::encrypt_directory(std::filesystem::path(data.wc_str()),
+                    std::string(pubkey.mb_str()), std::string(keyID.mb_str()), {}, std::string(password.mb_str()));
+
+                PopStatusText();
+
+                if (success)
+                    wxMessageBox(_("Successfully encrypted folder."), _("Success!"));
+                else
+                    wxMessageBox(_(success.what()), _("Failed!"));
+                return;
+            }
+
             std::wstring filename = std::wstring(data.wc_str());
             auto filedata = std::vector<char>{};
+            /* utf-8 of the editor contents, converted in one pass and handed to rnp as is */
+            wxScopedCharBuffer text;
+            const uint8_t* message{ nullptr };
+            size_t message_size{ 0 };
 
             if (_enc_mode == EncMode::File)
             { /* data is to be interpreted as file */
@@ -375,11 +456,14 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
                 }
                 
                 save_to = pgp::utils::utf8_encode(filename) + ".asc";
+                message = reinterpret_cast<const uint8_t*>(filedata.data());
+                message_size = filedata.size();
             }
             else if (_enc_mode == EncMode::Text)
-            { /* data is to be interpreted as string */
-                auto* start = (const char*)data.wc_str();
-                std::copy(start, start + data.size() * 2, std::back_inserter(filedata));
+            { /* data is to be interpreted as string, utf-8 is what other OpenPGP programs expect and is half the size of utf-16 */
+                text = data.utf8_str();
+                message = reinterpret_cast<const uint8_t*>(text.data());
+                message_size = text.length();
 
                 wxFileDialog fileDialog(this, _("Save encrypted data to"), "", _("message"), "ASC files(*.asc) | *.asc | All files | *", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
 
@@ -392,8 +476,13 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
                 save_to = std::string(fileDialog.GetPath().mb_str());
             }
 
-            const auto success = pgp::encrypt_text((uint8_t*)filedata.data(), filedata.size(), 
-                std::string(pubkey.mb_str()), std::string(keyID.mb_str()), save_to, std::string(password.mb_str()));
+            /* the defaults are used until the calibration in the background is done */
+            const auto options = pgp::tune::enabled() && pgp::tune::ready() ? pgp::tune::choose(message, message_size) : pgp::EncryptOptions{};
+
+            const auto success = pgp::encrypt_text(message, message_size, 
+                std::string(pubkey.mb_str()), std::string(keyID.mb_str()), save_to, std::string(password.mb_str()), options);
+
+            show_metrics(success);
 
             if (success)
                 wxMessageBox(_("Successfully encrypted data."), _("Success!"));
@@ -401,11 +490,20 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
                 wxMessageBox(_(success.what()), _("Failed!"));
         }, ID_ENCRYPT_FILE, ID_ENCRYPT_FILE);
 
+    /* without a private key the configured directory of keyrings is used, only the keys a message is for are loaded from it */
+    auto secret_keys = [this]() -> wxString
+    {
+        const auto seckey = _input_fields["Private key"]->GetValue();
+        if (!seckey.empty()) return seckey;
+
+        return wxString::FromUTF8(persistent::settings().get("keys").get("keyring_dir"));
+    };
+
     /* ------------------------------------- DECRYPT ---------------------------------------------- */
     /* (TODO) accept wstrings as filenames by opening the file and loading it into memory and then decrypting that */
-    Bind(wxEVT_BUTTON, [this, passprovider, all_filled](wxCommandEvent& e)
+    Bind(wxEVT_BUTTON, [this, passprovider, all_filled, secret_keys](wxCommandEvent& e)
         {
-            auto seckey = _input_fields["Private key"]->GetValue();
+            auto seckey = secret_keys();
             auto file = _input_fields["File to decrypt"]->GetValue();
 
             if (!all_filled(file))
@@ -416,13 +514,34 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
 
             std::string filename = std::string(file.mb_str());
             
-            const auto success = pgp::decrypt_text(filename, "", passprovider, NULL, std::string(seckey.mb_str()));
+            /* archives are extracted next to the encrypted file instead of being written as one file */
+            const auto success = pgp::archive::is_archive_name(filename)
+                ? pgp::archive::decrypt_archive(filename, {}, passprovider, NULL, std::string(seckey.mb_str()))
+                : pgp::decrypt_text(filename, "", passprovider, NULL, std::string(seckey.mb_str()));
+
+            show_metrics(success);
 
             if (success)
                 wxMessageBox(_("Successfully decrypted data."), _("Success!"));
             else
                 wxMessageBox(_(success.what()), _("Failed!"));
         }, ID_DECRYPT_FILE, ID_DECRYPT_FILE);
+
+    /* decrypts into memory, nothing is written unless the user saves it from the viewer */
+    Bind(wxEVT_BUTTON, [this, all_filled, secret_keys](wxCommandEvent& e)
+        {
+            auto seckey = secret_keys();
+            auto file = _input_fields["File to decrypt"]->GetValue();
+
+            if (!all_filled(file))
+            {
+                wxMessageBox(_("Provide atleast a file to decrypt."), _("Decryption failed"));
+                return;
+            }
+
+            auto viewer = new TextViewer(this, std::string(file.mb_str()), std::string(seckey.mb_str()));
+            viewer->Show();
+        }, ID_DECRYPT_VIEW, ID_DECRYPT_VIEW);
     
     /* ------------------------------------- TEXT EDIT ---------------------------------------------- */
 
@@ -450,11 +569,81 @@ void MyFrame::runtime_bind_events(wxBookCtrlBase* notebook)
             if (diag.ShowModal() == wxID_OK)
             {
                 _json_data = diag.get_value();
+                _key_pool->set_profile(_json_data);
                 return;
             }
 
         }, ID_SHOW_GENERATE_SETTINGS, ID_SHOW_GENERATE_SETTINGS);
 
+    Bind(wxEVT_CHOICE, [this](wxCommandEvent& e)
+        {
+            const auto selection = e.GetSelection();
+            if (selection < 0 || selection >= static_cast<int>(pgp::key_profiles().size())) return;
+
+            const auto& profile = pgp::key_profiles()[selection];
+
+            _json_data = profile.json;
+            _key_pool->set_profile(_json_data);
+
+            persistent::settings()["keygen"]["profile"] = profile.id;
+            persistent::save_settings();
+
+        }, ID_KEY_PROFILE_SELECTION, ID_KEY_PROFILE_SELECTION);
+
+    Bind(wxEVT_BUTTON, [this](wxCommandEvent& e)
+        {
+            /* Outcome of benchmarking every profile, stops at the first failure */
+            struct Benchmark
+            {
+                std::vector<std::pair<std::string, std::string>> costs; /* profile id and serialized cost */
+                std::string failed_label;
+                pgp::OpRes result;
+            };
+
+            auto* button = FindWindow(ID_BENCHMARK_PROFILES);
+            if (button != nullptr) button->Disable();
+            PushStatusText(_("Benchmarking key profiles..."));
+
+            /* generating RSA-4096 keys alone takes seconds, the window stays responsive meanwhile */
+            io::run_in_background(this, []()
+                {
+                    Benchmark benchmark;
+
+                    for (const auto& profile : pgp::key_profiles())
+                    {
+                        pgp::ProfileCost cost;
+                        benchmark.result = pgp::benchmark_profile(profile, cost);
+
+                        if (!benchmark.result)
+                        {
+                            benchmark.failed_label = profile.label;
+                            break;
+                        }
+
+                        benchmark.costs.emplace_back(profile.id, cost.serialize());
+                    }
+
+                    return benchmark;
+                },
+                [this, button](Benchmark benchmark)
+                {
+                    auto& settings = persistent::settings();
+
+                    PopStatusText();
+                    if (button != nullptr) button->Enable();
+
+                    for (const auto& [id, cost] : benchmark.costs)
+                        settings["keygen_cost"][id] = cost;
+
+                    persistent::save_settings();
+                    fill_key_profiles(_choices["Key type"]);
+
+                    if (!benchmark.result)
+                        wxMessageBox(_("Benchmarking ") + benchmark.failed_label + _(" failed.\n") + benchmark.result.what(), _("Failed!"));
+                });
+
+        }, ID_BENCHMARK_PROFILES, ID_BENCHMARK_PROFILES);
+
     Bind(wxEVT_MENU, [this](wxCommandEvent& e)
         {
             AboutDiag diag = AboutDiag(this, wxID_ANY, _("About"));
@@ -468,6 +657,67 @@ void suite::MyFrame::startup_version_check()
 
     if (!perform_check) return;
 
-    ver::verify_local_version();
+    /* a recent result is good enough, show it once the window is up */
+    if (std::string latest; ver::cached_version(latest))
+    {
+        CallAfter([latest]() { ver::notify_if_outdated(latest); });
+        return;
+    }
+
+    ver::check_version_async(this, [this](const std::string& latest)
+        {
+            if (latest.empty())
+                SetStatusText(_("Could not check for a new version."));
+            else
+                ver::notify_if_outdated(latest);
+        });
 }
 
+void suite::MyFrame::create_key_pool()
+{
+    auto& settings = persistent::settings();
+    size_t depth = 2;
+
+    if (settings.has("keypool") && settings.get("keypool").has("depth"))
+    {
+        try { depth = std::stoul(settings.get("keypool").get("depth")); }
+        catch (const std::exception&) {}
+    }
+    else
+    {
+        settings["keypool"]["depth"] = std::to_string(depth);
+        persistent::save_settings();
+    }
+
+    if (settings.get("keygen").has("profile"))
+        _json_data = pgp::find_key_profile(settings.get("keygen").get("profile")).json;
+
+    _key_pool = std::make_shared<pgp::KeyPool>(_json_data, depth);
+}
+
+void suite::MyFrame::fill_key_profiles(wxChoice* choices)
+{
+    auto& settings = persistent::settings();
+    const auto& selected = pgp::find_key_profile(settings.get("keygen").get("profile"));
+
+    choices->Clear();
+
+    for (const auto& profile : pgp::key_profiles())
+    {
+        std::string label = profile.label;
+        pgp::ProfileCost cost;
+
+        if (cost.deserialize(settings.get("keygen_cost").get(profile.id)))
+            label += " (" + cost.describe() + ")";
+
+        choices->Append(label);
+
+        if (&profile == &selected) choices->SetSelection(choices->GetCount() - 1);
+    }
+}
+
+void suite::MyFrame::show_metrics(const pgp::OpRes& result)
+{
+    if (const auto* metrics = result.metrics())
+        SetStatusText(metrics->summary());
+}
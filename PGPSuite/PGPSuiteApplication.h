@@ -38,54 +38,37 @@
 #include <wx/simplebook.h>
 #include <wx/textdlg.h>
 #include <wx/radiobox.h>
+#include <wx/dirdlg.h>
+#include <wx/weakref.h>
 
 #include <unordered_map>
 
 #include "PGPEncrypt.h"
 #include "PGPGenerateKeys.h"
+#include "PGPKeyPool.h"
+#include "PGPKeyProfiles.h"
+#include "PGPAutoTune.h"
 #include "PGPDecrypt.h"
+#include "PGPArchive.h"
 #include "TextEditDiag.h"
+#include "TextViewer.h"
 #include "IOwx.h"
 #include "resource.h"
 #include "AboutDiag.h"
 #include "enums.h"
 #include "QuickPromptOperations.h"
 #include "RegUtils.h"
+#include "CommandLine.h"
+#include "SingleInstance.h"
 
 
 namespace suite
 {
-    /* Embedded json settings */
-    inline static const char* json_data = 
-R"({
-    'primary': {
-        'type': 'RSA',
-        'length': 2048,
-        'userid': 'user@id',
-        'expiration': 31536000,
-        'usage': ['sign'],
-        'protection': {
-            'cipher': 'AES256',
-            'hash': 'SHA256'
-        }
-    },
-    'sub': {
-        'type': 'RSA',
-        'length': 2048,
-        'expiration': 15768000,
-        'usage': ['encrypt'],
-        'protection': {
-            'cipher': 'AES256',
-            'hash': 'SHA256'
-        }
-    }
-}
-)";
-       
     /* Encryption mode 
         - File mode reads file and encrypts content
-        - Text mode encrypts the given data */
-    enum class EncMode { File, Text };
+        - Text mode encrypts the given data
+        - Folder mode packs a whole folder into one encrypted archive */
+    enum class EncMode { File, Text, Folder };
 
     class MyFrame : public wxFrame
     {
@@ -99,7 +82,9 @@ R"({
         ChoicesMap _choices;
         TextFieldMap _input_fields;
         EncMode _enc_mode{ EncMode::File };
-        std::string _json_data = json_data;
+        std::string _json_data = pgp::default_key_profile().json;
+        /* keypairs generated ahead of time so the generate button does not have to wait */
+        std::shared_ptr<pgp::KeyPool> _key_pool;
 
         wxPanel* create_encryption_page(wxBookCtrlBase* parent);
         wxPanel* create_generate_page(wxBookCtrlBase* parent);
@@ -110,6 +95,11 @@ R"({
         /* i prefer linking them at runtime, because lambda's */
         void runtime_bind_events(wxBookCtrlBase* notebook);
         void startup_version_check();
+        void create_key_pool();
+        /* @brief Show the built in key profiles with their last measured cost */
+        void fill_key_profiles(wxChoice* choices);
+        /* @brief Show where the time of an operation went in the status bar */
+        void show_metrics(const pgp::OpRes& result);
     public:
         MyFrame()
             : wxFrame(NULL, wxID_ANY, "PGPSuite")
@@ -142,6 +132,8 @@ R"({
             CreateStatusBar();
             SetStatusText("Ready...");
 
+            create_key_pool();
+
             runtime_bind_events(notebook);
             
             startup_version_check();
@@ -157,23 +149,95 @@ R"({
 
     class MyApp : public wxApp
     {
+    protected:
+        /* set when started as a command line operation or when the files were forwarded, no window is created in that case */
+        std::optional<int> _exit_code;
+        /* collects the files of later invocations of the same context menu action */
+        std::unique_ptr<instance::Forwarding> _forwarding;
+
+        /* @brief Let later invocations of the same action add their files to this frame */
+        template<typename _Frame>
+        void serve_forwarded_files(_Frame* frame)
+        {
+            wxWeakRef<_Frame> target(frame);
+
+            _forwarding->serve([target](const std::vector<wxString>& files)
+                {
+                    /* a closed frame can not take them, the sender opens a window of its own then */
+                    return target && target->add_files(files);
+                });
+        }
+
+        /* @brief Calibrate auto tuning in the background if it is switched on and nothing usable is stored
+        * Calibrating takes a second or two, the defaults are used until it is done */
+        void prepare_tuning(wxFrame* frame)
+        {
+            if (!pgp::tune::enabled() || pgp::tune::prepare()) return;
+
+            io::run_in_background(frame, []()
+                {
+                    pgp::tune::Calibration calibration;
+                    pgp::tune::calibrate(calibration);
+                    return calibration;
+                },
+                [](pgp::tune::Calibration calibration) { pgp::tune::install(calibration); });
+        }
     public:
         virtual bool OnInit()
         {
             wxFrame* frame = nullptr;
+
+            std::vector<std::string> args;
+            for (int i = 0; i < argc; i++)
+                args.emplace_back(argv[i].utf8_str());
+
+            if (cli::is_cli_invocation(args))
+            {
+                _exit_code = cli::run(args);
+                return true;
+            }
+
+            /* selecting many files starts one process per file, all but the first hand their file over */
+            if (argc > 1)
+            {
+                _forwarding = std::make_unique<instance::Forwarding>(argc > 2 ? "encrypt" : "decrypt");
+
+                if (_forwarding->is_another_running() && _forwarding->forward({ argv[argc > 2 ? 2 : 1] }))
+                {
+                    _exit_code = 0;
+                    return true;
+                }
+            }
             
             if (argc > 2)
-                frame = new suite::EncryptFrame(argc, argv);
+            {
+                auto encrypt_frame = new suite::EncryptFrame(argc, argv);
+                serve_forwarded_files(encrypt_frame);
+                frame = encrypt_frame;
+            }
             else if (argc > 1)
-                frame = new suite::DecryptFrame(argc, argv);
+            {
+                auto decrypt_frame = new suite::DecryptFrame(argc, argv);
+                serve_forwarded_files(decrypt_frame);
+                frame = decrypt_frame;
+            }
             else
                 frame = new MyFrame;
     
+            prepare_tuning(frame);
+
             frame->SetIcon(wxIcon(_("MY_ICON")));
             frame->CenterOnScreen(wxBOTH);
             frame->Show(true);
 
             return true;
         }
+
+        virtual int OnRun()
+        {
+            if (_exit_code) return *_exit_code;
+
+            return wxApp::OnRun();
+        }
     };
 }
@@ -0,0 +1,249 @@
+#include "PGPWatchFolder.h"
+#include "PGPEncrypt.h"
+#include "Tracing.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /* closes a win32 handle when it goes out of scope */
+    struct Handle
+    {
+        HANDLE handle;
+
+        explicit Handle(HANDLE handle) : handle(handle) {}
+        Handle(const Handle&) = delete;
+        ~Handle() { if (valid()) CloseHandle(handle); }
+
+        bool valid() const { return handle != nullptr && handle != INVALID_HANDLE_VALUE; }
+        operator HANDLE() const { return handle; }
+    };
+
+    /* extensions used by programs that are still writing a file, the file gets renamed once it is done */
+    constexpr std::array<const char*, 5> partial_extensions{ ".tmp", ".part", ".partial", ".crdownload", ".download" };
+
+    bool is_partial(const fs::path& file)
+    {
+        auto name = pgp::utils::from_path(file.filename());
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        /* office lock files */
+        if (name.rfind("~$", 0) == 0) return true;
+
+        return std::any_of(partial_extensions.begin(), partial_extensions.end(), [&](const std::string& partial)
+            {
+                return name.size() > partial.size() && name.compare(name.size() - partial.size(), partial.size(), partial) == 0;
+            });
+    }
+
+    /* @return False if another process still has the file open for writing */
+    bool can_open_exclusively(const fs::path& file)
+    {
+        Handle handle(CreateFileW(file.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        return handle.valid();
+    }
+
+    /* @brief Find a name in the directory that is not taken yet, "file (2).txt" if "file.txt" exists */
+    fs::path unique_path(const fs::path& directory, const fs::path& filename)
+    {
+        std::error_code ec;
+        auto target = directory / filename;
+
+        for (int i = 2; fs::exists(target, ec); i++)
+            target = directory / (filename.stem().wstring() + L" (" + std::to_wstring(i) + L")" + filename.extension().wstring());
+
+        return target;
+    }
+}
+
+pgp::watch::Watcher::Watcher(Options options, batch::Progress progress)
+    : _options(std::move(options)), _progress(std::move(progress))
+{
+    _stop_event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    if (_options.sent_dir.empty())
+        _options.sent_dir = utils::from_path(utils::to_path(_options.inbox) / "sent");
+}
+
+pgp::watch::Watcher::~Watcher()
+{
+    if (_stop_event != nullptr) CloseHandle(_stop_event);
+}
+
+void pgp::watch::Watcher::stop()
+{
+    if (_stop_event != nullptr) SetEvent(_stop_event);
+}
+
+std::vector<std::string> pgp::watch::Watcher::scan(bool& pending)
+{
+    std::vector<std::string> ready;
+    std::map<std::string, Candidate> seen;
+    std::error_code ec;
+    const auto now = Clock::now();
+
+    pending = false;
+
+    for (auto it = fs::directory_iterator(utils::to_path(_options.inbox), ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+    {
+        if (!it->is_regular_file(ec) || is_partial(it->path())) continue;
+
+        const auto path = utils::from_path(it->path());
+        const auto size = it->file_size(ec);
+        if (ec) continue;
+        const auto modified = it->last_write_time(ec);
+        if (ec) continue;
+
+        auto candidate = _candidates.find(path);
+
+        /* new or still being written, the clock starts over */
+        if (candidate == _candidates.end() || candidate->second.size != size || candidate->second.modified != modified)
+        {
+            seen[path] = { size, modified, now, false };
+            pending = true;
+            continue;
+        }
+
+        seen[path] = candidate->second;
+        if (candidate->second.failed) continue;
+
+        if (now - candidate->second.stable_since >= _options.settle && can_open_exclusively(it->path()))
+            ready.push_back(path);
+        else
+            pending = true;
+    }
+
+    /* files that disappeared are forgotten */
+    _candidates = std::move(seen);
+
+    return ready;
+}
+
+pgp::OpRes pgp::watch::Watcher::finish_original(const std::string& file)
+{
+    std::error_code ec;
+    const auto path = utils::to_path(file);
+
+    if (_options.originals == Originals::Delete)
+    {
+        if (!fs::remove(path, ec)) return "Failed to delete: " + file;
+        return true;
+    }
+
+    const auto sent = utils::to_path(_options.sent_dir);
+    fs::create_directories(sent, ec);
+
+    fs::rename(path, unique_path(sent, path.filename()), ec);
+    if (ec) return "Failed to move: " + file + " to " + _options.sent_dir;
+
+    return true;
+}
+
+void pgp::watch::Watcher::process(const std::vector<std::string>& files, const batch::WorkerFactory& factory)
+{
+    trace::Span span("watch burst");
+    std::vector<batch::Job> jobs;
+
+    for (const auto& file : files)
+    {
+        /* ciphertext that was not collected yet is kept, a later file with the same name gets a numbered one */
+        auto name = utils::to_path(file).filename();
+        name += ".asc";
+        jobs.push_back({ file, utils::from_path(unique_path(utils::to_path(_options.outbox), name)) });
+    }
+
+    for (auto& result : batch::run(jobs, factory, _options.batch))
+    {
+        if (result.result)
+        {
+            if (auto res = finish_original(result.source); !res) result.result = std::move(res);
+        }
+
+        if (result.result)
+            _candidates.erase(result.source);
+        else if (auto candidate = _candidates.find(result.source); candidate != _candidates.end())
+            candidate->second.failed = true;
+
+        if (_progress) _progress(result);
+    }
+}
+
+pgp::OpRes pgp::watch::Watcher::run()
+{
+    std::error_code ec;
+
+    if (_stop_event == nullptr) return "Failed to create stop event.\n";
+    if (!fs::is_directory(utils::to_path(_options.inbox), ec)) return "Not a directory: " + _options.inbox;
+    if ((_options.pubkey_file.empty() || _options.userid.empty()) && _options.password.empty())
+        return "A recipient key, a password or both are required.\n";
+
+    fs::create_directories(utils::to_path(_options.outbox), ec);
+    if (ec) return "Could not create: " + _options.outbox;
+
+    /* every burst starts new workers, loading the key from memory keeps that cheap */
+    if (!_options.pubkey_file.empty())
+    {
+        auto recipient = std::make_shared<std::vector<uint8_t>>();
+        if (auto res = export_recipient(_options.pubkey_file, _options.userid, *recipient); !res) return res;
+        _recipient = std::move(recipient);
+    }
+
+    const auto factory = batch::encrypt_worker(_recipient, _options.userid, _options.password, _options.auto_tune);
+
+    Handle directory(CreateFileW(utils::to_path(_options.inbox).wstring().c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr));
+    Handle changed(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+
+    /* the notifications are only used as a wake up, the inbox is scanned either way */
+    std::vector<DWORD> notifications(16 * 1024);
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = changed;
+    bool listening{ false };
+
+    _polling = !directory.valid() || !changed.valid();
+
+    while (true)
+    {
+        if (!_polling && !listening)
+        {
+            listening = ReadDirectoryChangesW(directory, notifications.data(), static_cast<DWORD>(notifications.size() * sizeof(DWORD)), FALSE,
+                FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &overlapped, nullptr);
+            _polling = !listening;
+        }
+
+        bool pending{ false };
+        if (const auto ready = scan(pending); !ready.empty()) process(ready, factory);
+
+        /* settling files are looked at again soon, otherwise only when something happens */
+        const auto wait = pending ? std::max<std::chrono::milliseconds>(_options.settle / 2, std::chrono::milliseconds(100)) : _options.poll_interval;
+        const HANDLE handles[2]{ _stop_event, changed };
+
+        const auto woken = WaitForMultipleObjects(listening ? 2 : 1, handles, FALSE, static_cast<DWORD>(wait.count()));
+
+        if (woken == WAIT_OBJECT_0 || woken == WAIT_FAILED) break;
+
+        if (woken == WAIT_OBJECT_0 + 1)
+        {
+            DWORD bytes{ 0 };
+            /* zero bytes means the buffer overflowed, which does not matter since everything is scanned */
+            if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE)) _polling = true;
+
+            ResetEvent(changed);
+            listening = false;
+        }
+    }
+
+    if (listening)
+    {
+        DWORD bytes{ 0 };
+        CancelIoEx(directory, &overlapped);
+        GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+    }
+
+    return true;
+}
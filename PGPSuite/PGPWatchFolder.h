@@ -0,0 +1,116 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Windows.h>
+
+#include "pgpsuite_common.h"
+#include "PGPBatch.h"
+
+/* Watch folder, encrypts every file that is dropped into a folder
+* Changes are picked up with ReadDirectoryChangesW, when the folder can not be watched (some network shares) it is polled instead.
+* A file is only picked up once it stopped changing and nobody has it open for writing anymore,
+* every burst of files that is ready is then encrypted with the batch pipeline */
+namespace pgp::watch
+{
+    /* What happens to a file after it was encrypted */
+    enum class Originals { Move, Delete };
+
+    struct Options
+    {
+        /* folder that is watched, files in sub folders are left alone */
+        std::string inbox;
+        /* folder the encrypted files are written to */
+        std::string outbox;
+        /* recipient, the key is loaded once when watching starts */
+        std::string pubkey_file;
+        std::string userid;
+        std::string password;
+        Originals originals{ Originals::Move };
+        /* originals are moved here, a "sent" folder in the inbox if empty */
+        std::string sent_dir;
+        /* a file counts as complete once its size and time did not change for this long */
+        std::chrono::milliseconds settle{ 2000 };
+        /* interval of polling, also used as a safety net in case a notification is lost */
+        std::chrono::milliseconds poll_interval{ 5000 };
+        bool auto_tune{ false };
+        batch::Options batch;
+    };
+
+    class Watcher
+    {
+    protected:
+        using Clock = std::chrono::steady_clock;
+
+        /* A file seen in the inbox that is not processed yet */
+        struct Candidate
+        {
+            uint64_t size{ 0 };
+            std::filesystem::file_time_type modified;
+            Clock::time_point stable_since;
+            /* failed files are only tried again once they change */
+            bool failed{ false };
+        };
+
+        Options _options;
+        batch::Progress _progress;
+        HANDLE _stop_event{ nullptr };
+        std::atomic<bool> _polling{ false };
+        std::map<std::string, Candidate> _candidates;
+        std::shared_ptr<const std::vector<uint8_t>> _recipient;
+
+        /* @brief Look at the inbox and update the candidates
+        @param pending: receives whether files are still settling
+        @return The files that are complete */
+        std::vector<std::string> scan(bool& pending);
+
+        /* @brief Encrypt the files and move or delete the originals */
+        void process(const std::vector<std::string>& files, const batch::WorkerFactory& factory);
+
+        OpRes finish_original(const std::string& file);
+    public:
+        /* @param progress: called for every file that was processed */
+        Watcher(Options options, batch::Progress progress = {});
+        Watcher(const Watcher&) = delete;
+        ~Watcher();
+
+        /* @brief Watch until stop is called, blocks
+        @return An error if watching could not be started */
+        OpRes run();
+
+        /* @brief Make run return, can be called from any thread */
+        void stop();
+
+        /* @return True if the inbox could not be watched and is being polled */
+        bool polling() const { return _polling; }
+    };
+}
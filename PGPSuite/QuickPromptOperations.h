@@ -27,8 +27,14 @@
 #include <wx/wxprec.h>
 #include "rnp_wrappers.h"
 #include "PGPDecrypt.h"
+#include "PGPArchive.h"
+#include "PGPAutoTune.h"
+#include "PGPBatch.h"
 #include <wx/statline.h>
 #include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
 
 namespace suite
 {
@@ -87,6 +93,43 @@ namespace suite
 			return input_sizer;
 		}
 
+		/* @brief Label describing the files a quick prompt works on */
+		inline wxString describe_files(const std::vector<std::wstring>& files)
+		{
+			if (files.size() == 1) return _("File: ") + wxString(std::filesystem::path(files.front()).filename().wstring());
+			return wxString::Format(_("%zu files"), files.size());
+		}
+
+		/* @brief Run the files through the batch pipeline and tell the user how it went
+		@param make_destination: turns a source path into the path of the result */
+		inline void run_batch(wxWindow* parent, const std::vector<std::wstring>& files, pgp::batch::WorkerFactory factory, std::function<std::string(const std::string&)> make_destination)
+		{
+			std::vector<pgp::batch::Job> jobs;
+			for (const auto& file : files)
+			{
+				const auto source = pgp::utils::utf8_encode(file);
+				jobs.push_back({ source, make_destination(source) });
+			}
+
+			wxBusyCursor busy;
+			const auto results = pgp::batch::run(jobs, std::move(factory));
+
+			size_t failed{ 0 };
+			wxString failures;
+			for (const auto& result : results)
+			{
+				if (result.result) continue;
+
+				/* the first few are enough to see what went wrong */
+				if (failed++ < 5) failures += wxString::FromUTF8(result.source) + ": " + wxString::FromUTF8(result.result.what()) + "\n";
+			}
+
+			if (failed == 0)
+				wxMessageBox(wxString::Format(_("Successfully processed %zu files."), results.size()), _("Success!"), wxOK, parent);
+			else
+				wxMessageBox(wxString::Format(_("%zu of %zu files failed.\n\n"), failed, results.size()) + failures, _("Error"), wxICON_ERROR, parent);
+		}
+
 		/* 
 		@param map map with wxTextControl's
 		@param key key to query */
@@ -106,7 +149,27 @@ namespace suite
 		enum class TextInput { PublicKey, KeyID, Password };
 
 		std::unordered_map<TextInput, wxTextCtrl*> _textfields;
+		/* the file it was started for, and those forwarded by later invocations */
+		std::vector<std::wstring> _files;
+		wxStaticText* _files_text{ nullptr };
 	public:
+		/* @brief Add files forwarded by another invocation, they are encrypted together
+		@return False if the frame is closing and the files were not taken */
+		bool add_files(const std::vector<wxString>& files)
+		{
+			if (IsBeingDeleted()) return false;
+
+			for (const auto& file : files)
+			{
+				if (std::find(_files.begin(), _files.end(), file.ToStdWstring()) == _files.end())
+					_files.push_back(file.ToStdWstring());
+			}
+
+			_files_text->SetLabel(describe_files(_files));
+			Layout();
+			return true;
+		}
+
 		EncryptFrame(int argc, wxCmdLineArgsArray& args)
 			: wxFrame(NULL, wxID_ANY, "PGPSuite")
 		{
@@ -121,7 +184,9 @@ namespace suite
 			auto panel_sizer = new wxBoxSizer(wxVERTICAL);
 			panel->SetSizer(panel_sizer);
 
-			auto filename = std::wstring(args[2].wc_str());
+			_files.push_back(std::wstring(args[2].wc_str()));
+			_files_text = new wxStaticText(panel, wxID_ANY, describe_files(_files));
+			panel_sizer->Add(_files_text, 0, wxTOP | wxLEFT, 15);
 
 			auto* clear_file_button = new wxButton(panel, ID_SELECT_KEYFILE, _("File..."));
 			auto* inputsizer = create_input_box(_textfields, panel, _("Public key"), TextInput::PublicKey, clear_file_button);
@@ -146,7 +211,7 @@ namespace suite
 			sizer->Fit(this);
 			Layout();
 
-			Bind(wxEVT_BUTTON, [this, filename, choice](wxCommandEvent&)
+			Bind(wxEVT_BUTTON, [this, choice](wxCommandEvent&)
 				{
 					auto filedata = std::vector<char>{};
 					auto password = if_map_has(_textfields, TextInput::Password);
@@ -158,6 +223,16 @@ namespace suite
 						return;
 					}
 
+					if (_files.size() > 1)
+					{ /* the keyring is loaded once per worker instead of once per file */
+						wxString keyid = choice->IsEmpty() ? _("") : io::wxget_value<wxChoice>(choice);
+						run_batch(this, _files, pgp::batch::encrypt_worker(pub_key, std::string(keyid.mbc_str()), password, pgp::tune::enabled() && pgp::tune::ready()),
+							[](const std::string& name) { return name + ".asc"; });
+						return;
+					}
+
+					const auto& filename = _files.front();
+
 					try
 					{
 						filedata = io::read_file_bytes(filename);
@@ -171,7 +246,9 @@ namespace suite
 					auto save_as_filename = pgp::utils::utf8_encode(filename) + ".asc";
 
 					wxString keyid = choice->IsEmpty() ? _("") : io::wxget_value<wxChoice>(choice);
-					const auto res = pgp::encrypt_text((uint8_t*)filedata.data(), filedata.size(), pub_key, std::string(keyid.mbc_str()), save_as_filename, password);
+					/* the defaults are used until the calibration in the background is done */
+					const auto options = pgp::tune::enabled() && pgp::tune::ready() ? pgp::tune::choose((uint8_t*)filedata.data(), filedata.size()) : pgp::EncryptOptions{};
+					const auto res = pgp::encrypt_text((uint8_t*)filedata.data(), filedata.size(), pub_key, std::string(keyid.mbc_str()), save_as_filename, password, options);
 
 					if (res)
 						wxMessageBox(_("Success"));
@@ -227,7 +304,58 @@ namespace suite
 		enum class TextInput { SecretKey, Password };
 
 		std::unordered_map<TextInput, wxTextCtrl*> _textfields;
+		/* the file it was started for, and those forwarded by later invocations */
+		std::vector<std::wstring> _files;
+		wxStaticText* _files_text{ nullptr };
 	public:
+		/* @brief Add files forwarded by another invocation, they are decrypted together
+		@return False if the frame is closing and the files were not taken */
+		bool add_files(const std::vector<wxString>& files)
+		{
+			/* no _files_text if the first file could not be decrypted, the frame destroys itself then */
+			if (_files_text == nullptr || IsBeingDeleted()) return false;
+
+			for (const auto& file : files)
+			{
+				if (std::find(_files.begin(), _files.end(), file.ToStdWstring()) == _files.end())
+					_files.push_back(file.ToStdWstring());
+			}
+
+			_files_text->SetLabel(describe_files(_files));
+			Layout();
+			return true;
+		}
+
+		/* @brief Decrypt all files with one prompt, archives are extracted one by one, everything else goes through the batch pipeline */
+		void decrypt_files(const rnp::PacketInfo& packet, const std::string& secret_key, std::string password)
+		{
+			/* one password for every file, the workers can not ask */
+			if (password.empty() && packet.key_protected())
+				password = std::string(io::text_prompt(_("Password"), _("Password of the secret key")).utf8_str());
+
+			std::vector<std::wstring> messages;
+			wxString failures;
+
+			for (const auto& file : _files)
+			{
+				const auto name = pgp::utils::utf8_encode(file);
+
+				if (!pgp::archive::is_archive_name(name))
+				{
+					messages.push_back(file);
+					continue;
+				}
+
+				const auto res = pgp::archive::decrypt_archive(name, {}, pgp::context_pass_provider, &password, secret_key);
+				if (!res) failures += wxString::FromUTF8(name) + ": " + wxString::FromUTF8(res.what()) + "\n";
+			}
+
+			if (!failures.empty()) wxMessageBox(_("Some archives failed.\n\n") + failures, _("Error"), wxICON_ERROR, this);
+
+			if (!messages.empty())
+				run_batch(this, messages, pgp::batch::decrypt_worker(secret_key, password), pgp::utils::remove_extension);
+		}
+
 		DecryptFrame(int argc, wxCmdLineArgsArray& args)
 			: wxFrame(NULL, wxID_ANY, "PGPSuite")
 		{
@@ -245,6 +373,10 @@ namespace suite
 			auto main_sizer = new wxBoxSizer(wxVERTICAL);
 			panel->SetSizer(main_sizer);
 
+			_files.push_back(std::wstring(args[1].wc_str()));
+			_files_text = new wxStaticText(panel, wxID_ANY, describe_files(_files));
+			main_sizer->Add(_files_text, 0, wxTOP | wxLEFT, 15);
+
 			if (info.key_protected())
 			{
 				auto key_sizer = create_input_box(_textfields, panel, _("Secret key: "), TextInput::SecretKey, new wxButton(panel, ID_SELECT_KEYFILE, _("file...")));
@@ -265,6 +397,7 @@ namespace suite
 			if (!info.password_protected() && !info.key_protected())
 			{
 				wxMessageBox(_("This is not a compatible .asc file."), _("Error"));
+				_files_text = nullptr;
 				Destroy();
 				return;
 			}
@@ -314,6 +447,23 @@ namespace suite
 						return;
 					}
 
+					if (_files.size() > 1)
+					{
+						decrypt_files(packet, secret_key, password);
+						return;
+					}
+
+					if (pgp::archive::is_archive_name(filename))
+					{ /* archives are extracted next to the encrypted file */
+						const auto res = pgp::archive::decrypt_archive(filename, {}, passprovider, password.size() > 0 ? &password : NULL, secret_key);
+
+						if (res)
+							wxMessageBox(_("Successfully decrypted archive.\n") + _("Extracted archive next to: ") + _(filename), _("Success!"));
+						else
+							wxMessageBox(_(res.what()), _("Error"), wxICON_ERROR);
+						return;
+					}
+
 					const auto res = pgp::decrypt_text(filename, "", passprovider, password.size() > 0 ? &password : NULL, secret_key);
 
 					if (res)
@@ -0,0 +1,146 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <wx/wxprec.h>
+
+#ifndef WX_PRECOMP
+#include <wx/wx.h>
+#endif
+
+#include <wx/ipc.h>
+#include <wx/snglinst.h>
+#include <wx/tokenzr.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* Selecting many files in explorer and picking a context menu action starts one process per file,
+* the first process of an action keeps running and every later one hands its file to it and exits,
+* so all files end up in one window with one prompt */
+namespace suite::instance
+{
+    /* Receives the files forwarded by later invocations, on the gui thread
+    * returns false if it could not take them, the invocation that sent them then handles them itself */
+    using FilesHandler = std::function<bool(const std::vector<wxString>&)>;
+
+    namespace intern
+    {
+        constexpr const char* topic = "files";
+
+        class FilesConnection : public wxConnection
+        {
+        protected:
+            FilesHandler _handler;
+        public:
+            FilesConnection(FilesHandler handler) : _handler(std::move(handler)) {}
+
+            /* every forwarded invocation executes its paths, one per line, failing the execute tells it the files were not taken */
+            bool OnExec(const wxString&, const wxString& data) override
+            {
+                std::vector<wxString> files;
+                wxStringTokenizer tokens(data, "\n", wxTOKEN_STRTOK);
+
+                while (tokens.HasMoreTokens()) files.push_back(tokens.GetNextToken());
+
+                return files.empty() || _handler(files);
+            }
+        };
+
+        class FilesServer : public wxServer
+        {
+        protected:
+            FilesHandler _handler;
+        public:
+            FilesServer(FilesHandler handler) : _handler(std::move(handler)) {}
+
+            wxConnectionBase* OnAcceptConnection(const wxString& requested_topic) override
+            {
+                if (requested_topic != topic) return nullptr;
+                return new FilesConnection(_handler);
+            }
+        };
+    }
+
+    class Forwarding
+    {
+    protected:
+        wxString _service;
+        wxSingleInstanceChecker _checker;
+        std::unique_ptr<intern::FilesServer> _server;
+    public:
+        /* @param action: every action gathers its own files, e.g. "encrypt" and "decrypt" */
+        explicit Forwarding(const wxString& action)
+            : _service("PGPSuite-" + action + "-" + wxGetUserId())
+        {
+            _checker.Create(_service + ".lock");
+        }
+
+        Forwarding(const Forwarding&) = delete;
+
+        /* @return True if another process already handles this action */
+        bool is_another_running() const { return _checker.IsAnotherRunning(); }
+
+        /* @brief Hand the files to the process that handles this action
+        * That process may have only just started, so it gets a moment to start listening
+        @return False if it could not be reached or refused the files, they should then be handled here */
+        bool forward(const std::vector<wxString>& files)
+        {
+            wxString data;
+            for (const auto& file : files) data += file + "\n";
+
+            wxLogNull no_log; /* failed attempts are expected while the other process starts */
+            const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+
+            do
+            {
+                wxClient client;
+                std::unique_ptr<wxConnectionBase> connection(client.MakeConnection("localhost", _service, intern::topic));
+
+                if (connection)
+                {
+                    const bool sent = connection->Execute(data);
+                    connection->Disconnect();
+
+                    /* it answered but did not take the files, e.g. its window is closing, waiting will not change that */
+                    return sent;
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            } while (std::chrono::steady_clock::now() < give_up);
+
+            return false;
+        }
+
+        /* @brief Start accepting files from later invocations of this action */
+        bool serve(FilesHandler handler)
+        {
+            _server = std::make_unique<intern::FilesServer>(std::move(handler));
+            return _server->Create(_service);
+        }
+    };
+}
@@ -0,0 +1,126 @@
+#include "StreamingText.h"
+
+#include <algorithm>
+
+void pgp::StreamingText::reserve(size_t size)
+{
+    std::lock_guard lock(_mutex);
+    _data.reserve(size);
+}
+
+void pgp::StreamingText::append(const uint8_t* data, size_t size)
+{
+    std::lock_guard lock(_mutex);
+
+    const auto offset = _data.size();
+    _data.insert(_data.end(), data, data + size);
+
+    size_t length = offset - _line_starts.back();
+
+    for (size_t i = offset; i < _data.size(); i++)
+    {
+        const auto c = static_cast<uint8_t>(_data[i]);
+
+        if (c == '\n')
+        {
+            _longest_line = std::max(_longest_line, length);
+            _line_starts.push_back(i + 1);
+            length = 0;
+            continue;
+        }
+
+        /* wrap, but never in the middle of a utf-8 sequence */
+        if (length >= max_line_length && (c & 0xc0) != 0x80)
+        {
+            _longest_line = std::max(_longest_line, length);
+            _line_starts.push_back(i);
+            length = 0;
+        }
+
+        length++;
+    }
+
+    _longest_line = std::max(_longest_line, length);
+}
+
+void pgp::StreamingText::finish(OpRes result)
+{
+    std::lock_guard lock(_mutex);
+    _result = std::move(result);
+    _finished = true;
+}
+
+void pgp::StreamingText::clear()
+{
+    std::lock_guard lock(_mutex);
+    _data.clear();
+    _data.shrink_to_fit();
+    _line_starts = { 0 };
+    _longest_line = 0;
+}
+
+size_t pgp::StreamingText::size() const
+{
+    std::lock_guard lock(_mutex);
+    return _data.size();
+}
+
+size_t pgp::StreamingText::line_count() const
+{
+    std::lock_guard lock(_mutex);
+
+    if (_data.empty()) return 0;
+
+    /* a trailing line break does not start another line */
+    return _line_starts.back() == _data.size() ? _line_starts.size() - 1 : _line_starts.size();
+}
+
+size_t pgp::StreamingText::longest_line() const
+{
+    std::lock_guard lock(_mutex);
+    return _longest_line;
+}
+
+bool pgp::StreamingText::finished() const
+{
+    std::lock_guard lock(_mutex);
+    return _finished;
+}
+
+pgp::OpRes pgp::StreamingText::result() const
+{
+    std::lock_guard lock(_mutex);
+    return _result;
+}
+
+std::string pgp::StreamingText::line(size_t index) const
+{
+    std::lock_guard lock(_mutex);
+
+    if (index >= _line_starts.size()) return {};
+
+    const auto start = _line_starts[index];
+    auto end = index + 1 < _line_starts.size() ? _line_starts[index + 1] : _data.size();
+
+    /* strip \n and \r\n, wrapped lines have neither */
+    if (end > start && _data[end - 1] == '\n') end--;
+    if (end > start && _data[end - 1] == '\r') end--;
+
+    return std::string(_data.begin() + start, _data.begin() + end);
+}
+
+std::vector<char> pgp::StreamingText::data() const
+{
+    std::lock_guard lock(_mutex);
+    return _data;
+}
+
+bool pgp::StreamingText::writer_callback(void* app_ctx, const void* buf, size_t len)
+{
+    auto* text = static_cast<StreamingText*>(app_ctx);
+
+    if (text->cancelled()) return false;
+
+    text->append(static_cast<const uint8_t*>(buf), len);
+    return true;
+}
@@ -0,0 +1,85 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pgpsuite_common.h"
+
+namespace pgp
+{
+    /* Text that is still being produced, e.g. by a decryption running on another thread
+    * Lines are indexed as the data comes in, so any line can be looked up without scanning the text */
+    class StreamingText
+    {
+    protected:
+        mutable std::mutex _mutex;
+        std::vector<char> _data;
+        std::vector<size_t> _line_starts{ 0 };
+        size_t _longest_line{ 0 };
+        bool _finished{ false };
+        OpRes _result;
+        std::atomic<bool> _cancelled{ false };
+    public:
+        /* longer lines are wrapped, so text without line breaks still shows up in pieces */
+        static constexpr size_t max_line_length{ 4096 };
+
+        /* @brief Reserve memory up front, so appending does not have to move what is already there */
+        void reserve(size_t size);
+
+        /* @brief Add data and index the lines in it */
+        void append(const uint8_t* data, size_t size);
+
+        /* @brief No more data will follow
+        @param result: outcome of whatever produced the text */
+        void finish(OpRes result);
+
+        /* @brief Throw away everything received, for text that turned out not to be trustworthy */
+        void clear();
+
+        /* @brief Ask the producer to stop, appending fails from now on */
+        void cancel() { _cancelled = true; }
+        bool cancelled() const { return _cancelled; }
+
+        size_t size() const;
+        size_t line_count() const;
+        /* @return Length in bytes of the longest line so far */
+        size_t longest_line() const;
+        bool finished() const;
+        OpRes result() const;
+
+        /* @return Line at index without its line ending, empty if there is no such line */
+        std::string line(size_t index) const;
+
+        /* @return Copy of everything received so far */
+        std::vector<char> data() const;
+
+        /* rnp output writer that appends to the StreamingText passed as context, fails once cancelled */
+        static bool writer_callback(void* app_ctx, const void* buf, size_t len);
+    };
+}
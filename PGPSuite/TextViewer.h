@@ -0,0 +1,202 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <wx/wxprec.h>
+
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <wx/listctrl.h>
+#include <wx/timer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include "PGPDecrypt.h"
+#include "IOwx.h"
+#include "Tracing.h"
+
+namespace suite
+{
+    /* list that only asks for the lines that are visible, so a huge text costs no more than a small one */
+    class VirtualTextList :
+        public wxListCtrl
+    {
+    protected:
+        std::shared_ptr<pgp::StreamingText> _text;
+
+        wxString OnGetItemText(long item, long column) const override
+        {
+            return wxString::FromUTF8(_text->line(static_cast<size_t>(item)));
+        }
+    public:
+        VirtualTextList(wxWindow* parent, std::shared_ptr<pgp::StreamingText> text)
+            : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_NO_HEADER | wxLC_SINGLE_SEL),
+            _text(std::move(text))
+        {
+            SetFont(wxFont(wxFontInfo().Family(wxFONTFAMILY_TELETYPE)));
+            InsertColumn(0, wxEmptyString);
+        }
+
+        /* @brief Pick up the lines that arrived since the last call */
+        void update()
+        {
+            const auto count = static_cast<long>(_text->line_count());
+            /* the last line might have grown, also when no line was added */
+            const auto first_changed = GetItemCount() > 0 ? GetItemCount() - 1 : 0;
+
+            if (count != GetItemCount()) SetItemCount(count);
+            if (count > 0) RefreshItems(std::min(first_changed, count - 1), count - 1);
+
+            /* widen the column so the longest line can be scrolled to */
+            const auto width = static_cast<int>(_text->longest_line() + 2) * GetCharWidth();
+            if (width > GetColumnWidth(0)) SetColumnWidth(0, width);
+        }
+    };
+
+    /* Window that shows a decrypted file without writing it to disk,
+    * the first lines show up while the rest is still being decrypted */
+    class TextViewer :
+        public wxFrame
+    {
+    protected:
+        std::shared_ptr<pgp::StreamingText> _text{ std::make_shared<pgp::StreamingText>() };
+        wxTimer _timer;
+        wxString _title;
+        VirtualTextList* _list{};
+        wxButton* _save_button{};
+
+        /* asks the gui thread for the password and waits for it, gives up if the viewer is closed meanwhile
+        * app_ctx is the shared_ptr of the text, so the queued prompt can still tell whether the viewer was closed */
+        static bool passprovider(rnp_ffi_t, void* app_ctx, rnp_key_handle_t, const char* pgp_context, char buf[], size_t buf_len)
+        {
+            const auto text = *static_cast<const std::shared_ptr<pgp::StreamingText>*>(app_ctx);
+            auto answer = std::make_shared<std::promise<wxString>>();
+            auto future = answer->get_future();
+            const wxString reason = rnp::get_password_acquisition_reason(pgp_context);
+
+            wxTheApp->CallAfter([answer, reason, text]
+                {
+                    /* no prompt for a viewer that is gone */
+                    answer->set_value(text->cancelled() ? wxString() : io::text_prompt(_("Please enter a password"), reason));
+                });
+
+            while (future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+            {
+                if (text->cancelled()) return false;
+            }
+
+            const auto input = future.get();
+            pgp::utils::copy_to_ctype(input, buf, buf_len);
+
+            return input.size() > 0;
+        }
+
+        void on_timer(wxTimerEvent&)
+        {
+            _list->update();
+
+            const auto finished = _text->finished();
+            const auto size = static_cast<double>(_text->size()) / (1024 * 1024);
+
+            SetStatusText(wxString::Format(finished ? _("%zu lines, %.1f MiB") : _("Decrypting... %zu lines, %.1f MiB, not verified yet"),
+                _text->line_count(), size));
+
+            if (!finished) return;
+
+            _timer.Stop();
+
+            /* the integrity of the text is only known once all of it was decrypted, whatever was shown of a bad one goes away */
+            if (auto res = _text->result(); !res)
+            {
+                _text->clear();
+                _list->update();
+                SetStatusText(_("Decryption failed, the text was discarded"));
+                wxMessageBox(_(res.what()), _("Failed!"));
+                return;
+            }
+
+            SetTitle(_title);
+            _save_button->Enable();
+        }
+
+        void on_save(wxCommandEvent&)
+        {
+            const auto path = io::file_select_prompt(this, "All files|*", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+            if (path.empty()) return;
+
+            const auto data = _text->data();
+            std::ofstream file(pgp::utils::to_path(std::string(path.utf8_str())), std::ios::binary | std::ios::trunc);
+
+            if (!file.write(data.data(), data.size()))
+                wxMessageBox(_("Failed writing: ") + path, _("Failed!"));
+        }
+    public:
+        /* @param encrypted_file: file to decrypt and show
+        @param secring_file: secret keyring, may be empty for password encrypted files */
+        TextViewer(wxWindow* parent, const std::string& encrypted_file, const std::string& secring_file)
+            : wxFrame(parent, wxID_ANY, wxString::FromUTF8(encrypted_file), wxDefaultPosition, wxSize(800, 600)),
+            _timer(this), _title(wxString::FromUTF8(encrypted_file))
+        {
+            SetTitle(_title + _(" (unverified)"));
+
+            auto main_sizer = new wxBoxSizer(wxVERTICAL);
+
+            _list = new VirtualTextList(this, _text);
+            main_sizer->Add(_list, 1, wxGROW);
+
+            _save_button = new wxButton(this, wxID_SAVEAS, _("Save as..."));
+            _save_button->Disable();
+            main_sizer->Add(_save_button, 0, wxALL, 5);
+
+            CreateStatusBar();
+            SetSizer(main_sizer);
+
+            Bind(wxEVT_TIMER, &TextViewer::on_timer, this);
+            Bind(wxEVT_BUTTON, &TextViewer::on_save, this, wxID_SAVEAS);
+
+            /* the worker shares the text, so it can finish on its own after the viewer is closed */
+            std::thread([text = _text, encrypted_file, secring_file]() mutable
+                {
+                    pgp::trace::name_thread("decrypt view");
+                    pgp::decrypt_to_text(encrypted_file, *text, passprovider, &text, secring_file);
+                }).detach();
+
+            _timer.Start(100);
+        }
+
+        ~TextViewer()
+        {
+            /* the decryption stops at the next block it would have written, there is no need to wait for that */
+            _text->cancel();
+            _timer.Stop();
+        }
+    };
+}
@@ -0,0 +1,219 @@
+#include "Tracing.h"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include <Windows.h>
+
+std::atomic<bool> pgp::trace::intern::active{ false };
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Event
+    {
+        const char* name;
+        std::string detail;
+        Clock::time_point start;
+        Clock::duration duration;
+    };
+
+    /* Every thread records into its own buffer, the lock is only contended while writing the file */
+    struct ThreadBuffer
+    {
+        std::mutex mutex;
+        unsigned long tid{ GetCurrentThreadId() };
+        std::string name;
+        std::vector<Event> events;
+        bool finished{ false }; /* the thread ended, dropped once its events are written */
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        Clock::time_point origin{ Clock::now() };
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    /* Per thread state, a buffer is only registered once the thread records something while tracing is on */
+    struct ThreadSlot
+    {
+        std::string name;
+        std::shared_ptr<ThreadBuffer> buffer;
+
+        ~ThreadSlot()
+        {
+            if (!buffer) return;
+
+            std::lock_guard lock(buffer->mutex);
+            buffer->finished = true;
+        }
+    };
+
+    ThreadSlot& thread_slot()
+    {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    ThreadBuffer& thread_buffer()
+    {
+        auto& slot = thread_slot();
+        if (slot.buffer) return *slot.buffer;
+
+        slot.buffer = std::make_shared<ThreadBuffer>();
+        slot.buffer->name = slot.name;
+
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        reg.buffers.push_back(slot.buffer);
+
+        return *slot.buffer;
+    }
+
+    /* @brief Forget the buffers of threads that ended, the registry lock has to be held */
+    void drop_finished(Registry& reg)
+    {
+        std::erase_if(reg.buffers, [](const std::shared_ptr<ThreadBuffer>& buffer)
+            {
+                std::lock_guard lock(buffer->mutex);
+                return buffer->finished;
+            });
+    }
+
+    std::string escape(const std::string& str)
+    {
+        std::string out;
+        out.reserve(str.size());
+
+        for (const char c : str)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) continue;
+                out += c;
+            }
+        }
+
+        return out;
+    }
+
+    double micros(Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+}
+
+void pgp::trace::start()
+{
+    auto& reg = registry();
+    {
+        std::lock_guard lock(reg.mutex);
+
+        for (auto& buffer : reg.buffers)
+        {
+            std::lock_guard buffer_lock(buffer->mutex);
+            buffer->events.clear();
+        }
+
+        drop_finished(reg);
+        reg.origin = Clock::now();
+    }
+
+    intern::active.store(true);
+}
+
+pgp::OpRes pgp::trace::stop(const std::string& path)
+{
+    intern::active.store(false);
+
+    auto& reg = registry();
+    std::ostringstream out;
+    const auto pid = GetCurrentProcessId();
+    bool first = true;
+
+    auto separator = [&]() -> std::ostringstream&
+    {
+        if (!first) out << ",\n";
+        first = false;
+        return out;
+    };
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    {
+        std::lock_guard lock(reg.mutex);
+
+        for (auto& buffer : reg.buffers)
+        {
+            std::lock_guard buffer_lock(buffer->mutex);
+
+            if (!buffer->name.empty())
+                separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+                    << ",\"args\":{\"name\":\"" << escape(buffer->name) << "\"}}";
+
+            for (const auto& event : buffer->events)
+            {
+                separator() << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\"pgp\",\"ph\":\"X\",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->tid << ",\"ts\":" << micros(event.start - reg.origin) << ",\"dur\":" << micros(event.duration);
+
+                if (!event.detail.empty()) out << ",\"args\":{\"detail\":\"" << escape(event.detail) << "\"}";
+
+                out << '}';
+            }
+
+            buffer->events.clear();
+        }
+
+        drop_finished(reg);
+    }
+    out << "\n]}\n";
+
+    if (path.empty()) return true;
+
+    std::ofstream file(std::filesystem::path(std::u8string(path.begin(), path.end())), std::ios::binary | std::ios::trunc);
+    const auto json = out.str();
+
+    if (!file.write(json.data(), json.size())) return "Failed writing trace: " + path;
+
+    return true;
+}
+
+void pgp::trace::name_thread(const std::string& name)
+{
+    auto& slot = thread_slot();
+    slot.name = name;
+
+    /* without a buffer the name is picked up when the thread records its first span */
+    if (!slot.buffer) return;
+
+    std::lock_guard lock(slot.buffer->mutex);
+    slot.buffer->name = name;
+}
+
+pgp::trace::Span::~Span()
+{
+    /* spans that outlive the recording are dropped */
+    if (_name == nullptr || !enabled()) return;
+
+    const auto end = Clock::now();
+    auto& buffer = thread_buffer();
+
+    std::lock_guard lock(buffer.mutex);
+    buffer.events.push_back({ _name, std::move(_detail), _start, end - _start });
+}
@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright (c) 2018-2023
+ * Author: WebSec B.V.
+ * Developer: Koen Blok
+ * Website: https://websec.nl
+ *
+ * Permission to use, copy, modify, distribute this software
+ * and its documentation for non-commercial purposes is hereby granted exclusivley
+ * under the terms of the GNU GPLv3 License.
+ *
+ * Most importantly:
+ *  1. The above copyright notice appear in all copies and supporting documents.
+ *  2. The application / code will not be used or reused for commercial purposes.
+ *  3. All modifications are documented.
+ *  4. All new releases will remain open source and contain the same license.
+ *
+ * WebSec B.V. makes no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * please read the full license agreement for more information:
+ * https://github.com/websecnl/PGPSuite/LICENSE.md
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "pgpsuite_common.h"
+
+/* Records spans in the Chrome trace event format, open the written file in chrome://tracing or ui.perfetto.dev
+* While tracing is off a span costs a single atomic load */
+namespace pgp::trace
+{
+    namespace intern
+    {
+        extern std::atomic<bool> active;
+    }
+
+    inline bool enabled() { return intern::active.load(std::memory_order_relaxed); }
+
+    /* @brief Start recording, events of an earlier recording are discarded */
+    void start();
+
+    /* @brief Stop recording and write everything recorded to a json file
+    @param path: file to write, the recording is discarded if empty */
+    OpRes stop(const std::string& path);
+
+    /* @brief Give the calling thread a name in the trace */
+    void name_thread(const std::string& name);
+
+    /* Measures the lifetime of a scope */
+    class Span
+    {
+    protected:
+        const char* _name{ nullptr }; /* nullptr if tracing was off when the span started */
+        std::string _detail;
+        std::chrono::steady_clock::time_point _start;
+    public:
+        /* @param name: has to outlive the recording, use string literals */
+        explicit Span(const char* name)
+        {
+            if (!enabled()) return;
+            _name = name;
+            _start = std::chrono::steady_clock::now();
+        }
+
+        /* @param detail: shown as argument of the event, a filename for example */
+        Span(const char* name, const std::string& detail)
+            : Span(name)
+        {
+            if (_name) _detail = detail;
+        }
+
+        Span(const Span&) = delete;
+        ~Span();
+    };
+}
@@ -29,8 +29,10 @@
 #include <string>
 #include <algorithm>
 #include <optional>
+#include <filesystem>
 
 #include "pgpsuite_common.h"
+#include "PGPKeyStore.h"
 
 namespace pgp::utils
 {
@@ -56,6 +58,27 @@ namespace pgp::utils
         return wstrTo;
     }
 
+    /* Convert an UTF8 string to a path, plain std::string constructors would use the ANSI code page */
+    inline std::filesystem::path to_path(const std::string& str)
+    {
+        return std::filesystem::path(std::u8string(str.begin(), str.end()));
+    }
+
+    /* Convert a path to an UTF8 string, which is what rnp expects for filenames */
+    inline std::string from_path(const std::filesystem::path& path)
+    {
+        const auto str = path.u8string();
+        return std::string(str.begin(), str.end());
+    }
+
+    /* @return Size of the file at the UTF8 path, 0 if it does not exist */
+    inline uint64_t file_size(const std::string& str)
+    {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(to_path(str), ec);
+        return ec ? 0 : size;
+    }
+
     /* @brief Will remove anything after the first '.' encountered
     something.exe -> something
     some.thing.exe -> some.thing */
@@ -122,21 +145,17 @@ namespace pgp::utils
     inline bool add_keys_to_choice(std::string pubkey_fname, wxChoice* choices)
     {
         rnp::FFI ffi("GPG", "GPG");
-        rnp::Input key_input{};
-        rnp_key_handle_t key{};
-        rnp_identifier_iterator_t it{};
+        rnp::IdentifierIterator it;
         wxArrayString keyids{};
-        char* keyid{ nullptr };
+        const char* keyid{ nullptr };
 
-        key_input.set_input_from_path(std::move(pubkey_fname));
-        if (auto res = rnp_load_keys(ffi, "GPG", key_input, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS) return false;
+        if (!keystore::load_public_keys(ffi, pubkey_fname)) return false;
 
-        rnp_identifier_iterator_create(ffi, &it, "userid");
+        if (rnp_identifier_iterator_create(ffi, it.put(), "userid") != RNP_SUCCESS) return false;
         while (true)
         {
-            auto res = rnp_identifier_iterator_next(it, (const char**)&keyid);
-
-            if (res != RNP_SUCCESS) return false;
+            /* the identifier is owned by the iterator */
+            if (rnp_identifier_iterator_next(it, &keyid) != RNP_SUCCESS) return false;
             if (keyid == NULL) break;
 
             keyids.Add(_(keyid));
@@ -144,10 +163,6 @@ namespace pgp::utils
 
         choices->Set(keyids);
 
-        rnp_key_handle_destroy(key);
-        rnp_buffer_destroy(keyid);
-        rnp_identifier_iterator_destroy(it);
-
         return true;
     }
 }
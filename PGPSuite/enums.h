@@ -35,20 +35,25 @@ namespace suite
         ID_OPEN_ENC_FILE,
         ID_OPEN_FILE,
         ID_EDIT_TEXT,
+        ID_OPEN_FOLDER,
 
         /* actions */
         ID_GENERATE_KEY,
         ID_ENCRYPT_FILE,
         ID_DECRYPT_FILE,
+        ID_DECRYPT_VIEW,
         ID_ENC_TYPE_RADIO_CHANGED,
         ID_SHOW_GENERATE_SETTINGS,
         ID_CHECK_VERSION,
         ID_STARTUP_CHECKBOX_SETTING,
         ID_KEYID_SELECTION,
+        ID_KEY_PROFILE_SELECTION,
+        ID_BENCHMARK_PROFILES,
 
         /* menu's */
         ID_REGISTER_EXTENSION,
         ID_UNREGISTER_EXTENSION,
+        ID_TOGGLE_TRACE,
 
         /* unused */
         ID_SAVE_FILE,
@@ -178,10 +178,10 @@ bool encrypt_text(std::string message)
 {
     rnp::Input input_message;
     rnp::Output output_message;
-    rnp_key_handle_t key = nullptr;
 
     rnp::Input input_key;
     rnp::FFI ffi("GPG", "GPG");
+    rnp::KeyHandle key;
 
     /* Load key file */
     if (input_key.set_input_from_path("pubring.pgp") != RNP_SUCCESS) return false;
@@ -192,7 +192,8 @@ bool encrypt_text(std::string message)
     /* Prepare the output for the encrypted message */
     if (output_message.set_output_to_path("password_protected.asc") != RNP_SUCCESS) return false;
 
-    rnp::EncryptOperation op(ffi, input_message, output_message);
+    rnp::EncryptOperation op;
+    if (op.create(ffi, input_message, output_message) != RNP_SUCCESS) return false;
 
     /* Attempt to read pubring.pgp for its keys */
     if (rnp_load_keys(ffi, "GPG", input_key, RNP_LOAD_SAVE_PUBLIC_KEYS) != RNP_SUCCESS)
@@ -213,7 +214,7 @@ bool encrypt_text(std::string message)
     op.set_password("cool-wachtwoord", RNP_ALGNAME_SHA256, 0, RNP_ALGNAME_AES_256);
 
     /* Locate key using the userid and load it into the key_handle_t */
-    if (rnp_locate_key(ffi, "userid", "rsa@key", &key) != RNP_SUCCESS)
+    if (rnp_locate_key(ffi, "userid", "rsa@key", key.put()) != RNP_SUCCESS)
     {
         std::cerr << "failed to locate recipient key rsa@key\n";
         return false;
@@ -221,9 +222,6 @@ bool encrypt_text(std::string message)
     
     /* Recipient public key */
     if (op.add_recipient(key) != RNP_SUCCESS) return false;
-    
-    rnp_key_handle_destroy(key);
-    key = nullptr;
 
     if (op.execute() != RNP_SUCCESS) return false;
     
@@ -23,6 +23,7 @@
  */
 #pragma once
 
+#include <memory>
 #include <string>
 
 /* Used to check if an rnp function resulted in success */
@@ -30,12 +31,15 @@ constexpr int RNP_SUCCESS{ 0 };
 
 namespace pgp
 {
+	struct Metrics; /* see Metrics.h */
+
 	/* Operation Result
 	To be returned by pgp operations, if OpRes::_what is not empty there is an error */
 	struct OpRes
 	{
 	private:
 		std::string _what;
+		std::shared_ptr<Metrics> _metrics;
 	public:	
 		OpRes() = default;
 		/* @param no_err: True if no error, False if error */
@@ -58,5 +62,15 @@ namespace pgp
 		{
 			return _what;
 		}
+
+		/* @return Measurements of the operation, nullptr if none were recorded */
+		const Metrics* metrics() const { return _metrics.get(); }
+
+		/* @brief Attach measurements to the result */
+		OpRes& attach(std::shared_ptr<Metrics> metrics)
+		{
+			_metrics = std::move(metrics);
+			return *this;
+		}
 	};
 }
\ No newline at end of file
@@ -25,15 +25,22 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <vector>
 #include <assert.h>
 #include <functional>
+#include <memory>
+#include <utility>
 
 #define RNP_NO_DEPRECATED
 #include <rnp/rnp.h>
 
 #include "pgpsuite_common.h"
+#include "BufferPool.h"
+#include "FileSink.h"
+#include "FileSource.h"
+#include "Tracing.h"
 
 /* A collection of wrapper classes that utilize RAII to clean up the rnp C-objects
 * The wrapper classes can all be cast to their original C-type 
@@ -66,21 +73,93 @@ namespace rnp
         }
     }   
 
+    /* Deleter policies, each releases one kind of rnp handle
+    * They are stateless and picked at compile time, so a Handle is no larger than the raw handle and the call is direct */
+    struct FFIDeleter { void operator()(rnp_ffi_t ffi) const { rnp_ffi_destroy(ffi); } };
+    struct InputDeleter { void operator()(rnp_input_t input) const { rnp_input_destroy(input); } };
+    struct OutputDeleter { void operator()(rnp_output_t output) const { rnp_output_destroy(output); } };
+    struct KeyDeleter { void operator()(rnp_key_handle_t key) const { rnp_key_handle_destroy(key); } };
+    struct IteratorDeleter { void operator()(rnp_identifier_iterator_t it) const { rnp_identifier_iterator_destroy(it); } };
+    struct EncryptOpDeleter { void operator()(rnp_op_encrypt_t op) const { rnp_op_encrypt_destroy(op); } };
+    struct SignOpDeleter { void operator()(rnp_op_sign_t op) const { rnp_op_sign_destroy(op); } };
+    struct VerifyOpDeleter { void operator()(rnp_op_verify_t op) const { rnp_op_verify_destroy(op); } };
+
+    /* Owns an rnp handle and releases it with _Deleter, can be moved but not copied
+    * Converts to the raw handle so it can be passed to rnp functions directly
+    @param _Handle: the rnp handle type
+    @param _Deleter: policy that releases the handle */
+    template<typename _Handle, typename _Deleter>
+    class Handle
+    {
+    protected:
+        _Handle _handle{ nullptr };
+    public:
+        Handle() = default;
+        explicit Handle(_Handle handle) : _handle(handle) {}
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        Handle(Handle&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+        Handle& operator=(Handle&& other) noexcept
+        {
+            if (this != &other) reset(std::exchange(other._handle, nullptr));
+            return *this;
+        }
+        ~Handle() { reset(); }
+
+        /* @brief Release the current handle and take ownership of another */
+        void reset(_Handle handle = nullptr)
+        {
+            if (_handle != nullptr) _Deleter{}(_handle);
+            _handle = handle;
+        }
+
+        /* @return The handle, which the caller now has to release */
+        _Handle release() { return std::exchange(_handle, nullptr); }
+
+        /* @return Address for rnp functions that create a handle, the current one is released first */
+        _Handle* put()
+        {
+            reset();
+            return &_handle;
+        }
+
+        _Handle get() const { return _handle; }
+        operator _Handle() const { return _handle; } /* To allow passing this object as its underlying C-type */
+    };
+
+    using KeyHandle = Handle<rnp_key_handle_t, KeyDeleter>;
+    using IdentifierIterator = Handle<rnp_identifier_iterator_t, IteratorDeleter>;
+    using SignOperation = Handle<rnp_op_sign_t, SignOpDeleter>;
+    using VerifyOperation = Handle<rnp_op_verify_t, VerifyOpDeleter>;
+
     /* Interface for the IO wrappers, handles deletion and io mode setting
-    @param _IO type of the io object to be wrapped */
-    template<typename _IO_Object>
+    @param _IO_Object: type of the io object to be wrapped
+    @param _Deleter: policy that destroys the io object */
+    template<typename _IO_Object, typename _Deleter>
     struct IIOWrapper
     {
-        using Destructor = std::function<void(_IO_Object)>;
-
-        IIOWrapper(Destructor func) : _destructor(func) {}
+        IIOWrapper() = default;
         IIOWrapper(const IIOWrapper&) = delete;
+        IIOWrapper& operator=(const IIOWrapper&) = delete;
+        IIOWrapper(IIOWrapper&& other) noexcept
+            : io_object(std::exchange(other.io_object, nullptr)), _io_mode(std::exchange(other._io_mode, IOMode::None))
+        {}
+        IIOWrapper& operator=(IIOWrapper&& other) noexcept
+        {
+            if (this == &other) return *this;
+
+            destroy();
+            io_object = std::exchange(other.io_object, nullptr);
+            _io_mode = std::exchange(other._io_mode, IOMode::None);
+            return *this;
+        }
         ~IIOWrapper() { destroy(); }
         operator _IO_Object() { return io_object; }
 
         void destroy()
         {
-            if (is_io_set()) _destructor(io_object);
+            if (is_io_set() && io_object != nullptr) _Deleter{}(io_object);
+            io_object = nullptr;
             _io_mode = IOMode::None;
         }
 
@@ -95,7 +174,6 @@ namespace rnp
         bool is_io(IOMode mode) const { return _io_mode == mode; }
     protected:
         IOMode _io_mode{ IOMode::None };
-        Destructor _destructor; /* function to destroy the io object */
 
         /* @brief Prepare input to be set, will delete old input
         @param mode The io mode that the input is preparing for */
@@ -106,36 +184,32 @@ namespace rnp
         }
     };
 
-    /* Simple ffi wrapper to handle automatic clean up */
+    /* Simple ffi wrapper to handle automatic clean up, can be moved so ffi's can be pooled */
     struct FFI
+        : public Handle<rnp_ffi_t, FFIDeleter>
     {
         FFI(std::string pub_format, std::string sec_format)
         {
-            rnp_ffi_create(&ffi, pub_format.c_str(), sec_format.c_str());
+            pgp::trace::Span span("create ffi");
+            rnp_ffi_create(put(), pub_format.c_str(), sec_format.c_str());
         }
-        FFI(const FFI&) = delete;
+        FFI(FFI&&) noexcept = default;
+        FFI& operator=(FFI&&) noexcept = default;
+        /* the ffi goes before the provider it might still call */
         ~FFI() { destroy(); }
 
-        rnp_ffi_t ffi = nullptr;
-        operator bool() { return ffi != nullptr; }
-        operator rnp_ffi_t() { return ffi; } /* To allow passing this object as its underlying C-type */
+        /* context of a key provider set on this ffi, kept alive as long as the ffi */
+        std::shared_ptr<void> provider_context;
 
-        void destroy()
-        {
-            if (ffi == nullptr) return;
-            rnp_ffi_destroy(ffi);
-            ffi = nullptr;
-        }
+        void destroy() { reset(); }
     };
 
     /* Simple rnp_output_t wrapper, automatically cleans itself up via RAII
     * Also automatically destroys old output when setting new output
     * It outputs data from here to somewhere like a file*/
     struct Output
-        : public IIOWrapper<rnp_output_t>
+        : public IIOWrapper<rnp_output_t, OutputDeleter>
     {
-        Output() : IIOWrapper(rnp_output_destroy) {}
-
         /* @return A copy of the data in the internal buffer */
         std::vector<uint8_t> get_memory_buffer()
         {
@@ -177,6 +251,28 @@ namespace rnp
             return rnp_output_to_callback(&io_object, callback, closer, app_context);
         }
 
+        /* @brief Set output to a pooled buffer, unlike memory output the buffer is reused between operations
+        @param sink: buffer the data is appended to, has to outlive the output */
+        rnp_result_t set_output_to_buffer(pgp::utils::PooledBuffer& sink)
+        {
+            return set_output_to_callback(pgp::utils::PooledBuffer::writer_callback, nullptr, &sink);
+        }
+
+        /* @brief Set output to a file sink, it has to be open and is committed by the caller after destroying the output
+        @param sink: receives the data, has to outlive the output */
+        rnp_result_t set_output_to_sink(pgp::utils::FileSink& sink)
+        {
+            return set_output_to_callback(pgp::utils::FileSink::writer_callback, nullptr, &sink);
+        }
+
+        /* @brief Initialize output to discard everything written to it */
+        rnp_result_t set_output_to_null()
+        {
+            prepare_io(IOMode::Callback);
+
+            return rnp_output_to_null(&io_object);
+        }
+
         rnp_result_t set_output_to_path(std::string path)
         {
             prepare_io(IOMode::Path);
@@ -192,10 +288,8 @@ namespace rnp
     * Also automatically destroys old input when setting new input
     * It inputs data from somewhere to here */
     struct Input
-        : public IIOWrapper<rnp_input_t>
+        : public IIOWrapper<rnp_input_t, InputDeleter>
     {
-        Input() : IIOWrapper(rnp_input_destroy) {}
-
         /* @brief Opens the given path for loading data */
         rnp_result_t set_input_from_path(std::string path)
         {
@@ -213,6 +307,23 @@ namespace rnp
 
             return rnp_input_from_memory(&io_object, data, size, copy);
         }
+
+        /* @brief Set input to a callback, allows streaming data that is produced on the fly
+        @param reader: The callback used to read data from the input stream
+        @param closer: Callback used to close the input stream
+        @param app_context: Context parameter that will be passed to the callbacks */
+        rnp_result_t set_input_from_callback(rnp_input_reader_t reader, rnp_input_closer_t closer, void* app_context)
+        {
+            prepare_io(IOMode::Callback);
+
+            return rnp_input_from_callback(&io_object, reader, closer, app_context);
+        }
+
+        /* @brief Initialize input to read from a file source, which has to stay alive as long as the input is used */
+        rnp_result_t set_input_from_source(pgp::utils::FileSource& source)
+        {
+            return set_input_from_callback(pgp::utils::FileSource::reader_callback, nullptr, &source);
+        }
     };
 
     /* Wrapper for rnp buffers
@@ -254,30 +365,17 @@ namespace rnp
     struct EncryptOperation
     {
         EncryptOperation() = default;
-        EncryptOperation(FFI& ffi, Input& input, Output& output)
-        {
-            create(ffi, input, output);
-        }
-        EncryptOperation(const EncryptOperation&) = delete;
-        ~EncryptOperation() { destroy(); }
 
-        rnp_op_encrypt_t op{ nullptr };
+        Handle<rnp_op_encrypt_t, EncryptOpDeleter> op;
 
-        /* Will throw upon failure to create 
+        /* Has to succeed before anything else is called, does not throw so it is safe on worker threads
         *  If object was already created the old one will be destroyed */
-        void create(FFI& ffi, Input& input, Output& output)
+        rnp_result_t create(FFI& ffi, Input& input, Output& output)
         {
-            destroy();
-            if (rnp_op_encrypt_create(&op, ffi, input, output) != RNP_SUCCESS)
-                throw std::exception("Failed to create Encryption Operation");
+            return rnp_op_encrypt_create(op.put(), ffi, input, output);
         }
 
-        void destroy()
-        {
-            if (op == nullptr) return;
-            rnp_op_encrypt_destroy(op);
-            op = nullptr;
-        }
+        void destroy() { op.reset(); }
 
         /* Setters */
         /* Set wether output will be set to binary or plaintext */
@@ -327,6 +425,7 @@ namespace rnp
         /* Execute encryption operation */
         rnp_result_t execute()
         {
+            pgp::trace::Span span("encrypt execute");
             const auto res = rnp_op_encrypt_execute(op);
             validate_result(res, "Error executing encryption operation");
             return res;
@@ -340,12 +439,12 @@ namespace rnp
         bool _is_password_protected{ false };
         bool _is_key_protected{ false };
 
-        static bool data_has_header(const std::string& data, std::string header)
+        static bool data_has_header(std::string_view data, std::string_view header)
         {
             return data.find(header, 0) != data.npos;
         }
 
-        void parse(std::string data)
+        void parse(std::string_view data)
         {
             _is_key_protected = data_has_header(data, "Public-key encrypted session key packet");
             _is_password_protected = data_has_header(data, "Symmetric-key encrypted session key packet");
@@ -362,23 +461,17 @@ namespace rnp
             Input filedata;
             Output output;
 
-            /* save packet info here */
-            std::string raw_data; 
+            /* save packet info here, the pooled buffer reuses the memory of earlier parses */
+            pgp::utils::PooledBuffer raw_data(16 * 1024);
 
             if (filedata.set_input_from_path(filename) != RNP_SUCCESS) return "Could not find: " + filename;
-            output.set_output_to_callback([](void* context, const void* buf, size_t len)
-                { /* write packet data to raw_data */
-                    std::string* data = static_cast<std::string*>(context);
-                    *data = std::string((const char*)buf, (const char*)buf + len);
-
-                    return data->size() == len;
-                }, nullptr, &raw_data);
+            output.set_output_to_buffer(raw_data);
 
             if (rnp_dump_packets_to_output(filedata, output, 0) != RNP_SUCCESS) return "Failed dumping packets";
             
             output.destroy(); /* only on destruction will output actually dump the packets */
 
-            parse(std::move(raw_data));
+            parse(std::string_view(reinterpret_cast<const char*>(raw_data.data()), raw_data.size()));
             
             return true;
         }
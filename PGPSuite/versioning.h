@@ -24,6 +24,11 @@
 #pragma once
 
 #include "Networks.h"
+#include "PersistentData.h"
+#include "IOwx.h"
+
+#include <ctime>
+#include <functional>
 
 #include <wx/txtstrm.h>
 #include <wx/sstream.h>
@@ -51,23 +56,106 @@ namespace suite::ver
         return response.substr(start + 1, end - start - 1);
     }
 
-    /* Retrieves newest version from network location and caches it */
-    inline std::string retrieve_version()
+    /* Where the newest version is published, configurable through the [version] section of settings.ini */
+    struct Endpoint
     {
-        static std::string cached_version{};
-        if (!cached_version.empty()) 
-            return cached_version;
+        std::string server{ "www.vapt.nl" };
+        std::string port{ "443" };
+        std::string path{ "/pgpsuite_version.txt" };
+        std::chrono::milliseconds timeout{ std::chrono::seconds(5) };
+    };
+
+    /* @brief Read the endpoint from the settings, only call from the ui thread */
+    inline Endpoint get_endpoint()
+    {
+        const auto section = persistent::settings().get("version");
+        Endpoint endpoint;
+
+        if (section.has("server")) endpoint.server = section.get("server");
+        if (section.has("port")) endpoint.port = section.get("port");
+        if (section.has("path")) endpoint.path = section.get("path");
+
+        try { if (section.has("timeout_ms")) endpoint.timeout = std::chrono::milliseconds(std::stoll(section.get("timeout_ms"))); }
+        catch (const std::exception&) {}
 
-        const auto response = net::get_network_data();
-        cached_version = parse_version(response);
+        return endpoint;
+    }
 
-        if (cached_version.empty())
+    /* @brief Query the endpoint for the newest version, does not touch wx or the settings so it can run on any thread
+    @return The newest version, empty if it could not be retrieved */
+    inline std::string fetch_version(const Endpoint& endpoint)
+    {
+        return parse_version(net::get_network_data(endpoint.server, endpoint.port, endpoint.path, endpoint.timeout));
+    }
+
+    /* @brief Look up the newest version from the last successful check
+    @return False if there is none or it is older than [version] cache_ttl seconds (a day by default) */
+    inline bool cached_version(std::string& latest)
+    {
+        const auto section = persistent::settings().get("version");
+        long long ttl = 24 * 60 * 60;
+
+        if (!section.has("latest") || !section.has("checked_at")) return false;
+
+        try
+        {
+            if (section.has("cache_ttl")) ttl = std::stoll(section.get("cache_ttl"));
+
+            const auto age = static_cast<long long>(std::time(nullptr)) - std::stoll(section.get("checked_at"));
+            if (age < 0 || age >= ttl) return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        latest = section.get("latest");
+        return !latest.empty();
+    }
+
+    /* @brief Remember the result of a successful check */
+    inline void store_version(const std::string& latest)
+    {
+        auto& settings = persistent::settings();
+
+        settings["version"]["latest"] = latest;
+        settings["version"]["checked_at"] = std::to_string(static_cast<long long>(std::time(nullptr)));
+
+        persistent::save_settings();
+    }
+
+    /* Retrieves newest version from network location and caches it
+    @param use_cache: accept the result of an earlier check if it has not expired yet */
+    inline std::string retrieve_version(bool use_cache = true)
+    {
+        std::string latest;
+        if (use_cache && cached_version(latest))
+            return latest;
+
+        latest = fetch_version(get_endpoint());
+
+        if (latest.empty())
         {
             wxMessageBox(_("Could not reach host, check your internet connection."), _("Error."), wxICON_ERROR);
             return "";
         }
 
-        return cached_version;
+        store_version(latest);
+        return latest;
+    }
+
+    /* @brief Check for a new version on a background thread
+    * The result is cached and handed to the callback on the ui thread, an empty string if the check failed
+    * Nothing waits for the check, if the window is gone by the time it finishes the callback is skipped
+    @param window: window the callback belongs to */
+    inline void check_version_async(wxWindow* window, std::function<void(const std::string&)> callback)
+    {
+        io::run_in_background(window, [endpoint = get_endpoint()]() { return fetch_version(endpoint); },
+            [callback](std::string latest)
+            {
+                if (!latest.empty()) store_version(latest);
+                callback(latest);
+            });
     }
 
     /* Retrieves local version and caches it */
@@ -90,12 +178,11 @@ namespace suite::ver
         return cached_version = input.ReadLine();
     }
 
-    /* Checks if the local version is up-to-date, otherwise it displays a dialogue giving the latest version
+    /* @brief Compare the local version against the given latest version, shows a dialogue giving the latest version if they differ
     @return If local version is up-to-date */
-    inline bool verify_local_version()
+    inline bool notify_if_outdated(const wxString& latest_version)
     {
         const auto local_version = get_local_version();
-        const auto latest_version = retrieve_version();
 
         const auto res = compare(local_version, latest_version);
 
@@ -106,4 +193,12 @@ namespace suite::ver
 
         return res;
     }
+
+    /* Checks if the local version is up-to-date, otherwise it displays a dialogue giving the latest version
+    @param use_cache: accept the result of an earlier check if it has not expired yet
+    @return If local version is up-to-date */
+    inline bool verify_local_version(bool use_cache = false)
+    {
+        return notify_if_outdated(retrieve_version(use_cache));
+    }
 }
\ No newline at end of file